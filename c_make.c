@@ -26,8 +26,12 @@ C_MAKE_ENTRY()
         case TargetBuild:
         {
             const char *target_c_compiler = get_target_c_compiler();
+            const char *config_file = c_string_path_concat(get_build_path(), "c_make.txt");
 
             Command cmd = { 0 };
+            Command link_flags = { 0 };
+
+            const char *system_info_sources[] = { c_string_path_concat(get_source_path(), "src", "system_info.c") };
 
             command_append(&cmd, target_c_compiler);
             command_append_command_line(&cmd, get_target_c_flags());
@@ -49,15 +53,11 @@ C_MAKE_ENTRY()
                 command_append(&cmd, "-ObjC");
             }
 
-            command_append_output_executable(&cmd, c_string_path_concat(get_build_path(), "system_info"), get_target_platform());
-            command_append(&cmd, c_string_path_concat(get_source_path(), "src", "system_info.c"));
-            command_append_default_linker_flags(&cmd, get_target_architecture());
-
             switch (get_target_platform())
             {
                 case PlatformAndroid:
                 {
-                    command_append(&cmd, "-lEGL");
+                    command_append(&link_flags, "-lEGL");
                 } break;
 
                 case PlatformFreeBsd:
@@ -70,12 +70,12 @@ C_MAKE_ENTRY()
 
                 case PlatformLinux:
                 {
-                    command_append(&cmd, "-lwayland-client", "-lEGL");
+                    command_append(&link_flags, "-lwayland-client", "-lEGL");
                 } break;
 
                 case PlatformMacOs:
                 {
-                    command_append(&cmd, "-framework", "Foundation", "-framework", "Metal");
+                    command_append(&link_flags, "-framework", "Foundation", "-framework", "Metal");
                 } break;
 
                 case PlatformWeb:
@@ -83,22 +83,42 @@ C_MAKE_ENTRY()
                 } break;
             }
 
-            c_make_log(LogLevelInfo, "compile 'system_info'\n");
-            command_run_and_reset(&cmd);
+            graph_add_executable(c_string_path_concat(get_build_path(), "system_info"), cmd,
+                                 ArrayCount(system_info_sources), system_info_sources, 1, &config_file, link_flags);
+            cmd.count = 0;
+            link_flags.count = 0;
+
+            const char *bdf2h_sources[] = { c_string_path_concat(get_source_path(), "src", "bdf2h.c") };
 
             command_append(&cmd, target_c_compiler);
             command_append_command_line(&cmd, get_target_c_flags());
             command_append_default_compiler_flags(&cmd, get_build_type());
 
-            command_append_output_executable(&cmd, c_string_path_concat(get_build_path(), "bdf2h"), get_target_platform());
-            command_append(&cmd, c_string_path_concat(get_source_path(), "src", "bdf2h.c"));
-            command_append_default_linker_flags(&cmd, get_target_architecture());
-
-            c_make_log(LogLevelInfo, "compile 'bdf2h'\n");
-            command_run_and_reset(&cmd);
+            graph_add_executable(c_string_path_concat(get_build_path(), "bdf2h"), cmd,
+                                 ArrayCount(bdf2h_sources), bdf2h_sources, 1, &config_file, link_flags);
+            cmd.count = 0;
+            link_flags.count = 0;
         } break;
 
         case TargetInstall:
+        {
+            const char *executable_suffix = (get_target_platform() == PlatformWindows) ? ".exe" : "";
+            const char *programs[] = { "system_info", "bdf2h" };
+
+            InstallManifest manifest = { 0 };
+
+            for (size_t i = 0; i < ArrayCount(programs); i += 1)
+            {
+                const char *program = c_string_concat(programs[i], executable_suffix);
+
+                install_manifest_add(&manifest, c_string_path_concat(get_build_path(), program),
+                                     c_string_path_concat("bin", program), 0755);
+            }
+
+            install(manifest);
+        } break;
+
+        case TargetTest:
         {
         } break;
     }
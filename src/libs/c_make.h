@@ -132,6 +132,10 @@ typedef HANDLE CMakeProcessId;
 
 #  include <dirent.h>
 #  include <sys/wait.h>
+#  include <sys/resource.h>
+#  if !C_MAKE_PLATFORM_ANDROID
+#    include <spawn.h>
+#  endif
 
 typedef pid_t CMakeProcessId;
 
@@ -146,6 +150,7 @@ typedef pid_t CMakeProcessId;
 #endif
 
 #include <stddef.h>
+#include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -158,6 +163,7 @@ typedef enum CMakeTarget
     CMakeTargetSetup   = 0,
     CMakeTargetBuild   = 1,
     CMakeTargetInstall = 2,
+    CMakeTargetTest    = 3,
 } CMakeTarget;
 
 #if !defined(C_MAKE_NO_ENTRY_POINT)
@@ -201,13 +207,33 @@ typedef enum CMakeBuildType
     CMakeBuildTypeDebug    = 0,
     CMakeBuildTypeRelDebug = 1,
     CMakeBuildTypeRelease  = 2,
+    // Release build with link time optimization.
+    CMakeBuildTypeReleaseLto   = 3,
+    // Release build that records profile data in c_make_get_profile_path() when run.
+    CMakeBuildTypePgoGenerate  = 4,
+    // Release build that optimizes with the profile data recorded by 'pgo_generate'.
+    CMakeBuildTypePgoUse       = 5,
 } CMakeBuildType;
 
+// A memory block is followed by 'size' bytes of usable memory. Blocks are chained, so
+// that a memory can grow without moving earlier allocations. The offset of a block is
+// the position of its first byte in the whole memory.
+typedef struct CMakeMemoryBlock
+{
+    struct CMakeMemoryBlock *prev;
+    struct CMakeMemoryBlock *next;
+    size_t offset;
+    size_t size;
+} CMakeMemoryBlock;
+
+// 'used' and 'allocated' are offsets over all blocks of the memory. 'base' points
+// to the usable memory of the current block.
 typedef struct CMakeMemory
 {
     size_t used;
     size_t allocated;
     void *base;
+    CMakeMemoryBlock *block;
 } CMakeMemory;
 
 typedef struct CMakeTemporaryMemory
@@ -258,18 +284,115 @@ typedef struct CMakeConfig
     CMakeConfigEntry *items;
 } CMakeConfig;
 
+typedef struct CMakeOutputBuffer
+{
+    int fd;
+    size_t count;
+    size_t allocated;
+    char *data;
+} CMakeOutputBuffer;
+
 typedef struct CMakeProcess
 {
     CMakeProcessId id;
     bool exited;
     bool succeeded;
+    bool cancelled;
+
+    const char *command;
+    const char *dependency_file;
+
+    // Captured standard output and standard error.
+    CMakeOutputBuffer output[2];
+
+    // Hash of the command line and the memory in kilobytes the command is expected to use.
+    uint64_t command_hash;
+    uint64_t memory_weight;
+
+    // Jobserver token that was taken for the process. It is returned when the process exits.
+    bool has_token;
+    char token;
+
+    // Time in microseconds at which the process is killed, 0 if it has no timeout. On posix
+    // a process with a timeout runs in its own process group, which is killed as a whole.
+    uint64_t timeout_time;
+    bool timed_out;
+
+    // Only used when tracing is enabled.
+    const char *trace_name;
+    size_t trace_slot;
+
+    // All times are in microseconds, the resident size is in kilobytes.
+    uint64_t start_time;
+    uint64_t wall_time;
+    uint64_t user_time;
+    uint64_t system_time;
+    uint64_t max_resident_size;
 } CMakeProcess;
 
 typedef struct CMakeDirectoryEntry
 {
     CMakeString name;
+    bool is_directory;
 } CMakeDirectoryEntry;
 
+typedef struct CMakeFileList
+{
+    size_t count;
+    const char **items;
+} CMakeFileList;
+
+typedef struct CMakeInstallFile
+{
+    const char *source;
+    const char *destination;
+    uint32_t mode;
+} CMakeInstallFile;
+
+typedef struct CMakeInstallManifest
+{
+    size_t count;
+    size_t allocated;
+    CMakeInstallFile *items;
+} CMakeInstallManifest;
+
+typedef enum CMakeTestResult
+{
+    CMakeTestResultNotRun    = 0,
+    CMakeTestResultRunning   = 1,
+    CMakeTestResultPassed    = 2,
+    CMakeTestResultFailed    = 3,
+    CMakeTestResultTimedOut  = 4,
+    CMakeTestResultCancelled = 5,
+} CMakeTestResult;
+
+typedef struct CMakeTest
+{
+    const char *name;
+    CMakeCommand command;
+    // Timeout in seconds, 0 uses the 'test_timeout' config value.
+    uint32_t timeout;
+
+    CMakeTestResult result;
+    CMakeProcessId process_id;
+
+    // Wall time in microseconds and resident size in kilobytes of the last run.
+    uint64_t wall_time;
+    uint64_t max_resident_size;
+} CMakeTest;
+
+typedef struct CMakeTestList
+{
+    size_t count;
+    size_t allocated;
+    CMakeTest *items;
+
+    // Tests before this index were already run by c_make_test_run().
+    size_t run_count;
+
+    CMakeMemory memory;
+} CMakeTestList;
+
 typedef struct CMakeDirectory
 {
     CMakeDirectoryEntry entry;
@@ -290,15 +413,316 @@ typedef struct CMakeProcessGroup
     CMakeProcess *items;
 } CMakeProcessGroup;
 
+typedef struct CMakeMapSlot
+{
+    uint64_t hash;
+    CMakeString key;
+    size_t index;
+} CMakeMapSlot;
+
+typedef struct CMakeMap
+{
+    size_t count;
+    size_t allocated;
+    CMakeMapSlot *slots;
+} CMakeMap;
+
+typedef struct CMakeFileHash
+{
+    CMakeString path;
+    uint64_t hash;
+    uint64_t size;
+    uint64_t modification_time;
+} CMakeFileHash;
+
+typedef struct CMakeOutputHash
+{
+    CMakeString path;
+    bool has_inputs_hash;
+    bool is_pending;
+    uint64_t inputs_hash;
+    uint64_t pending_inputs_hash;
+    uint64_t output_hash;
+} CMakeOutputHash;
+
+typedef struct CMakeHashDatabase
+{
+    bool is_loaded;
+    bool is_dirty;
+
+    CMakeMap file_map;
+    size_t file_count;
+    size_t file_allocated;
+    CMakeFileHash *files;
+
+    CMakeMap output_map;
+    size_t output_count;
+    size_t output_allocated;
+    CMakeOutputHash *outputs;
+} CMakeHashDatabase;
+
+typedef struct CMakeDependencies
+{
+    CMakeString target;
+    size_t count;
+    CMakeString *items;
+} CMakeDependencies;
+
+typedef struct CMakeDependencyDatabase
+{
+    bool is_loaded;
+    bool is_dirty;
+
+    CMakeMap map;
+    size_t count;
+    size_t allocated;
+    CMakeDependencies *items;
+} CMakeDependencyDatabase;
+
+typedef struct CMakeCommandHistory
+{
+    // Hash of the command line as 16 hex digits.
+    CMakeString command_hash;
+    // Largest resident size in kilobytes that was measured for the command.
+    uint64_t max_resident_size;
+    // Average wall time of the last runs in microseconds.
+    uint64_t wall_time;
+} CMakeCommandHistory;
+
+typedef struct CMakeHistory
+{
+    bool is_loaded;
+    bool is_dirty;
+
+    CMakeMap map;
+    size_t count;
+    size_t allocated;
+    CMakeCommandHistory *items;
+} CMakeHistory;
+
+typedef struct CMakeBuildLogAction
+{
+    uint64_t command_hash;
+    size_t input_count;
+    size_t output_count;
+    // Indices into the files of the build log, first the inputs, then the outputs.
+    uint32_t *files;
+} CMakeBuildLogAction;
+
+// The build log records all actions of the last build together with the size and
+// modification time of every file they used. If that build succeeded and none of the files
+// changed, the next build returns without running the build script.
+typedef struct CMakeBuildLog
+{
+    bool is_recording;
+    // Cleared if the build did something the log can't check, like running a command
+    // outside of the build graph.
+    bool is_valid;
+
+    uint64_t key;
+    // Modification time of the build log file when the build started. Inputs that are newer
+    // than this were changed while the build was running.
+    uint64_t start_time;
+
+    CMakeMap file_map;
+    size_t file_count;
+    size_t file_allocated;
+    const char **files;
+
+    size_t action_count;
+    size_t action_allocated;
+    CMakeBuildLogAction *actions;
+
+    // The command hash of every output in the log of the previous build. An output is
+    // rebuilt if the command that writes it changed since then.
+    CMakeMap previous_output_map;
+    size_t previous_output_count;
+    const char **previous_outputs;
+    uint64_t *previous_command_hashes;
+
+    CMakeMemory memory;
+} CMakeBuildLog;
+
+// A jobserver shares the number of parallel jobs between all processes of a build, e.g. a
+// make that runs c_make, which runs another make. Every job except the first one of each
+// process needs a token, which is a byte read from the jobserver and written back after
+// the job is done.
+typedef struct CMakeJobserver
+{
+    bool is_initialized;
+    bool is_active;
+    int read_fd;
+    int write_fd;
+
+    // Only set if this process created the jobserver as a fifo.
+    const char *fifo_path;
+
+    // MAKEFLAGS before the jobserver was added, 0 if it wasn't set.
+    const char *saved_makeflags;
+} CMakeJobserver;
+
+typedef enum CMakeActionState
+{
+    CMakeActionStateWaiting  = 0,
+    CMakeActionStateReady    = 1,
+    CMakeActionStateRunning  = 2,
+    CMakeActionStateFinished = 3,
+    CMakeActionStateFailed   = 4,
+    CMakeActionStateSkipped  = 5,
+} CMakeActionState;
+
+typedef struct CMakeAction
+{
+    const char *description;
+    CMakeCommand command;
+
+    size_t input_count;
+    const char **inputs;
+    size_t output_count;
+    const char **outputs;
+
+    CMakeActionState state;
+    CMakeProcessId process_id;
+
+    // Estimated memory use in kilobytes, 0 if unknown.
+    uint64_t memory_weight;
+
+    // Predicted wall time in microseconds of the longest chain of actions that starts
+    // with this action. Ready actions with the highest priority run first.
+    uint64_t priority;
+    // Measured wall time in microseconds, 0 if the command didn't run.
+    uint64_t wall_time;
+
+    // Set if an input was changed since the last run. Only used in watch mode.
+    bool input_changed;
+    // Set once the action is known to be out of date, while it waits for a free job slot.
+    bool is_outdated;
+
+    size_t pending_input_count;
+    size_t dependent_count;
+    size_t dependent_allocated;
+    size_t *dependents;
+} CMakeAction;
+
+typedef struct CMakeGraph
+{
+    size_t count;
+    size_t allocated;
+    CMakeAction *items;
+
+    // In watch mode the actions are kept after a run, so that a change to a
+    // file only reruns the actions that depend on it.
+    bool keep_actions;
+    bool only_changed_inputs;
+
+    CMakeMemory memory;
+} CMakeGraph;
+
+typedef struct CMakeWatchedDirectory
+{
+    int watch_descriptor;
+    const char *path;
+
+    // Set for directories that were listed with c_make_directory_open.
+    // Adding or removing an entry reruns the whole build target.
+    bool is_listed;
+} CMakeWatchedDirectory;
+
+typedef struct CMakeWatcher
+{
+    bool is_active;
+    int fd;
+
+    CMakeMap directory_map;
+    size_t directory_count;
+    size_t directory_allocated;
+    CMakeWatchedDirectory *directories;
+
+    size_t listed_count;
+    size_t listed_allocated;
+    const char **listed;
+
+    CMakeMap file_map;
+
+    CMakeMemory memory;
+    CMakeMemory file_memory;
+} CMakeWatcher;
+
+typedef struct CMakeTraceEvent
+{
+    const char *name;
+    const char *command;
+    const char *status;
+    int code;
+    size_t slot;
+
+    // All times are in microseconds, the resident size is in kilobytes.
+    uint64_t start_time;
+    uint64_t end_time;
+    uint64_t user_time;
+    uint64_t system_time;
+    uint64_t max_resident_size;
+} CMakeTraceEvent;
+
+typedef struct CMakeTrace
+{
+    uint64_t start_time;
+
+    size_t count;
+    size_t allocated;
+    CMakeTraceEvent *items;
+
+    CMakeMemory memory;
+} CMakeTrace;
+
+typedef struct CMakeFileStatus
+{
+    CMakeString path;
+    uint64_t generation;
+
+    // 0 if the file exists, otherwise the errno of the failed stat.
+    int error;
+    bool is_directory;
+    bool is_regular_file;
+    uint64_t size;
+    uint64_t modification_time;
+} CMakeFileStatus;
+
+typedef struct CMakeFileStatusCache
+{
+    uint64_t generation;
+
+    CMakeMap map;
+    size_t count;
+    size_t allocated;
+    CMakeFileStatus *items;
+
+    CMakeMemory memory;
+} CMakeFileStatusCache;
+
 typedef struct CMakeContext
 {
     bool verbose;
     bool did_fail;
     bool sequential;
+    bool fail_fast;
+    bool cancelled;
+    bool cache_was_used;
+    bool trace_enabled;
+    bool report_enabled;
+
+    int max_jobs;
+
+    // Set with '--shard <i>/<n>', only every n-th test starting with the i-th is run.
+    // Both are 0 if all tests run.
+    size_t test_shard_index;
+    size_t test_shard_count;
 
     CMakePlatform target_platform;
     CMakeArchitecture target_architecture;
     CMakeBuildType build_type;
+    const char *build_settings_file;
+    const char *profile_path;
 
     const char *build_path;
     const char *source_path;
@@ -309,6 +733,28 @@ typedef struct CMakeContext
     CMakeMemory temporary_memories[2];
 
     CMakeProcessGroup process_group;
+    CMakeMemory process_memory;
+
+    CMakeGraph graph;
+    CMakeTestList tests;
+    CMakeTrace trace;
+    CMakeWatcher watcher;
+
+    CMakeHashDatabase hash_database;
+    CMakeDependencyDatabase dependency_database;
+    CMakeFileStatusCache file_status_cache;
+    CMakeHistory history;
+    CMakeBuildLog build_log;
+    CMakeJobserver jobserver;
+
+    // The SIGCHLD handler writes to this pipe, so that the exit of a process wakes up
+    // poll. The file descriptors are only valid if the handler is installed.
+    bool child_signal_installed;
+    int child_signal_pipe[2];
+
+    // Memory in kilobytes that running commands may use together, 0 if unlimited.
+    bool memory_budget_is_set;
+    uint64_t memory_budget;
 
     bool shell_initialized;
 
@@ -460,6 +906,8 @@ C_MAKE_DEF void c_make_command_append_output_executable(CMakeCommand *command, c
 C_MAKE_DEF void c_make_command_append_input_static_library(CMakeCommand *command, const char *input_path, CMakePlatform platform);
 C_MAKE_DEF void c_make_command_append_default_compiler_flags(CMakeCommand *command, CMakeBuildType build_type);
 C_MAKE_DEF void c_make_command_append_default_linker_flags(CMakeCommand *command, CMakeArchitecture architecture);
+C_MAKE_DEF void c_make_command_append_target_clones(CMakeCommand *command, CMakePlatform platform, CMakeArchitecture architecture);
+C_MAKE_DEF void c_make_command_append_dependency_file(CMakeCommand *command, const char *output_path);
 C_MAKE_DEF CMakeString c_make_command_to_string(CMakeMemory *memory, CMakeCommand command);
 
 C_MAKE_DEF bool c_make_strings_are_equal(CMakeString a, CMakeString b);
@@ -479,8 +927,11 @@ C_MAKE_DEF CMakePlatform c_make_get_target_platform(void);
 C_MAKE_DEF CMakeArchitecture c_make_get_target_architecture(void);
 C_MAKE_DEF CMakeBuildType c_make_get_build_type(void);
 C_MAKE_DEF const char *c_make_get_build_path(void);
+C_MAKE_DEF const char *c_make_get_profile_path(void);
 C_MAKE_DEF const char *c_make_get_source_path(void);
 C_MAKE_DEF const char *c_make_get_install_prefix(void);
+C_MAKE_DEF int c_make_get_processor_count(void);
+C_MAKE_DEF int c_make_get_max_jobs(void);
 
 C_MAKE_DEF const char *c_make_get_host_ar(void);
 C_MAKE_DEF const char *c_make_get_target_ar(void);
@@ -515,6 +966,7 @@ C_MAKE_DEF const char *c_make_get_java_jar(void);
 C_MAKE_DEF const char *c_make_get_java_jarsigner(void);
 C_MAKE_DEF const char *c_make_get_java_javac(void);
 C_MAKE_DEF const char *c_make_get_java_keytool(void);
+C_MAKE_DEF const char *c_make_get_llvm_profdata(void);
 
 C_MAKE_DEF bool c_make_setup_java(bool logging);
 
@@ -524,12 +976,17 @@ C_MAKE_DEF CMakeConfigValue c_make_config_get(const char *key);
 C_MAKE_DEF bool c_make_store_config(const char *file_name);
 C_MAKE_DEF bool c_make_load_config(const char *file_name);
 
+C_MAKE_DEF uint64_t c_make_hash_data(uint64_t hash, const void *data, size_t size);
+C_MAKE_DEF bool c_make_hash_file(const char *file_name, uint64_t *hash);
+
 C_MAKE_DEF bool c_make_needs_rebuild(const char *output_file, size_t input_file_count, const char **input_files);
+C_MAKE_DEF bool c_make_needs_rebuild_ignore_dependencies(const char *output_file, size_t input_file_count, const char **input_files);
 C_MAKE_DEF bool c_make_needs_rebuild_single_source(const char *output_file, const char *input_file);
 
 C_MAKE_DEF CMakeDirectory *c_make_directory_open(CMakeMemory *memory, const char *directory_name);
 C_MAKE_DEF CMakeDirectoryEntry *c_make_directory_get_next_entry(CMakeMemory *memory, CMakeDirectory *directory);
 C_MAKE_DEF void c_make_directory_close(CMakeDirectory *directory);
+C_MAKE_DEF CMakeFileList c_make_glob_files(CMakeMemory *memory, const char *pattern, bool parallel);
 
 C_MAKE_DEF bool c_make_file_exists(const char *file_name);
 C_MAKE_DEF bool c_make_directory_exists(const char *directory_name);
@@ -540,6 +997,8 @@ C_MAKE_DEF bool c_make_write_entire_file(const char *file_name, CMakeString cont
 C_MAKE_DEF bool c_make_copy_file(const char *src_file, const char *dst_file);
 C_MAKE_DEF bool c_make_rename_file(const char *old_file_name, const char *new_file_name);
 C_MAKE_DEF bool c_make_delete_file(const char *file_name);
+C_MAKE_DEF void c_make_install_manifest_add(CMakeInstallManifest *manifest, const char *source, const char *destination, uint32_t mode);
+C_MAKE_DEF bool c_make_install(CMakeInstallManifest manifest);
 
 C_MAKE_DEF bool c_make_has_slash_or_backslash(const char *path);
 C_MAKE_DEF CMakeString c_make_get_environment_variable(CMakeMemory *memory, const char *variable_name);
@@ -553,12 +1012,26 @@ C_MAKE_DEF char *c_make_c_string_concat_va(CMakeMemory *memory, size_t count, ..
 C_MAKE_DEF char *c_make_c_string_path_concat_va(CMakeMemory *memory, size_t count, ...);
 
 C_MAKE_DEF CMakeProcessId c_make_command_run(CMakeCommand command);
+C_MAKE_DEF CMakeProcessId c_make_command_run_with_redirect(CMakeCommand command, const char *stdout_file, const char *stderr_file);
 C_MAKE_DEF CMakeProcessId c_make_command_run_and_reset(CMakeCommand *command);
 C_MAKE_DEF bool c_make_process_wait(CMakeProcessId process_id);
 C_MAKE_DEF bool c_make_command_run_and_reset_and_wait(CMakeCommand *command);
 C_MAKE_DEF bool c_make_command_run_and_wait(CMakeCommand command);
 C_MAKE_DEF bool c_make_process_wait_for_all(void);
 
+C_MAKE_DEF void c_make_graph_add_action(const char *description, CMakeCommand command,
+                                        size_t input_count, const char **inputs,
+                                        size_t output_count, const char **outputs);
+C_MAKE_DEF void c_make_graph_set_memory_estimate(uint64_t megabytes);
+C_MAKE_DEF void c_make_graph_add_executable(const char *output_path, CMakeCommand compile_command,
+                                            size_t source_count, const char **sources,
+                                            size_t input_count, const char **inputs,
+                                            CMakeCommand link_flags);
+C_MAKE_DEF bool c_make_graph_run(void);
+
+C_MAKE_DEF void c_make_test_add(const char *name, CMakeCommand command, uint32_t timeout);
+C_MAKE_DEF bool c_make_test_run(void);
+
 static inline bool
 c_make_is_msvc_library_manager(const char *cmd)
 {
@@ -619,6 +1092,10 @@ c_make_config_is_enabled(const char *key, bool fallback)
     return result;
 }
 
+#if defined(C_MAKE_SEPARATE_IMPLEMENTATION) || defined(C_MAKE_IMPLEMENTATION_OBJECT)
+extern CMakeContext _c_make_context;
+#endif
+
 #ifdef __cplusplus
 }
 #endif
@@ -632,17 +1109,51 @@ c_make_config_is_enabled(const char *key, bool fallback)
 
 #  include <time.h>
 #  include <errno.h>
+#  include <signal.h>
 #  include <fcntl.h>
 #  include <unistd.h>
+#  include <poll.h>
 #  include <sys/stat.h>
+#  include <sys/time.h>
+
+#endif
+
+#if C_MAKE_PLATFORM_ANDROID || C_MAKE_PLATFORM_LINUX
+
+#  include <sys/ioctl.h>
+#  include <sys/inotify.h>
+#  include <sys/sendfile.h>
+#  include <sys/syscall.h>
+
+#  if !defined(FICLONE)
+#    define FICLONE _IOW(0x94, 9, int)
+#  endif
+
+#endif
 
+// Threads are only used where they don't need an extra library. Before version 2.34
+// glibc has pthreads in a separate library.
+#if C_MAKE_PLATFORM_WINDOWS || C_MAKE_PLATFORM_ANDROID || C_MAKE_PLATFORM_MACOS || \
+    (C_MAKE_PLATFORM_LINUX && (!defined(__GLIBC__) || (__GLIBC__ > 2) || ((__GLIBC__ == 2) && (__GLIBC_MINOR__ >= 34))))
+#  define __C_MAKE_HAS_THREADS 1
+#  if !C_MAKE_PLATFORM_WINDOWS
+#    include <pthread.h>
+#  endif
+#else
+#  define __C_MAKE_HAS_THREADS 0
 #endif
 
 #endif // __C_MAKE_INCLUDE__
 
-#if defined(C_MAKE_IMPLEMENTATION)
+// With C_MAKE_SEPARATE_IMPLEMENTATION the implementation is not compiled into the
+// build script, but linked from an object built with C_MAKE_IMPLEMENTATION_OBJECT.
+#if defined(C_MAKE_IMPLEMENTATION) && !defined(C_MAKE_SEPARATE_IMPLEMENTATION)
 
+#if defined(C_MAKE_IMPLEMENTATION_OBJECT)
+CMakeContext _c_make_context;
+#else
 static CMakeContext _c_make_context;
+#endif
 
 #if !defined(c_make_strlen)
 #  include <string.h>
@@ -655,6 +1166,33 @@ static CMakeContext _c_make_context;
 #  define c_make_malloc(a) malloc(a)
 #endif
 
+#if !defined(c_make_free)
+#  include <stdlib.h>
+#  define c_make_free(a) free(a)
+#endif
+
+// c_make.h doesn't define _GNU_SOURCE, because that has no effect once another system
+// header was included. In strict modes like -std=c99 the system headers hide some of
+// what c_make uses. Those functions are declared where they are used, the constants
+// below are part of the Linux ABI. Without O_CLOEXEC child processes inherit a few
+// file descriptors, without O_DIRECTORY a path is checked when it is read.
+#if C_MAKE_PLATFORM_ANDROID || C_MAKE_PLATFORM_LINUX
+#  if !defined(DT_UNKNOWN)
+#    define DT_UNKNOWN 0
+#    define DT_DIR 4
+#    define DT_LNK 10
+#  endif
+#  if !defined(CLOCK_MONOTONIC)
+#    define CLOCK_MONOTONIC 1
+#  endif
+#  if !defined(O_CLOEXEC)
+#    define O_CLOEXEC 0
+#  endif
+#  if !defined(O_DIRECTORY)
+#    define O_DIRECTORY 0
+#  endif
+#endif
+
 #if C_MAKE_PLATFORM_WINDOWS
 
 #  if !defined(__MINGW32__)
@@ -942,26 +1480,73 @@ c_make_log(CMakeLogLevel log_level, const char *format, ...)
     va_end(args);
 }
 
+static void
+__c_make_memory_set_block(CMakeMemory *memory, CMakeMemoryBlock *block)
+{
+    memory->block = block;
+    memory->base = (unsigned char *) block + ((sizeof(CMakeMemoryBlock) + 15) & ~15);
+    memory->allocated = block->offset + block->size;
+}
+
 C_MAKE_DEF void *
 c_make_memory_allocate(CMakeMemory *memory, size_t size)
 {
     size = (size + 15) & ~15;
 
-    if (memory->allocated == 0)
+    if (!memory->block || ((memory->used + size) > memory->allocated))
     {
-        memory->used = 0;
-        memory->allocated = 16 * 1024 * 1024;
-        memory->base = c_make_malloc(memory->allocated);
-    }
+        size_t offset = memory->block ? memory->allocated : 0;
+        CMakeMemoryBlock *block = memory->block ? memory->block->next : 0;
 
-    void *result = 0;
+        // A block that was left behind by c_make_memory_set_used is reused if it is large enough.
+        if (block && (block->size < size))
+        {
+            while (block)
+            {
+                CMakeMemoryBlock *next = block->next;
+                c_make_free(block);
+                block = next;
+            }
 
-    if ((memory->used + size) <= memory->allocated)
-    {
-        result = (unsigned char *) memory->base + memory->used;
-        memory->used += size;
+            memory->block->next = 0;
+        }
+
+        if (!block)
+        {
+            size_t block_size = 16 * 1024 * 1024;
+
+            // Leave room to grow large allocations in place with c_make_memory_reallocate.
+            if (block_size < (2 * size))
+            {
+                block_size = 2 * size;
+            }
+
+            block = (CMakeMemoryBlock *) c_make_malloc(((sizeof(CMakeMemoryBlock) + 15) & ~15) + block_size);
+
+            if (!block)
+            {
+                c_make_log(CMakeLogLevelError, "out of memory, could not allocate %zu bytes\n", block_size);
+                exit(1);
+            }
+
+            block->prev = memory->block;
+            block->next = 0;
+            block->offset = offset;
+            block->size = block_size;
+
+            if (memory->block)
+            {
+                memory->block->next = block;
+            }
+        }
+
+        __c_make_memory_set_block(memory, block);
+        memory->used = block->offset;
     }
 
+    void *result = (unsigned char *) memory->base + (memory->used - memory->block->offset);
+    memory->used += size;
+
     return result;
 }
 
@@ -973,16 +1558,27 @@ c_make_memory_reallocate(CMakeMemory *memory, void *old_ptr, size_t old_size, si
     old_size = (old_size + 15) & ~15;
     new_size = (new_size + 15) & ~15;
 
-    void *end_ptr  = (unsigned char *) old_ptr + old_size;
-    void *next_ptr = (unsigned char *) memory->base + memory->used;
-
     void *result = 0;
 
-    if (!old_ptr || (end_ptr != next_ptr))
+    if (old_ptr && memory->block)
+    {
+        void *end_ptr  = (unsigned char *) old_ptr + old_size;
+        void *next_ptr = (unsigned char *) memory->base + (memory->used - memory->block->offset);
+        size_t size = new_size - old_size;
+
+        // Grow in place if this was the last allocation and the current block has enough space left.
+        if ((end_ptr == next_ptr) && ((memory->used + size) <= memory->allocated))
+        {
+            result = old_ptr;
+            memory->used += size;
+        }
+    }
+
+    if (!result)
     {
         result = c_make_memory_allocate(memory, new_size);
 
-        if (old_ptr && result)
+        if (old_ptr)
         {
             // TODO: take advantage of the fact that old_size is a multiple of 16
             unsigned char *src = (unsigned char *) old_ptr;
@@ -994,16 +1590,6 @@ c_make_memory_reallocate(CMakeMemory *memory, void *old_ptr, size_t old_size, si
             }
         }
     }
-    else
-    {
-        size_t size = new_size - old_size;
-
-        if ((memory->used + size) <= memory->allocated)
-        {
-            result = old_ptr;
-            memory->used += size;
-        }
-    }
 
     return result;
 }
@@ -1020,6 +1606,12 @@ c_make_memory_set_used(CMakeMemory *memory, size_t used)
     assert(used <= memory->used);
     assert(!(used & 15));
 
+    // Blocks after the one containing 'used' are kept for later allocations.
+    while (memory->block && memory->block->prev && (used < memory->block->offset))
+    {
+        __c_make_memory_set_block(memory, memory->block->prev);
+    }
+
     memory->used = used;
 }
 
@@ -1265,6 +1857,58 @@ c_make_command_append_input_static_library(CMakeCommand *command, const char *in
     }
 }
 
+// Translates the config option 'target_cpu' to the flags of the compiler. gcc and clang
+// get '-march=<cpu>' for amd64 and '-mcpu=<cpu>' for all other architectures. msvc only
+// knows instruction set levels, so 'x86-64-v3' and 'x86-64-v4' map to '-arch:AVX2' and
+// '-arch:AVX512', and values like 'AVX2' or 'armv8.2' are passed to '-arch:' as is.
+// A value that starts with '-' is appended unchanged.
+static void
+__c_make_command_append_target_cpu(CMakeCommand *command, bool is_msvc)
+{
+    CMakeConfigValue target_cpu = c_make_config_get("target_cpu");
+
+    if (!target_cpu.is_valid || !target_cpu.val[0])
+    {
+        return;
+    }
+
+    CMakeString cpu = CMakeCString(target_cpu.val);
+
+    if (cpu.data[0] == '-')
+    {
+        c_make_command_append(command, target_cpu.val);
+    }
+    else if (is_msvc)
+    {
+        if (c_make_strings_are_equal(cpu, CMakeStringLiteral("x86-64-v3")))
+        {
+            c_make_command_append(command, "-arch:AVX2");
+        }
+        else if (c_make_strings_are_equal(cpu, CMakeStringLiteral("x86-64-v4")))
+        {
+            c_make_command_append(command, "-arch:AVX512");
+        }
+        else if (c_make_string_starts_with(cpu, CMakeStringLiteral("AVX")) ||
+                 c_make_string_starts_with(cpu, CMakeStringLiteral("armv8")) ||
+                 c_make_string_starts_with(cpu, CMakeStringLiteral("armv9")))
+        {
+            c_make_command_append(command, c_make_c_string_concat("-arch:", target_cpu.val));
+        }
+        else
+        {
+            c_make_log(CMakeLogLevelWarning, "target_cpu '%s' is not supported by msvc\n", target_cpu.val);
+        }
+    }
+    else if (c_make_get_target_architecture() == CMakeArchitectureAmd64)
+    {
+        c_make_command_append(command, c_make_c_string_concat("-march=", target_cpu.val));
+    }
+    else
+    {
+        c_make_command_append(command, c_make_c_string_concat("-mcpu=", target_cpu.val));
+    }
+}
+
 C_MAKE_DEF void
 c_make_command_append_default_compiler_flags(CMakeCommand *command, CMakeBuildType build_type)
 {
@@ -1293,7 +1937,17 @@ c_make_command_append_default_compiler_flags(CMakeCommand *command, CMakeBuildTy
                 {
                     c_make_command_append(command, "-O2", "-DNDEBUG");
                 } break;
+
+                case CMakeBuildTypeReleaseLto:
+                case CMakeBuildTypePgoGenerate:
+                case CMakeBuildTypePgoUse:
+                {
+                    // The profile instrumentation is selected by the linker, see c_make_command_append_default_linker_flags.
+                    c_make_command_append(command, "-O2", "-DNDEBUG", "-GL");
+                } break;
             }
+
+            __c_make_command_append_target_cpu(command, true);
         }
         else
         {
@@ -1313,7 +1967,27 @@ c_make_command_append_default_compiler_flags(CMakeCommand *command, CMakeBuildTy
                 {
                     c_make_command_append(command, "-O2", "-DNDEBUG");
                 } break;
+
+                case CMakeBuildTypeReleaseLto:
+                {
+                    c_make_command_append(command, "-O2", "-DNDEBUG", "-flto");
+                } break;
+
+                case CMakeBuildTypePgoGenerate:
+                {
+                    c_make_command_append(command, "-O2", "-DNDEBUG", "-fprofile-update=atomic",
+                                          c_make_c_string_concat("-fprofile-generate=", c_make_get_profile_path()));
+                } break;
+
+                case CMakeBuildTypePgoUse:
+                {
+                    // gcc reads the .gcda files from this directory, clang reads 'default.profdata'.
+                    c_make_command_append(command, "-O2", "-DNDEBUG",
+                                          c_make_c_string_concat("-fprofile-use=", c_make_get_profile_path()));
+                } break;
             }
+
+            __c_make_command_append_target_cpu(command, false);
         }
     }
     else
@@ -1322,26 +1996,141 @@ c_make_command_append_default_compiler_flags(CMakeCommand *command, CMakeBuildTy
     }
 }
 
+// Returns the config option 'target_clones' or the default clones of the architecture.
+static const char *
+__c_make_get_target_clones(CMakeArchitecture architecture)
+{
+    CMakeConfigValue target_clones = c_make_config_get("target_clones");
+
+    if (target_clones.is_valid)
+    {
+        return target_clones.val;
+    }
+    else if (architecture == CMakeArchitectureAmd64)
+    {
+        return "arch=x86-64-v2,arch=x86-64-v3,arch=x86-64-v4";
+    }
+    else if (architecture == CMakeArchitectureAarch64)
+    {
+        return "sve,sve2";
+    }
+
+    return "";
+}
+
+// Defines the macro C_MAKE_TARGET_CLONES for the compiled translation unit. Functions
+// that are marked with it are compiled once for every entry of the config option
+// 'target_clones' (a comma separated list of gcc/clang target_clones names) and the best
+// version is picked when the program is loaded:
+//
+//     C_MAKE_TARGET_CLONES void hot_loop(float *data, size_t count);
+//
+// This needs ifunc support, so on other platforms and with msvc the macro is empty.
+// The default clones are 'x86-64-v2', 'x86-64-v3' and 'x86-64-v4' for amd64 and 'sve'
+// and 'sve2' for aarch64.
 C_MAKE_DEF void
-c_make_command_append_default_linker_flags(CMakeCommand *command, CMakeArchitecture architecture)
+c_make_command_append_target_clones(CMakeCommand *command, CMakePlatform platform, CMakeArchitecture architecture)
 {
     if ((command->count > 0) && command->items[0])
     {
         const char *compiler = command->items[0];
+        const char *clones = 0;
 
-        if (c_make_compiler_is_msvc(compiler))
+        if (!c_make_compiler_is_msvc(compiler) &&
+            ((platform == CMakePlatformAndroid) || (platform == CMakePlatformFreeBsd) || (platform == CMakePlatformLinux)))
         {
-            c_make_command_append(command, "-link");
-            c_make_command_append_msvc_linker_flags(command, architecture);
+            clones = __c_make_get_target_clones(architecture);
         }
-    }
-    else
-    {
-        c_make_log(CMakeLogLevelWarning, "%s: you need to append a c/c++ compiler command as the first argument\n", __func__);
-    }
-}
 
-C_MAKE_DEF CMakeString
+        if (clones && clones[0])
+        {
+            CMakeString list = CMakeCString(clones);
+            CMakeString attribute = CMakeStringLiteral("-DC_MAKE_TARGET_CLONES=__attribute__((target_clones(\"default\"");
+
+            while (list.count)
+            {
+                CMakeString clone = c_make_string_trim(c_make_string_split_left(&list, ','));
+
+                if (clone.count && !c_make_strings_are_equal(clone, CMakeStringLiteral("default")))
+                {
+                    attribute = c_make_string_concat(attribute, CMakeStringLiteral(",\""), clone, CMakeStringLiteral("\""));
+                }
+            }
+
+            c_make_command_append(command, c_make_string_concat(attribute, CMakeStringLiteral(")))")).data);
+        }
+        else
+        {
+            c_make_command_append(command, "-DC_MAKE_TARGET_CLONES=");
+        }
+    }
+    else
+    {
+        c_make_log(CMakeLogLevelWarning, "%s: you need to append a c/c++ compiler command as the first argument\n", __func__);
+    }
+}
+
+C_MAKE_DEF void
+c_make_command_append_default_linker_flags(CMakeCommand *command, CMakeArchitecture architecture)
+{
+    if ((command->count > 0) && command->items[0])
+    {
+        const char *compiler = command->items[0];
+
+        if (c_make_compiler_is_msvc(compiler))
+        {
+            c_make_command_append(command, "-link");
+            c_make_command_append_msvc_linker_flags(command, architecture);
+
+            switch (_c_make_context.build_type)
+            {
+                case CMakeBuildTypeDebug:
+                case CMakeBuildTypeRelDebug:
+                case CMakeBuildTypeRelease:
+                    break;
+
+                case CMakeBuildTypeReleaseLto:
+                {
+                    c_make_command_append(command, "-LTCG");
+                } break;
+
+                case CMakeBuildTypePgoGenerate:
+                {
+                    c_make_command_append(command, "-LTCG", "-GENPROFILE");
+                } break;
+
+                case CMakeBuildTypePgoUse:
+                {
+                    c_make_command_append(command, "-LTCG", "-USEPROFILE");
+                } break;
+            }
+        }
+    }
+    else
+    {
+        c_make_log(CMakeLogLevelWarning, "%s: you need to append a c/c++ compiler command as the first argument\n", __func__);
+    }
+}
+
+C_MAKE_DEF void
+c_make_command_append_dependency_file(CMakeCommand *command, const char *output_path)
+{
+    if ((command->count > 0) && command->items[0])
+    {
+        const char *compiler = command->items[0];
+
+        if (!c_make_compiler_is_msvc(compiler))
+        {
+            c_make_command_append(command, "-MMD", "-MF", c_make_c_string_concat(output_path, ".d"), "-MT", output_path);
+        }
+    }
+    else
+    {
+        c_make_log(CMakeLogLevelWarning, "%s: you need to append a c/c++ compiler command as the first argument\n", __func__);
+    }
+}
+
+C_MAKE_DEF CMakeString
 c_make_command_to_string(CMakeMemory *memory, CMakeCommand command)
 {
     CMakeString result = { 0, 0 };
@@ -1413,6 +2202,7 @@ c_make_command_to_string(CMakeMemory *memory, CMakeCommand command)
         }
 
         result.count -= 1;
+        result.data[result.count] = 0;
     }
 
     return result;
@@ -1730,6 +2520,56 @@ c_make_get_build_path(void)
     return _c_make_context.build_path;
 }
 
+static const char *
+__c_make_get_absolute_path(CMakeMemory *memory, const char *path)
+{
+    const char *result = path;
+
+#if C_MAKE_PLATFORM_WINDOWS
+    CMakeTemporaryMemory temp_memory = c_make_begin_temporary_memory(1, &memory);
+
+    LPWSTR utf16_path = c_make_c_string_utf8_to_utf16(temp_memory.memory, path);
+    DWORD length = GetFullPathName(utf16_path, 0, 0, 0);
+
+    if (length)
+    {
+        wchar_t *full_path = (wchar_t *) c_make_memory_allocate(temp_memory.memory, length * sizeof(wchar_t));
+        length = GetFullPathName(utf16_path, length, full_path, 0);
+
+        if (length)
+        {
+            result = c_make_c_string_utf16_to_utf8(memory, full_path, length);
+        }
+    }
+
+    c_make_end_temporary_memory(temp_memory);
+#elif C_MAKE_PLATFORM_ANDROID || C_MAKE_PLATFORM_FREEBSD || C_MAKE_PLATFORM_LINUX || C_MAKE_PLATFORM_MACOS
+    char current_directory[4096];
+
+    if ((path[0] != '/') && getcwd(current_directory, sizeof(current_directory)))
+    {
+        result = c_make_c_string_path_concat_with_memory(memory, current_directory, path);
+    }
+#endif
+
+    return result;
+}
+
+// The profile data of the 'pgo_generate' and 'pgo_use' build types lives in the
+// directory 'pgo' in the build directory. The path is absolute, so that training
+// runs can be started from any working directory.
+C_MAKE_DEF const char *
+c_make_get_profile_path(void)
+{
+    if (!_c_make_context.profile_path && _c_make_context.build_path)
+    {
+        const char *profile_path = c_make_c_string_path_concat_with_memory(&_c_make_context.permanent_memory, _c_make_context.build_path, "pgo");
+        _c_make_context.profile_path = __c_make_get_absolute_path(&_c_make_context.permanent_memory, profile_path);
+    }
+
+    return _c_make_context.profile_path;
+}
+
 C_MAKE_DEF const char *
 c_make_get_source_path(void)
 {
@@ -1756,6 +2596,64 @@ c_make_get_install_prefix(void)
     return result;
 }
 
+C_MAKE_DEF int
+c_make_get_processor_count(void)
+{
+    int result = 1;
+
+#if C_MAKE_PLATFORM_WINDOWS
+    SYSTEM_INFO system_info;
+    GetSystemInfo(&system_info);
+
+    if (system_info.dwNumberOfProcessors > 0)
+    {
+        result = (int) system_info.dwNumberOfProcessors;
+    }
+#elif C_MAKE_PLATFORM_ANDROID || C_MAKE_PLATFORM_FREEBSD || C_MAKE_PLATFORM_LINUX || C_MAKE_PLATFORM_MACOS
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (count > 0)
+    {
+        result = (int) count;
+    }
+#endif
+
+    return result;
+}
+
+C_MAKE_DEF int
+c_make_get_max_jobs(void)
+{
+    int result = 0;
+
+    if (_c_make_context.max_jobs > 0)
+    {
+        result = _c_make_context.max_jobs;
+    }
+    else
+    {
+        CMakeConfigValue value = c_make_config_get("max_jobs");
+
+        if (value.is_valid)
+        {
+            CMakeString str = CMakeCString(value.val);
+
+            if (!c_make_parse_integer(&str, &result) || str.count || (result < 1))
+            {
+                c_make_log(CMakeLogLevelWarning, "invalid max_jobs '%s'; falling back to the processor count\n", value.val);
+                result = 0;
+            }
+        }
+    }
+
+    if (result < 1)
+    {
+        result = c_make_get_processor_count();
+    }
+
+    return result;
+}
+
 C_MAKE_DEF const char *
 c_make_get_host_ar(void)
 {
@@ -1798,6 +2696,95 @@ c_make_get_host_ar(void)
     return result;
 }
 
+// Finds a tool that comes with 'compiler'. For clang this is 'llvm_tool' with the
+// same prefix and suffix, e.g. 'llvm-ar-18' for 'clang-18'. For gcc it is the
+// compiler name with 'gcc_tool_suffix' appended, e.g. 'x86_64-linux-gnu-gcc-ar-13'
+// for 'x86_64-linux-gnu-gcc-13'. The directory of the compiler is searched first.
+static const char *
+__c_make_find_compiler_tool(const char *compiler, const char *llvm_tool, const char *gcc_tool_suffix)
+{
+    if (!compiler)
+    {
+        return 0;
+    }
+
+    CMakeString directory = CMakeCString(compiler);
+    CMakeString name = c_make_string_split_right_path_separator(&directory);
+
+    const char *candidates[3] = { 0, 0, 0 };
+    size_t index = c_make_string_find(name, CMakeStringLiteral("clang"));
+
+    if (index < name.count)
+    {
+        CMakeString prefix = name;
+        prefix.count = index;
+
+        CMakeString suffix = name;
+        suffix.count -= index + 5;
+        suffix.data += index + 5;
+
+        if ((suffix.count >= 2) && (suffix.data[0] == '+') && (suffix.data[1] == '+'))
+        {
+            suffix.count -= 2;
+            suffix.data += 2;
+        }
+
+        candidates[0] = c_make_string_concat(prefix, CMakeCString(llvm_tool), suffix).data;
+        candidates[1] = c_make_string_concat(CMakeCString(llvm_tool), suffix).data;
+        candidates[2] = llvm_tool;
+    }
+    else if (gcc_tool_suffix)
+    {
+        index = c_make_string_find(name, CMakeStringLiteral("gcc"));
+
+        if (index >= name.count)
+        {
+            index = c_make_string_find(name, CMakeStringLiteral("g++"));
+        }
+
+        if (index < name.count)
+        {
+            CMakeString prefix = name;
+            prefix.count = index;
+
+            CMakeString suffix = name;
+            suffix.count -= index + 3;
+            suffix.data += index + 3;
+
+            candidates[0] = c_make_string_concat(prefix, CMakeStringLiteral("gcc"), CMakeCString(gcc_tool_suffix), suffix).data;
+        }
+#if C_MAKE_PLATFORM_ANDROID || C_MAKE_PLATFORM_LINUX
+        else if (c_make_strings_are_equal(name, CMakeStringLiteral("cc")) ||
+                 c_make_strings_are_equal(name, CMakeStringLiteral("c++")))
+        {
+            candidates[0] = c_make_c_string_concat("gcc", gcc_tool_suffix);
+        }
+#endif
+    }
+
+    for (size_t i = 0; (i < CMakeArrayCount(candidates)) && candidates[i]; i += 1)
+    {
+        if (directory.count)
+        {
+            const char *path = c_make_string_path_concat(directory, CMakeCString(candidates[i])).data;
+
+            if (c_make_file_exists(path))
+            {
+                return path;
+            }
+        }
+
+        const char *path = c_make_find_program(candidates[i]);
+
+        if (path)
+        {
+            return path;
+        }
+    }
+
+    return 0;
+}
+
 C_MAKE_DEF const char *
 c_make_get_target_ar(void)
 {
@@ -1818,7 +2805,16 @@ c_make_get_target_ar(void)
 #if C_MAKE_PLATFORM_WINDOWS
         result = c_make_get_msvc_library_manager(c_make_get_target_architecture());
 #else
-        result = c_make_get_host_ar();
+        // Archives of objects compiled with -flto need the archiver that can read the compiler's IR.
+        if (c_make_get_build_type() == CMakeBuildTypeReleaseLto)
+        {
+            result = __c_make_find_compiler_tool(c_make_get_target_c_compiler(), "llvm-ar", "-ar");
+        }
+
+        if (!result)
+        {
+            result = c_make_get_host_ar();
+        }
 #endif
     }
 
@@ -2693,6 +3689,30 @@ c_make_get_java_keytool(void)
 #endif
 }
 
+C_MAKE_DEF const char *
+c_make_get_llvm_profdata(void)
+{
+    CMakeConfigValue value = c_make_config_get("llvm_profdata_executable");
+
+    if (value.is_valid)
+    {
+        return c_make_get_executable("llvm_profdata_executable", 0);
+    }
+
+    const char *result = __c_make_find_compiler_tool(c_make_get_target_c_compiler(), "llvm-profdata", 0);
+
+    if (!result)
+    {
+#if C_MAKE_PLATFORM_WINDOWS && !defined(__MINGW32__)
+        result = c_make_find_program("llvm-profdata.exe");
+#else
+        result = c_make_find_program("llvm-profdata");
+#endif
+    }
+
+    return result;
+}
+
 C_MAKE_DEF bool
 c_make_setup_java(bool logging)
 {
@@ -2943,9 +3963,22 @@ c_make_config_set(const char *_key, const char *value)
         {
             _c_make_context.build_type = CMakeBuildTypeRelease;
         }
+        else if (c_make_strings_are_equal(entry->value, CMakeStringLiteral("release_lto")))
+        {
+            _c_make_context.build_type = CMakeBuildTypeReleaseLto;
+        }
+        else if (c_make_strings_are_equal(entry->value, CMakeStringLiteral("pgo_generate")))
+        {
+            _c_make_context.build_type = CMakeBuildTypePgoGenerate;
+        }
+        else if (c_make_strings_are_equal(entry->value, CMakeStringLiteral("pgo_use")))
+        {
+            _c_make_context.build_type = CMakeBuildTypePgoUse;
+        }
         else
         {
-            c_make_log(CMakeLogLevelWarning, "unknown build_type '%" CMakeStringFmt "'; valid values are 'debug', 'reldebug' or 'release'\n", CMakeStringArg(entry->value));
+            c_make_log(CMakeLogLevelWarning, "unknown build_type '%" CMakeStringFmt "'; valid values are 'debug', 'reldebug', 'release', "
+                                             "'release_lto', 'pgo_generate' or 'pgo_use'\n", CMakeStringArg(entry->value));
         }
     }
 }
@@ -3059,1192 +4092,8295 @@ c_make_load_config(const char *file_name)
     return true;
 }
 
-C_MAKE_DEF bool
-c_make_needs_rebuild(const char *output_file, size_t input_file_count, const char **input_files)
+C_MAKE_DEF uint64_t
+c_make_hash_data(uint64_t hash, const void *data, size_t size)
 {
-#if C_MAKE_PLATFORM_WINDOWS
-    CMakeTemporaryMemory temp_memory = c_make_begin_temporary_memory(0, 0);
-
-    LPWSTR utf16_file_name = c_make_c_string_utf8_to_utf16(temp_memory.memory, output_file);
-    HANDLE file = CreateFile(utf16_file_name, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, 0, 0);
+    const uint64_t m = 0xc6a4a7935bd1e995ull;
+    const unsigned char *bytes = (const unsigned char *) data;
 
-    c_make_end_temporary_memory(temp_memory);
+    hash ^= size * m;
 
-    if (file == INVALID_HANDLE_VALUE)
+    while (size >= 8)
     {
-        if (GetLastError() == ERROR_FILE_NOT_FOUND)
-        {
-            return true;
-        }
+        uint64_t k;
+        memcpy(&k, bytes, sizeof(k));
 
-        return false;
-    }
+        k *= m;
+        k ^= k >> 47;
+        k *= m;
 
-    FILETIME output_file_last_write_time;
+        hash ^= k;
+        hash *= m;
 
-    if (!GetFileTime(file, 0, 0, &output_file_last_write_time))
-    {
-        CloseHandle(file);
-        return true;
+        bytes += 8;
+        size -= 8;
     }
 
-    CloseHandle(file);
-
-    for (size_t i = 0; i < input_file_count; i += 1)
+    if (size > 0)
     {
-        CMakeTemporaryMemory temp_memory = c_make_begin_temporary_memory(0, 0);
-
-        utf16_file_name = c_make_c_string_utf8_to_utf16(temp_memory.memory, input_files[i]);
-        file = CreateFile(utf16_file_name, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, 0, 0);
-
-        c_make_end_temporary_memory(temp_memory);
+        uint64_t k = 0;
 
-        if (file == INVALID_HANDLE_VALUE)
+        for (size_t i = 0; i < size; i += 1)
         {
-            return false;
+            k |= (uint64_t) bytes[i] << (8 * i);
         }
 
-        FILETIME input_file_last_write_time;
+        hash ^= k;
+        hash *= m;
+    }
 
-        if (!GetFileTime(file, 0, 0, &input_file_last_write_time))
-        {
-            CloseHandle(file);
-            return true;
-        }
+    hash ^= hash >> 47;
+    hash *= m;
+    hash ^= hash >> 47;
 
-        CloseHandle(file);
+    return hash;
+}
 
-        if (CompareFileTime(&output_file_last_write_time, &input_file_last_write_time) < 0)
-        {
-            return true;
-        }
-    }
+#if C_MAKE_PLATFORM_ANDROID || C_MAKE_PLATFORM_FREEBSD || C_MAKE_PLATFORM_LINUX || C_MAKE_PLATFORM_MACOS
 
-    return false;
-#elif C_MAKE_PLATFORM_ANDROID || C_MAKE_PLATFORM_FREEBSD || C_MAKE_PLATFORM_LINUX || C_MAKE_PLATFORM_MACOS
-    struct stat stats;
+// Hashes everything that can be read from fd in chunks of 64k. Every chunk hash is folded
+// into the result, which keeps the memory usage constant for inputs of any size.
+static bool
+__c_make_hash_file_descriptor(int fd, uint64_t *hash)
+{
+    size_t chunk_size = 64 * 1024;
+    uint64_t result = 0;
 
-    if (stat(output_file, &stats))
+    CMakeTemporaryMemory temp_memory = c_make_begin_temporary_memory(0, 0);
+
+    unsigned char *chunk = (unsigned char *) c_make_memory_allocate(temp_memory.memory, chunk_size);
+
+    for (;;)
     {
-        if (errno == ENOENT)
+        size_t index = 0;
+
+        // Fill the whole chunk, so that short reads don't change the result.
+        while (index < chunk_size)
         {
-            return true;
+            ssize_t read_bytes = read(fd, chunk + index, chunk_size - index);
+
+            if (read_bytes < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+
+                c_make_end_temporary_memory(temp_memory);
+                return false;
+            }
+
+            if (read_bytes == 0)
+            {
+                break;
+            }
+
+            index += read_bytes;
+        }
+
+        if (index > 0)
+        {
+            result = c_make_hash_data(result, chunk, index);
+        }
+
+        if (index < chunk_size)
+        {
+            break;
         }
+    }
+
+    c_make_end_temporary_memory(temp_memory);
+
+    *hash = result;
+
+    return true;
+}
+
+#endif
+
+C_MAKE_DEF bool
+c_make_hash_file(const char *file_name, uint64_t *hash)
+{
+    uint64_t result = 0;
+
+#if C_MAKE_PLATFORM_WINDOWS
+    size_t chunk_size = 64 * 1024;
+
+    CMakeTemporaryMemory temp_memory = c_make_begin_temporary_memory(0, 0);
+
+    LPWSTR utf16_file_name = c_make_c_string_utf8_to_utf16(temp_memory.memory, file_name);
+    HANDLE file = CreateFile(utf16_file_name, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, 0, 0);
 
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        c_make_end_temporary_memory(temp_memory);
         return false;
     }
 
-    time_t output_file_last_write_time = stats.st_mtime;
+    unsigned char *chunk = (unsigned char *) c_make_memory_allocate(temp_memory.memory, chunk_size);
 
-    for (size_t i = 0; i < input_file_count; i += 1)
+    for (;;)
     {
-        const char *input_file = input_files[i];
+        DWORD bytes_read = 0;
+
+        if (!ReadFile(file, chunk, (DWORD) chunk_size, &bytes_read, 0))
+        {
+            CloseHandle(file);
+            c_make_end_temporary_memory(temp_memory);
+            return false;
+        }
 
-        if (!stat(input_file, &stats))
+        if (bytes_read == 0)
         {
-            time_t input_file_last_write_time = stats.st_mtime;
+            break;
+        }
 
-            if (input_file_last_write_time > output_file_last_write_time)
+        result = c_make_hash_data(result, chunk, bytes_read);
+    }
+
+    CloseHandle(file);
+    c_make_end_temporary_memory(temp_memory);
+#elif C_MAKE_PLATFORM_ANDROID || C_MAKE_PLATFORM_FREEBSD || C_MAKE_PLATFORM_LINUX || C_MAKE_PLATFORM_MACOS
+    int fd = open(file_name, O_RDONLY);
+
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    bool succeeded = __c_make_hash_file_descriptor(fd, &result);
+
+    close(fd);
+
+    if (!succeeded)
+    {
+        return false;
+    }
+#endif
+
+    *hash = result;
+
+    return true;
+}
+
+static size_t
+__c_make_map_find(CMakeMap *map, CMakeString key)
+{
+    if (map->allocated)
+    {
+        uint64_t hash = c_make_hash_data(0, key.data, key.count);
+        size_t mask = map->allocated - 1;
+        size_t slot_index = hash & mask;
+
+        for (;;)
+        {
+            CMakeMapSlot *slot = map->slots + slot_index;
+
+            if (!slot->key.data)
             {
-                return true;
+                break;
+            }
+
+            if ((slot->hash == hash) && c_make_strings_are_equal(slot->key, key))
+            {
+                return slot->index;
             }
+
+            slot_index = (slot_index + 1) & mask;
         }
     }
 
-    return false;
-#endif
+    return (size_t) -1;
 }
 
-C_MAKE_DEF bool
-c_make_needs_rebuild_single_source(const char *output_file, const char *input_file)
+static void
+__c_make_map_insert(CMakeMemory *memory, CMakeMap *map, CMakeString key, size_t index)
 {
-    return c_make_needs_rebuild(output_file, 1, &input_file);
+    if ((2 * (map->count + 1)) > map->allocated)
+    {
+        CMakeMap new_map;
+        new_map.count = 0;
+        new_map.allocated = map->allocated ? (2 * map->allocated) : 256;
+        new_map.slots = (CMakeMapSlot *) c_make_memory_allocate(memory, new_map.allocated * sizeof(*new_map.slots));
+
+        for (size_t i = 0; i < new_map.allocated; i += 1)
+        {
+            new_map.slots[i].key.data = 0;
+        }
+
+        for (size_t i = 0; i < map->allocated; i += 1)
+        {
+            if (map->slots[i].key.data)
+            {
+                __c_make_map_insert(memory, &new_map, map->slots[i].key, map->slots[i].index);
+            }
+        }
+
+        *map = new_map;
+    }
+
+    uint64_t hash = c_make_hash_data(0, key.data, key.count);
+    size_t mask = map->allocated - 1;
+    size_t slot_index = hash & mask;
+
+    for (;;)
+    {
+        CMakeMapSlot *slot = map->slots + slot_index;
+
+        if (!slot->key.data)
+        {
+            slot->hash = hash;
+            slot->key = key;
+            slot->index = index;
+            map->count += 1;
+            break;
+        }
+
+        if ((slot->hash == hash) && c_make_strings_are_equal(slot->key, key))
+        {
+            slot->index = index;
+            break;
+        }
+
+        slot_index = (slot_index + 1) & mask;
+    }
 }
 
-C_MAKE_DEF CMakeDirectory *
-c_make_directory_open(CMakeMemory *memory, const char *directory_name)
+static void
+__c_make_stat_file(CMakeFileStatus *status, const char *file_name)
 {
-    CMakeDirectory *directory = 0;
+    status->error = 0;
+    status->is_directory = false;
+    status->is_regular_file = false;
+    status->size = 0;
+    status->modification_time = 0;
 
 #if C_MAKE_PLATFORM_WINDOWS
     CMakeTemporaryMemory temp_memory = c_make_begin_temporary_memory(0, 0);
 
-    directory_name = c_make_c_string_concat_with_memory(temp_memory.memory, directory_name, "\\*");
-    LPWSTR utf16_directory_name = c_make_c_string_utf8_to_utf16(temp_memory.memory, directory_name);
+    LPWSTR utf16_file_name = c_make_c_string_utf8_to_utf16(temp_memory.memory, file_name);
 
-    WIN32_FIND_DATA find_data = { 0 };
-    HANDLE handle = FindFirstFile(utf16_directory_name, &find_data);
+    WIN32_FILE_ATTRIBUTE_DATA file_attributes;
+    BOOL result = GetFileAttributesEx(utf16_file_name, GetFileExInfoStandard, &file_attributes);
 
     c_make_end_temporary_memory(temp_memory);
 
-    if (handle != INVALID_HANDLE_VALUE)
+    if (!result)
     {
-        directory = (CMakeDirectory *) c_make_memory_allocate(memory, sizeof(*directory));
-        directory->first_read = true;
-        directory->handle = handle;
-        directory->find_data = find_data;
+        status->error = (int) GetLastError();
+        return;
+    }
+
+    status->is_directory = (file_attributes.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) ? true : false;
+    status->is_regular_file = !status->is_directory;
+    status->size = ((uint64_t) file_attributes.nFileSizeHigh << 32) | file_attributes.nFileSizeLow;
+    status->modification_time = 100 * (((uint64_t) file_attributes.ftLastWriteTime.dwHighDateTime << 32) |
+                                       file_attributes.ftLastWriteTime.dwLowDateTime);
+#elif C_MAKE_PLATFORM_LINUX && defined(STATX_TYPE)
+    struct statx stats;
+
+    if (statx(AT_FDCWD, file_name, 0, STATX_TYPE | STATX_SIZE | STATX_MTIME, &stats))
+    {
+        status->error = errno;
+        return;
     }
+
+    status->is_directory = S_ISDIR(stats.stx_mode) ? true : false;
+    status->is_regular_file = S_ISREG(stats.stx_mode) ? true : false;
+    status->size = stats.stx_size;
+    status->modification_time = (uint64_t) stats.stx_mtime.tv_sec * 1000000000ull + stats.stx_mtime.tv_nsec;
 #elif C_MAKE_PLATFORM_ANDROID || C_MAKE_PLATFORM_FREEBSD || C_MAKE_PLATFORM_LINUX || C_MAKE_PLATFORM_MACOS
-    DIR *dir = opendir(directory_name);
+    struct stat stats;
 
-    if (dir)
+    if (stat(file_name, &stats))
     {
-        directory = (CMakeDirectory *) c_make_memory_allocate(memory, sizeof(*directory));
-        directory->handle = dir;
+        status->error = errno;
+        return;
     }
+
+    status->is_directory = S_ISDIR(stats.st_mode) ? true : false;
+    status->is_regular_file = S_ISREG(stats.st_mode) ? true : false;
+    status->size = stats.st_size;
+#  if C_MAKE_PLATFORM_MACOS
+    status->modification_time = (uint64_t) stats.st_mtimespec.tv_sec * 1000000000ull + stats.st_mtimespec.tv_nsec;
+#  elif defined(__GLIBC__) && !defined(st_mtime)
+    // glibc only names the field st_mtim with POSIX.1-2008 enabled.
+    status->modification_time = (uint64_t) stats.st_mtime * 1000000000ull + stats.st_mtimensec;
+#  else
+    status->modification_time = (uint64_t) stats.st_mtim.tv_sec * 1000000000ull + stats.st_mtim.tv_nsec;
+#  endif
 #endif
+}
 
-    return directory;
+// Every command and every file operation of c_make can change any file, so they
+// invalidate all cached file status. Entries are refreshed on their next use.
+static void
+__c_make_invalidate_file_status_cache(void)
+{
+    _c_make_context.file_status_cache.generation += 1;
 }
 
-C_MAKE_DEF CMakeDirectoryEntry *
-c_make_directory_get_next_entry(CMakeMemory *memory, CMakeDirectory *directory)
+// Returns the status of a file, which is cached until the next invalidation.
+static CMakeFileStatus
+__c_make_get_file_status(const char *file_name)
 {
-    CMakeDirectoryEntry *result = 0;
+    CMakeFileStatusCache *cache = &_c_make_context.file_status_cache;
+    CMakeString path = CMakeCString(file_name);
 
-#if C_MAKE_PLATFORM_WINDOWS
-    if (directory->first_read)
+    size_t index = __c_make_map_find(&cache->map, path);
+
+    if (index >= cache->count)
     {
-        directory->first_read = false;
+        if (cache->count == cache->allocated)
+        {
+            size_t old_count = cache->allocated;
+            cache->allocated = cache->allocated ? (2 * cache->allocated) : 256;
+            cache->items = (CMakeFileStatus *) c_make_memory_reallocate(&_c_make_context.permanent_memory, cache->items,
+                                                                        old_count * sizeof(*cache->items),
+                                                                        cache->allocated * sizeof(*cache->items));
+        }
+
+        index = cache->count;
+        cache->count += 1;
+
+        CMakeFileStatus *status = cache->items + index;
+        status->path = c_make_copy_string(&cache->memory, path);
+        status->generation = cache->generation;
+
+        __c_make_stat_file(status, status->path.data);
+        __c_make_map_insert(&cache->memory, &cache->map, status->path, index);
     }
-    else
+    else if (cache->items[index].generation != cache->generation)
     {
-        if (!FindNextFile(directory->handle, &directory->find_data))
+        CMakeFileStatus *status = cache->items + index;
+        status->generation = cache->generation;
+
+        __c_make_stat_file(status, status->path.data);
+    }
+
+    return cache->items[index];
+}
+
+static bool
+__c_make_get_file_info(const char *file_name, uint64_t *size, uint64_t *modification_time)
+{
+    CMakeFileStatus status = __c_make_get_file_status(file_name);
+
+    if (status.error)
+    {
+        errno = status.error;
+        return false;
+    }
+
+    *size = status.size;
+    *modification_time = status.modification_time;
+
+    return true;
+}
+
+static bool
+__c_make_parse_u64(CMakeString *str, int base, uint64_t *value)
+{
+    uint64_t val = 0;
+    size_t index = 0;
+
+    while (index < str->count)
+    {
+        char c = str->data[index];
+        uint64_t digit;
+
+        if ((c >= '0') && (c <= '9'))
         {
-            return 0;
+            digit = c - '0';
+        }
+        else if ((base == 16) && (c >= 'a') && (c <= 'f'))
+        {
+            digit = 10 + (c - 'a');
+        }
+        else
+        {
+            break;
         }
+
+        val = base * val + digit;
+        index += 1;
     }
 
-    const char *entry_name = c_make_c_string_utf16_to_utf8(memory, directory->find_data.cFileName, wcslen(directory->find_data.cFileName));
+    if (!index)
+    {
+        return false;
+    }
 
-    result = &directory->entry;
-    result->name = CMakeCString(entry_name);
-#elif C_MAKE_PLATFORM_ANDROID || C_MAKE_PLATFORM_FREEBSD || C_MAKE_PLATFORM_LINUX || C_MAKE_PLATFORM_MACOS
-    struct dirent *entry = readdir(directory->handle);
+    *value = val;
+    str->count -= index;
+    str->data += index;
 
-    if (entry)
+    return true;
+}
+
+static CMakeFileHash *
+__c_make_hash_database_get_file(CMakeHashDatabase *database, CMakeString path)
+{
+    size_t index = __c_make_map_find(&database->file_map, path);
+
+    if (index < database->file_count)
     {
-        result = &directory->entry;
-        result->name = c_make_copy_string(memory, CMakeCString(entry->d_name));
+        return database->files + index;
     }
-#endif
 
-    return result;
+    if (database->file_count == database->file_allocated)
+    {
+        size_t old_count = database->file_allocated;
+        database->file_allocated = database->file_allocated ? (2 * database->file_allocated) : 256;
+        database->files =
+            (CMakeFileHash *) c_make_memory_reallocate(&_c_make_context.permanent_memory, database->files,
+                                                       old_count * sizeof(*database->files),
+                                                       database->file_allocated * sizeof(*database->files));
+    }
+
+    CMakeFileHash *file = database->files + database->file_count;
+
+    file->path = c_make_copy_string(&_c_make_context.permanent_memory, path);
+    file->hash = 0;
+    file->size = 0;
+    file->modification_time = 0;
+
+    __c_make_map_insert(&_c_make_context.permanent_memory, &database->file_map, file->path, database->file_count);
+    database->file_count += 1;
+
+    return file;
+}
+
+static CMakeOutputHash *
+__c_make_hash_database_get_output(CMakeHashDatabase *database, CMakeString path)
+{
+    size_t index = __c_make_map_find(&database->output_map, path);
+
+    if (index < database->output_count)
+    {
+        return database->outputs + index;
+    }
+
+    if (database->output_count == database->output_allocated)
+    {
+        size_t old_count = database->output_allocated;
+        database->output_allocated = database->output_allocated ? (2 * database->output_allocated) : 64;
+        database->outputs =
+            (CMakeOutputHash *) c_make_memory_reallocate(&_c_make_context.permanent_memory, database->outputs,
+                                                         old_count * sizeof(*database->outputs),
+                                                         database->output_allocated * sizeof(*database->outputs));
+    }
+
+    CMakeOutputHash *output = database->outputs + database->output_count;
+
+    output->path = c_make_copy_string(&_c_make_context.permanent_memory, path);
+    output->has_inputs_hash = false;
+    output->is_pending = false;
+    output->inputs_hash = 0;
+    output->pending_inputs_hash = 0;
+    output->output_hash = 0;
+
+    __c_make_map_insert(&_c_make_context.permanent_memory, &database->output_map, output->path, database->output_count);
+    database->output_count += 1;
+
+    return output;
+}
+
+static const char *
+__c_make_get_hash_database_file_name(CMakeMemory *memory)
+{
+    return c_make_c_string_path_concat_with_memory(memory, _c_make_context.build_path, "c_make_hashes.txt");
 }
 
-C_MAKE_DEF void
-c_make_directory_close(CMakeDirectory *directory)
-{
-#if C_MAKE_PLATFORM_WINDOWS
-    FindClose(directory->handle);
-#elif C_MAKE_PLATFORM_ANDROID || C_MAKE_PLATFORM_FREEBSD || C_MAKE_PLATFORM_LINUX || C_MAKE_PLATFORM_MACOS
-    closedir(directory->handle);
-#endif
+// The hash database is a text file with one entry per line. There are two kinds of entries:
+//
+//   f <content hash> <size> <modification time in ns> <path>
+//   o <hash of all input paths and content hashes> <content hash of the output> <path>
+static CMakeHashDatabase *
+__c_make_get_hash_database(void)
+{
+    CMakeHashDatabase *database = &_c_make_context.hash_database;
+
+    if (!database->is_loaded && _c_make_context.build_path)
+    {
+        database->is_loaded = true;
+
+        size_t public_used = c_make_memory_get_used(&_c_make_context.public_memory);
+
+        CMakeString content;
+
+        if (c_make_read_entire_file(__c_make_get_hash_database_file_name(&_c_make_context.public_memory), &content))
+        {
+            while (content.count)
+            {
+                CMakeString line = c_make_string_split_left(&content, '\n');
+                CMakeString kind = c_make_string_split_left(&line, ' ');
+
+                if (c_make_strings_are_equal(kind, CMakeStringLiteral("f")))
+                {
+                    uint64_t hash, size, modification_time;
+
+                    if (__c_make_parse_u64(&line, 16, &hash) && c_make_string_split_left(&line, ' ').count == 0 &&
+                        __c_make_parse_u64(&line, 10, &size) && c_make_string_split_left(&line, ' ').count == 0 &&
+                        __c_make_parse_u64(&line, 10, &modification_time) && c_make_string_split_left(&line, ' ').count == 0 &&
+                        line.count)
+                    {
+                        CMakeFileHash *file = __c_make_hash_database_get_file(database, line);
+                        file->hash = hash;
+                        file->size = size;
+                        file->modification_time = modification_time;
+                    }
+                }
+                else if (c_make_strings_are_equal(kind, CMakeStringLiteral("o")))
+                {
+                    uint64_t inputs_hash, output_hash;
+
+                    if (__c_make_parse_u64(&line, 16, &inputs_hash) && c_make_string_split_left(&line, ' ').count == 0 &&
+                        __c_make_parse_u64(&line, 16, &output_hash) && c_make_string_split_left(&line, ' ').count == 0 &&
+                        line.count)
+                    {
+                        CMakeOutputHash *output = __c_make_hash_database_get_output(database, line);
+                        output->has_inputs_hash = true;
+                        output->inputs_hash = inputs_hash;
+                        output->output_hash = output_hash;
+                    }
+                }
+            }
+        }
+
+        c_make_memory_set_used(&_c_make_context.public_memory, public_used);
+    }
+
+    return database;
+}
+
+// Looks up the content hash of a file. The file is only read if the size or the modification time
+// differ from the values stored in the hash database.
+static uint64_t
+__c_make_get_file_hash(CMakeHashDatabase *database, const char *file_name)
+{
+    uint64_t size, modification_time;
+
+    if (!__c_make_get_file_info(file_name, &size, &modification_time))
+    {
+        return 0;
+    }
+
+    CMakeFileHash *file = __c_make_hash_database_get_file(database, CMakeCString(file_name));
+
+    if ((file->size != size) || (file->modification_time != modification_time) || !file->hash)
+    {
+        uint64_t hash;
+
+        if (!c_make_hash_file(file_name, &hash))
+        {
+            return 0;
+        }
+
+        file->hash = hash ? hash : 1;
+        file->size = size;
+        file->modification_time = modification_time;
+
+        database->is_dirty = true;
+    }
+
+    return file->hash;
+}
+
+#if !defined(C_MAKE_NO_ENTRY_POINT)
+
+static bool
+__c_make_store_hash_database(void)
+{
+    CMakeHashDatabase *database = &_c_make_context.hash_database;
+
+    if (!database->is_loaded || !_c_make_context.build_path)
+    {
+        return true;
+    }
+
+    // Inputs hashes of outputs that needed a rebuild are only committed if the build
+    // succeeded. Otherwise a failed command would leave an outdated output behind.
+    if (!_c_make_context.did_fail)
+    {
+        for (size_t i = 0; i < database->output_count; i += 1)
+        {
+            CMakeOutputHash *output = database->outputs + i;
+
+            if (output->is_pending)
+            {
+                output->is_pending = false;
+                output->has_inputs_hash = true;
+                output->inputs_hash = output->pending_inputs_hash;
+                output->output_hash = __c_make_get_file_hash(database, output->path.data);
+
+                database->is_dirty = true;
+            }
+        }
+    }
+
+    if (!database->is_dirty)
+    {
+        return true;
+    }
+
+    CMakeTemporaryMemory temp_memory = c_make_begin_temporary_memory(0, 0);
+
+    size_t content_size = 0;
+
+    for (size_t i = 0; i < database->file_count; i += 1)
+    {
+        content_size += database->files[i].path.count + 64;
+    }
+
+    for (size_t i = 0; i < database->output_count; i += 1)
+    {
+        content_size += database->outputs[i].path.count + 40;
+    }
+
+    CMakeString content;
+    content.count = 0;
+    content.data = (char *) c_make_memory_allocate(temp_memory.memory, content_size + 1);
+
+    for (size_t i = 0; i < database->file_count; i += 1)
+    {
+        CMakeFileHash *file = database->files + i;
+
+        if (file->hash)
+        {
+            content.count += sprintf(content.data + content.count, "f %016llx %llu %llu %s\n",
+                                     (unsigned long long) file->hash, (unsigned long long) file->size,
+                                     (unsigned long long) file->modification_time, file->path.data);
+        }
+    }
+
+    for (size_t i = 0; i < database->output_count; i += 1)
+    {
+        CMakeOutputHash *output = database->outputs + i;
+
+        if (output->has_inputs_hash)
+        {
+            content.count += sprintf(content.data + content.count, "o %016llx %016llx %s\n",
+                                     (unsigned long long) output->inputs_hash,
+                                     (unsigned long long) output->output_hash, output->path.data);
+        }
+    }
+
+    bool result = c_make_write_entire_file(__c_make_get_hash_database_file_name(temp_memory.memory), content);
+
+    if (!result)
+    {
+        c_make_log(CMakeLogLevelError, "could not write hash database\n");
+    }
+
+    c_make_end_temporary_memory(temp_memory);
+
+    database->is_dirty = false;
+
+    return result;
+}
+
+#endif
+
+static bool
+__c_make_needs_rebuild_by_hash(const char *output_file, size_t input_file_count, const char **input_files)
+{
+    CMakeHashDatabase *database = __c_make_get_hash_database();
+
+    uint64_t output_size, output_modification_time;
+
+    if (!__c_make_get_file_info(output_file, &output_size, &output_modification_time))
+    {
+        return true;
+    }
+
+    uint64_t inputs_hash = c_make_hash_data(0, &input_file_count, sizeof(input_file_count));
+    bool is_newer_than_output = false;
+
+    for (size_t i = 0; i < input_file_count; i += 1)
+    {
+        CMakeString input_file = CMakeCString(input_files[i]);
+        uint64_t input_hash = __c_make_get_file_hash(database, input_files[i]);
+
+        inputs_hash = c_make_hash_data(inputs_hash, input_file.data, input_file.count);
+        inputs_hash = c_make_hash_data(inputs_hash, &input_hash, sizeof(input_hash));
+
+        uint64_t input_size, input_modification_time;
+
+        if (__c_make_get_file_info(input_files[i], &input_size, &input_modification_time) &&
+            (input_modification_time > output_modification_time))
+        {
+            is_newer_than_output = true;
+        }
+    }
+
+    CMakeOutputHash *output = __c_make_hash_database_get_output(database, CMakeCString(output_file));
+
+    if (output->has_inputs_hash)
+    {
+        // The output itself is only read again if its size or modification time changed. A
+        // replaced or corrupted output has to be rebuilt even if it is newer than all inputs.
+        if ((output->inputs_hash == inputs_hash) &&
+            (__c_make_get_file_hash(database, output_file) == output->output_hash))
+        {
+            output->is_pending = false;
+            return false;
+        }
+    }
+    else if (!is_newer_than_output)
+    {
+        // There is no record of this output yet, so the modification times have the last word.
+        output->has_inputs_hash = true;
+        output->inputs_hash = inputs_hash;
+        output->output_hash = __c_make_get_file_hash(database, output_file);
+        database->is_dirty = true;
+        return false;
+    }
+
+    output->is_pending = true;
+    output->pending_inputs_hash = inputs_hash;
+
+    return true;
+}
+
+static bool
+__c_make_needs_rebuild_ignore_dependencies(const char *output_file, size_t input_file_count, const char **input_files)
+{
+    if (c_make_config_is_enabled("content_hash", false))
+    {
+        return __c_make_needs_rebuild_by_hash(output_file, input_file_count, input_files);
+    }
+
+#if C_MAKE_PLATFORM_WINDOWS
+    CMakeTemporaryMemory temp_memory = c_make_begin_temporary_memory(0, 0);
+
+    LPWSTR utf16_file_name = c_make_c_string_utf8_to_utf16(temp_memory.memory, output_file);
+    HANDLE file = CreateFile(utf16_file_name, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, 0, 0);
+
+    c_make_end_temporary_memory(temp_memory);
+
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        if (GetLastError() == ERROR_FILE_NOT_FOUND)
+        {
+            return true;
+        }
+
+        return false;
+    }
+
+    FILETIME output_file_last_write_time;
+
+    if (!GetFileTime(file, 0, 0, &output_file_last_write_time))
+    {
+        CloseHandle(file);
+        return true;
+    }
+
+    CloseHandle(file);
+
+    for (size_t i = 0; i < input_file_count; i += 1)
+    {
+        CMakeTemporaryMemory temp_memory = c_make_begin_temporary_memory(0, 0);
+
+        utf16_file_name = c_make_c_string_utf8_to_utf16(temp_memory.memory, input_files[i]);
+        file = CreateFile(utf16_file_name, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, 0, 0);
+
+        c_make_end_temporary_memory(temp_memory);
+
+        if (file == INVALID_HANDLE_VALUE)
+        {
+            return false;
+        }
+
+        FILETIME input_file_last_write_time;
+
+        if (!GetFileTime(file, 0, 0, &input_file_last_write_time))
+        {
+            CloseHandle(file);
+            return true;
+        }
+
+        CloseHandle(file);
+
+        if (CompareFileTime(&output_file_last_write_time, &input_file_last_write_time) < 0)
+        {
+            return true;
+        }
+    }
+
+    return false;
+#elif C_MAKE_PLATFORM_ANDROID || C_MAKE_PLATFORM_FREEBSD || C_MAKE_PLATFORM_LINUX || C_MAKE_PLATFORM_MACOS
+    uint64_t output_file_size, output_file_last_write_time;
+
+    if (!__c_make_get_file_info(output_file, &output_file_size, &output_file_last_write_time))
+    {
+        if (errno == ENOENT)
+        {
+            return true;
+        }
+
+        return false;
+    }
+
+    for (size_t i = 0; i < input_file_count; i += 1)
+    {
+        uint64_t input_file_size, input_file_last_write_time;
+
+        if (__c_make_get_file_info(input_files[i], &input_file_size, &input_file_last_write_time))
+        {
+            if (input_file_last_write_time > output_file_last_write_time)
+            {
+                return true;
+            }
+        }
+    }
+
+    return false;
+#endif
+}
+
+static CMakeString
+__c_make_dependency_file_next_word(CMakeString *content, bool *is_target)
+{
+    CMakeString result = { 0, 0 };
+
+    *is_target = false;
+
+    for (;;)
+    {
+        while (content->count && ((content->data[0] == ' ') || (content->data[0] == '\t') ||
+                                  (content->data[0] == '\r')))
+        {
+            content->count -= 1;
+            content->data += 1;
+        }
+
+        if ((content->count >= 2) && (content->data[0] == '\\') &&
+            ((content->data[1] == '\n') || (content->data[1] == '\r')))
+        {
+            content->count -= 2;
+            content->data += 2;
+            continue;
+        }
+
+        break;
+    }
+
+    if (!content->count || (content->data[0] == '\n'))
+    {
+        return result;
+    }
+
+    // The word is unescaped in place, which is fine because the content is never used again.
+    result.data = content->data;
+
+    while (content->count)
+    {
+        char c = content->data[0];
+
+        if ((c == ' ') || (c == '\t') || (c == '\r') || (c == '\n'))
+        {
+            break;
+        }
+
+        if ((c == ':') && ((content->count == 1) || (content->data[1] == ' ') || (content->data[1] == '\t') ||
+                           (content->data[1] == '\r') || (content->data[1] == '\n')))
+        {
+            *is_target = true;
+            content->count -= 1;
+            content->data += 1;
+            break;
+        }
+
+        if ((c == '\\') && (content->count >= 2) && ((content->data[1] == ' ') || (content->data[1] == '#') ||
+                                                     (content->data[1] == ':') || (content->data[1] == '\\')))
+        {
+            content->count -= 1;
+            content->data += 1;
+        }
+        else if ((c == '$') && (content->count >= 2) && (content->data[1] == '$'))
+        {
+            content->count -= 1;
+            content->data += 1;
+        }
+
+        result.data[result.count] = content->data[0];
+        result.count += 1;
+
+        content->count -= 1;
+        content->data += 1;
+    }
+
+    return result;
+}
+
+// Parses make style dependency rules as written by the compiler with -MMD. Only rules that have
+// prerequisites are stored, the phony targets that -MP adds are ignored.
+static void
+__c_make_parse_dependencies(CMakeDependencyDatabase *database, CMakeString content)
+{
+    CMakeTemporaryMemory temp_memory = c_make_begin_temporary_memory(0, 0);
+
+    while (content.count)
+    {
+        CMakeString target = { 0, 0 };
+        size_t dependency_count = 0;
+        CMakeString *dependencies = (CMakeString *) c_make_memory_allocate(temp_memory.memory, 0);
+
+        for (;;)
+        {
+            bool is_target;
+            CMakeString word = __c_make_dependency_file_next_word(&content, &is_target);
+
+            if (!word.data)
+            {
+                break;
+            }
+
+            if (is_target)
+            {
+                target = word;
+            }
+            else if (target.data)
+            {
+                dependencies = (CMakeString *) c_make_memory_reallocate(temp_memory.memory, dependencies,
+                                                                        dependency_count * sizeof(*dependencies),
+                                                                        (dependency_count + 1) * sizeof(*dependencies));
+                dependencies[dependency_count] = word;
+                dependency_count += 1;
+            }
+        }
+
+        if (content.count)
+        {
+            content.count -= 1;
+            content.data += 1;
+        }
+
+        if (target.count && dependency_count)
+        {
+            size_t index = __c_make_map_find(&database->map, target);
+
+            if (index >= database->count)
+            {
+                if (database->count == database->allocated)
+                {
+                    size_t old_count = database->allocated;
+                    database->allocated = database->allocated ? (2 * database->allocated) : 64;
+                    database->items =
+                        (CMakeDependencies *) c_make_memory_reallocate(&_c_make_context.permanent_memory, database->items,
+                                                                       old_count * sizeof(*database->items),
+                                                                       database->allocated * sizeof(*database->items));
+                }
+
+                index = database->count;
+                database->count += 1;
+
+                database->items[index].target = c_make_copy_string(&_c_make_context.permanent_memory, target);
+                __c_make_map_insert(&_c_make_context.permanent_memory, &database->map, database->items[index].target, index);
+            }
+
+            CMakeDependencies *entry = database->items + index;
+
+            entry->count = dependency_count;
+            entry->items = (CMakeString *) c_make_memory_allocate(&_c_make_context.permanent_memory, dependency_count * sizeof(*entry->items));
+
+            for (size_t i = 0; i < dependency_count; i += 1)
+            {
+                entry->items[i] = c_make_copy_string(&_c_make_context.permanent_memory, dependencies[i]);
+            }
+        }
+
+        c_make_memory_set_used(temp_memory.memory, temp_memory.used);
+    }
+
+    c_make_end_temporary_memory(temp_memory);
+}
+
+static const char *
+__c_make_get_dependency_database_file_name(CMakeMemory *memory)
+{
+    return c_make_c_string_path_concat_with_memory(memory, _c_make_context.build_path, "c_make_deps.txt");
+}
+
+static CMakeDependencyDatabase *
+__c_make_get_dependency_database(void)
+{
+    CMakeDependencyDatabase *database = &_c_make_context.dependency_database;
+
+    if (!database->is_loaded && _c_make_context.build_path)
+    {
+        database->is_loaded = true;
+
+        size_t public_used = c_make_memory_get_used(&_c_make_context.public_memory);
+
+        CMakeString content;
+
+        if (c_make_read_entire_file(__c_make_get_dependency_database_file_name(&_c_make_context.public_memory), &content))
+        {
+            __c_make_parse_dependencies(database, content);
+        }
+
+        c_make_memory_set_used(&_c_make_context.public_memory, public_used);
+    }
+
+    return database;
+}
+
+static void
+__c_make_read_dependency_file(const char *dependency_file)
+{
+    CMakeDependencyDatabase *database = __c_make_get_dependency_database();
+
+    size_t public_used = c_make_memory_get_used(&_c_make_context.public_memory);
+
+    CMakeString content;
+
+    if (c_make_read_entire_file(dependency_file, &content))
+    {
+        __c_make_parse_dependencies(database, content);
+        database->is_dirty = true;
+
+        c_make_delete_file(dependency_file);
+    }
+
+    c_make_memory_set_used(&_c_make_context.public_memory, public_used);
+}
+
+static CMakeDependencies *
+__c_make_get_dependencies(const char *target)
+{
+    CMakeDependencies *result = 0;
+    CMakeDependencyDatabase *database = __c_make_get_dependency_database();
+
+    size_t index = __c_make_map_find(&database->map, CMakeCString(target));
+
+    if (index < database->count)
+    {
+        result = database->items + index;
+    }
+
+    return result;
+}
+
+#if !defined(C_MAKE_NO_ENTRY_POINT)
+
+static char *
+__c_make_escape_dependency_path(char *dst, CMakeString path)
+{
+    for (size_t i = 0; i < path.count; i += 1)
+    {
+        char c = path.data[i];
+
+        if ((c == ' ') || (c == '#') || (c == '\\'))
+        {
+            *dst++ = '\\';
+        }
+        else if (c == '$')
+        {
+            *dst++ = '$';
+        }
+
+        *dst++ = c;
+    }
+
+    return dst;
+}
+
+// The dependency database stores one make style rule per line: '<target>: <dependency> ...'
+static bool
+__c_make_store_dependency_database(void)
+{
+    CMakeDependencyDatabase *database = &_c_make_context.dependency_database;
+
+    if (!database->is_dirty || !_c_make_context.build_path)
+    {
+        return true;
+    }
+
+    CMakeTemporaryMemory temp_memory = c_make_begin_temporary_memory(0, 0);
+
+    size_t content_size = 0;
+
+    for (size_t i = 0; i < database->count; i += 1)
+    {
+        CMakeDependencies *entry = database->items + i;
+
+        content_size += 2 * entry->target.count + 2;
+
+        for (size_t j = 0; j < entry->count; j += 1)
+        {
+            content_size += 2 * entry->items[j].count + 1;
+        }
+
+        content_size += 1;
+    }
+
+    CMakeString content;
+    content.data = (char *) c_make_memory_allocate(temp_memory.memory, content_size);
+
+    char *dst = content.data;
+
+    for (size_t i = 0; i < database->count; i += 1)
+    {
+        CMakeDependencies *entry = database->items + i;
+
+        dst = __c_make_escape_dependency_path(dst, entry->target);
+        *dst++ = ':';
+
+        for (size_t j = 0; j < entry->count; j += 1)
+        {
+            *dst++ = ' ';
+            dst = __c_make_escape_dependency_path(dst, entry->items[j]);
+        }
+
+        *dst++ = '\n';
+    }
+
+    content.count = dst - content.data;
+
+    bool result = c_make_write_entire_file(__c_make_get_dependency_database_file_name(temp_memory.memory), content);
+
+    if (!result)
+    {
+        c_make_log(CMakeLogLevelError, "could not write dependency database\n");
+    }
+
+    c_make_end_temporary_memory(temp_memory);
+
+    database->is_dirty = false;
+
+    return result;
+}
+
+#endif
+
+static uint32_t
+__c_make_build_log_add_file(CMakeBuildLog *build_log, const char *file_name)
+{
+    size_t index = __c_make_map_find(&build_log->file_map, CMakeCString(file_name));
+
+    if (index < build_log->file_count)
+    {
+        return (uint32_t) index;
+    }
+
+    if (build_log->file_count == build_log->file_allocated)
+    {
+        size_t old_count = build_log->file_allocated;
+        build_log->file_allocated = build_log->file_allocated ? (2 * build_log->file_allocated) : 256;
+        build_log->files = (const char **) c_make_memory_reallocate(&_c_make_context.permanent_memory, build_log->files,
+                                                                    old_count * sizeof(*build_log->files),
+                                                                    build_log->file_allocated * sizeof(*build_log->files));
+    }
+
+    CMakeString path = c_make_copy_string(&build_log->memory, CMakeCString(file_name));
+
+    build_log->files[build_log->file_count] = path.data;
+    __c_make_map_insert(&build_log->memory, &build_log->file_map, path, build_log->file_count);
+
+    return (uint32_t) build_log->file_count++;
+}
+
+static CMakeBuildLogAction *
+__c_make_build_log_add_action(CMakeBuildLog *build_log, uint64_t command_hash, size_t input_count, size_t output_count)
+{
+    if (build_log->action_count == build_log->action_allocated)
+    {
+        size_t old_count = build_log->action_allocated;
+        build_log->action_allocated = build_log->action_allocated ? (2 * build_log->action_allocated) : 64;
+        build_log->actions = (CMakeBuildLogAction *) c_make_memory_reallocate(&_c_make_context.permanent_memory, build_log->actions,
+                                                                              old_count * sizeof(*build_log->actions),
+                                                                              build_log->action_allocated * sizeof(*build_log->actions));
+    }
+
+    CMakeBuildLogAction *action = build_log->actions + build_log->action_count;
+    build_log->action_count += 1;
+
+    action->command_hash = command_hash;
+    action->input_count = input_count;
+    action->output_count = output_count;
+    action->files = (uint32_t *) c_make_memory_allocate(&build_log->memory, (input_count + output_count) * sizeof(uint32_t));
+
+    return action;
+}
+
+static bool
+__c_make_build_log_get_previous_command_hash(CMakeBuildLog *build_log, const char *output_file, uint64_t *command_hash)
+{
+    size_t index = __c_make_map_find(&build_log->previous_output_map, CMakeCString(output_file));
+
+    if (index < build_log->previous_output_count)
+    {
+        *command_hash = build_log->previous_command_hashes[index];
+        return true;
+    }
+
+    return false;
+}
+
+// A check outside of the build graph is recorded in the build log. If the output was up to
+// date, the next build only has to run the build script again if one of its files changed.
+// Otherwise the build script did something that the log can't check.
+static void
+__c_make_build_log_add_check(CMakeBuildLog *build_log, const char *output_file, size_t input_file_count, const char **input_files,
+                             bool needs_rebuild)
+{
+    if (!build_log->is_recording)
+    {
+        return;
+    }
+
+    if (needs_rebuild)
+    {
+        build_log->is_valid = false;
+        return;
+    }
+
+    for (size_t i = 0; i < input_file_count; i += 1)
+    {
+        __c_make_build_log_add_file(build_log, input_files[i]);
+    }
+
+    CMakeDependencies *dependencies = __c_make_get_dependencies(output_file);
+
+    for (size_t i = 0; dependencies && (i < dependencies->count); i += 1)
+    {
+        __c_make_build_log_add_file(build_log, dependencies->items[i].data);
+    }
+
+    __c_make_build_log_add_file(build_log, output_file);
+}
+
+// Every output also depends on the build settings file, which changes with the
+// build type and, for 'pgo_use', with the profile data.
+static bool
+__c_make_needs_rebuild_with_build_settings(const char *output_file, size_t input_file_count, const char **input_files)
+{
+    if (!_c_make_context.build_settings_file)
+    {
+        return __c_make_needs_rebuild_ignore_dependencies(output_file, input_file_count, input_files);
+    }
+
+    CMakeTemporaryMemory temp_memory = c_make_begin_temporary_memory(0, 0);
+
+    const char **all_input_files = (const char **) c_make_memory_allocate(temp_memory.memory, (input_file_count + 1) * sizeof(*all_input_files));
+
+    for (size_t i = 0; i < input_file_count; i += 1)
+    {
+        all_input_files[i] = input_files[i];
+    }
+
+    all_input_files[input_file_count] = _c_make_context.build_settings_file;
+
+    bool result = __c_make_needs_rebuild_ignore_dependencies(output_file, input_file_count + 1, all_input_files);
+
+    c_make_end_temporary_memory(temp_memory);
+
+    return result;
+}
+
+static bool
+__c_make_needs_rebuild(const char *output_file, size_t input_file_count, const char **input_files)
+{
+    CMakeDependencies *dependencies = __c_make_get_dependencies(output_file);
+
+    if (dependencies)
+    {
+        CMakeTemporaryMemory temp_memory = c_make_begin_temporary_memory(0, 0);
+
+        size_t all_input_file_count = input_file_count + dependencies->count;
+        const char **all_input_files = (const char **) c_make_memory_allocate(temp_memory.memory, all_input_file_count * sizeof(*all_input_files));
+
+        for (size_t i = 0; i < input_file_count; i += 1)
+        {
+            all_input_files[i] = input_files[i];
+        }
+
+        for (size_t i = 0; i < dependencies->count; i += 1)
+        {
+            all_input_files[input_file_count + i] = dependencies->items[i].data;
+        }
+
+        bool result = __c_make_needs_rebuild_with_build_settings(output_file, all_input_file_count, all_input_files);
+
+        c_make_end_temporary_memory(temp_memory);
+
+        return result;
+    }
+
+    return __c_make_needs_rebuild_with_build_settings(output_file, input_file_count, input_files);
+}
+
+C_MAKE_DEF bool
+c_make_needs_rebuild_ignore_dependencies(const char *output_file, size_t input_file_count, const char **input_files)
+{
+    bool result = __c_make_needs_rebuild_with_build_settings(output_file, input_file_count, input_files);
+    __c_make_build_log_add_check(&_c_make_context.build_log, output_file, input_file_count, input_files, result);
+
+    return result;
+}
+
+C_MAKE_DEF bool
+c_make_needs_rebuild(const char *output_file, size_t input_file_count, const char **input_files)
+{
+    bool result = __c_make_needs_rebuild(output_file, input_file_count, input_files);
+    __c_make_build_log_add_check(&_c_make_context.build_log, output_file, input_file_count, input_files, result);
+
+    return result;
+}
+
+C_MAKE_DEF bool
+c_make_needs_rebuild_single_source(const char *output_file, const char *input_file)
+{
+    return c_make_needs_rebuild(output_file, 1, &input_file);
+}
+
+// In watch mode, adding or removing an entry of a listed directory reruns the build target.
+static void
+__c_make_watch_add_listed_directory(const char *directory_name)
+{
+    CMakeWatcher *watcher = &_c_make_context.watcher;
+
+    if (watcher->is_active)
+    {
+        if (watcher->listed_count == watcher->listed_allocated)
+        {
+            size_t old_count = watcher->listed_allocated;
+            watcher->listed_allocated = watcher->listed_allocated ? (2 * watcher->listed_allocated) : 16;
+            watcher->listed = (const char **) c_make_memory_reallocate(&watcher->memory, watcher->listed,
+                                                                      old_count * sizeof(*watcher->listed),
+                                                                      watcher->listed_allocated * sizeof(*watcher->listed));
+        }
+
+        watcher->listed[watcher->listed_count++] = c_make_copy_string(&watcher->memory, CMakeCString(directory_name)).data;
+    }
+}
+
+C_MAKE_DEF CMakeDirectory *
+c_make_directory_open(CMakeMemory *memory, const char *directory_name)
+{
+    CMakeDirectory *directory = 0;
+
+#if C_MAKE_PLATFORM_WINDOWS
+    CMakeTemporaryMemory temp_memory = c_make_begin_temporary_memory(0, 0);
+
+    directory_name = c_make_c_string_concat_with_memory(temp_memory.memory, directory_name, "\\*");
+    LPWSTR utf16_directory_name = c_make_c_string_utf8_to_utf16(temp_memory.memory, directory_name);
+
+    WIN32_FIND_DATA find_data = { 0 };
+    HANDLE handle = FindFirstFile(utf16_directory_name, &find_data);
+
+    c_make_end_temporary_memory(temp_memory);
+
+    if (handle != INVALID_HANDLE_VALUE)
+    {
+        directory = (CMakeDirectory *) c_make_memory_allocate(memory, sizeof(*directory));
+        directory->first_read = true;
+        directory->handle = handle;
+        directory->find_data = find_data;
+    }
+#elif C_MAKE_PLATFORM_ANDROID || C_MAKE_PLATFORM_FREEBSD || C_MAKE_PLATFORM_LINUX || C_MAKE_PLATFORM_MACOS
+    DIR *dir = opendir(directory_name);
+
+    if (dir)
+    {
+        directory = (CMakeDirectory *) c_make_memory_allocate(memory, sizeof(*directory));
+        directory->handle = dir;
+    }
+#endif
+
+    if (directory)
+    {
+        __c_make_watch_add_listed_directory(directory_name);
+    }
+
+    // Adding or removing an entry changes the modification time of the directory.
+    if (directory && _c_make_context.build_log.is_recording)
+    {
+        __c_make_build_log_add_file(&_c_make_context.build_log, directory_name);
+    }
+
+    return directory;
+}
+
+C_MAKE_DEF CMakeDirectoryEntry *
+c_make_directory_get_next_entry(CMakeMemory *memory, CMakeDirectory *directory)
+{
+    CMakeDirectoryEntry *result = 0;
+
+#if C_MAKE_PLATFORM_WINDOWS
+    if (directory->first_read)
+    {
+        directory->first_read = false;
+    }
+    else
+    {
+        if (!FindNextFile(directory->handle, &directory->find_data))
+        {
+            return 0;
+        }
+    }
+
+    const char *entry_name = c_make_c_string_utf16_to_utf8(memory, directory->find_data.cFileName, wcslen(directory->find_data.cFileName));
+
+    result = &directory->entry;
+    result->name = CMakeCString(entry_name);
+    result->is_directory = (directory->find_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+#elif C_MAKE_PLATFORM_ANDROID || C_MAKE_PLATFORM_FREEBSD || C_MAKE_PLATFORM_LINUX || C_MAKE_PLATFORM_MACOS
+    struct dirent *entry = readdir(directory->handle);
+
+    if (entry)
+    {
+        result = &directory->entry;
+        result->name = c_make_copy_string(memory, CMakeCString(entry->d_name));
+        result->is_directory = (entry->d_type == DT_DIR);
+
+        if ((entry->d_type == DT_UNKNOWN) || (entry->d_type == DT_LNK))
+        {
+            int dirfd(DIR *);
+            int fstatat(int, const char *, struct stat *, int);
+
+            struct stat stat_buffer;
+
+            result->is_directory = !fstatat(dirfd(directory->handle), entry->d_name, &stat_buffer, 0) && S_ISDIR(stat_buffer.st_mode);
+        }
+    }
+#endif
+
+    return result;
+}
+
+C_MAKE_DEF void
+c_make_directory_close(CMakeDirectory *directory)
+{
+#if C_MAKE_PLATFORM_WINDOWS
+    FindClose(directory->handle);
+#elif C_MAKE_PLATFORM_ANDROID || C_MAKE_PLATFORM_FREEBSD || C_MAKE_PLATFORM_LINUX || C_MAKE_PLATFORM_MACOS
+    closedir(directory->handle);
+#endif
+}
+
+static void
+__c_make_memory_release(CMakeMemory *memory)
+{
+    CMakeMemoryBlock *block = memory->block;
+
+    while (block && block->next)
+    {
+        block = block->next;
+    }
+
+    while (block)
+    {
+        CMakeMemoryBlock *prev = block->prev;
+        c_make_free(block);
+        block = prev;
+    }
+
+    memory->used = 0;
+    memory->allocated = 0;
+    memory->base = 0;
+    memory->block = 0;
+}
+
+#if C_MAKE_PLATFORM_WINDOWS
+#  define __C_MAKE_PATH_SEPARATOR '\\'
+#else
+#  define __C_MAKE_PATH_SEPARATOR '/'
+#endif
+
+// A directory that still has to be read. 'path' is empty or ends with a path separator.
+// Bit i of 'states' is set if the path matched the first i components of the pattern.
+typedef struct CMakeGlobWork
+{
+    struct CMakeGlobWork *next;
+    const char *path;
+    size_t path_length;
+    uint64_t states;
+} CMakeGlobWork;
+
+typedef struct CMakeGlob
+{
+    size_t component_count;
+    CMakeString components[63];
+
+    bool is_parallel;
+    CMakeGlobWork *first_work;
+    size_t pending_count;
+
+#if __C_MAKE_HAS_THREADS
+#  if C_MAKE_PLATFORM_WINDOWS
+    CRITICAL_SECTION mutex;
+    CONDITION_VARIABLE condition;
+#  else
+    pthread_mutex_t mutex;
+    pthread_cond_t condition;
+#  endif
+#endif
+} CMakeGlob;
+
+typedef struct CMakeGlobWorker
+{
+    CMakeGlob *glob;
+    CMakeMemory memory;
+
+    size_t count;
+    size_t allocated;
+    const char **items;
+
+    // The directories that were read, only collected while the build log is recorded
+    // or while c_make watches for changes.
+    size_t directory_count;
+    size_t directory_allocated;
+    const char **directories;
+
+#if __C_MAKE_HAS_THREADS
+#  if C_MAKE_PLATFORM_WINDOWS
+    HANDLE thread;
+#  else
+    pthread_t thread;
+#  endif
+#endif
+} CMakeGlobWorker;
+
+static void
+__c_make_glob_lock(CMakeGlob *glob)
+{
+#if __C_MAKE_HAS_THREADS
+    if (glob->is_parallel)
+    {
+#  if C_MAKE_PLATFORM_WINDOWS
+        EnterCriticalSection(&glob->mutex);
+#  else
+        pthread_mutex_lock(&glob->mutex);
+#  endif
+    }
+#else
+    (void) glob;
+#endif
+}
+
+static void
+__c_make_glob_unlock(CMakeGlob *glob, bool wake_up)
+{
+#if __C_MAKE_HAS_THREADS
+    if (glob->is_parallel)
+    {
+#  if C_MAKE_PLATFORM_WINDOWS
+        if (wake_up)
+        {
+            WakeAllConditionVariable(&glob->condition);
+        }
+
+        LeaveCriticalSection(&glob->mutex);
+#  else
+        if (wake_up)
+        {
+            pthread_cond_broadcast(&glob->condition);
+        }
+
+        pthread_mutex_unlock(&glob->mutex);
+#  endif
+    }
+#else
+    (void) glob;
+    (void) wake_up;
+#endif
+}
+
+static void
+__c_make_glob_wait(CMakeGlob *glob)
+{
+#if __C_MAKE_HAS_THREADS
+#  if C_MAKE_PLATFORM_WINDOWS
+    SleepConditionVariableCS(&glob->condition, &glob->mutex, INFINITE);
+#  else
+    pthread_cond_wait(&glob->condition, &glob->mutex);
+#  endif
+#else
+    (void) glob;
+#endif
+}
+
+static bool
+__c_make_glob_is_recursive(CMakeString component)
+{
+    return c_make_strings_are_equal(component, CMakeStringLiteral("**"));
+}
+
+static bool
+__c_make_glob_has_wildcard(CMakeString component)
+{
+    for (size_t i = 0; i < component.count; i += 1)
+    {
+        if ((component.data[i] == '*') || (component.data[i] == '?'))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Matches a single path component with '*' and '?'. Hidden entries are only
+// matched if the pattern starts with a '.' as well.
+static bool
+__c_make_glob_match(CMakeString pattern, const char *name)
+{
+    if ((name[0] == '.') && (!pattern.count || (pattern.data[0] != '.')))
+    {
+        return false;
+    }
+
+    size_t index = 0;
+    size_t star_index = (size_t) -1;
+    const char *star_name = 0;
+
+    while (*name)
+    {
+        if ((index < pattern.count) && ((pattern.data[index] == '?') || (pattern.data[index] == *name)))
+        {
+            index += 1;
+            name += 1;
+        }
+        else if ((index < pattern.count) && (pattern.data[index] == '*'))
+        {
+            star_index = index;
+            star_name = name;
+            index += 1;
+        }
+        else if (star_index != (size_t) -1)
+        {
+            index = star_index + 1;
+            star_name += 1;
+            name = star_name;
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    while ((index < pattern.count) && (pattern.data[index] == '*'))
+    {
+        index += 1;
+    }
+
+    return index == pattern.count;
+}
+
+// Returns the states that are reached by matching the first 'index' components.
+// '**' also matches no directory at all, so it adds the state after it as well.
+static uint64_t
+__c_make_glob_get_states(CMakeGlob *glob, size_t index)
+{
+    uint64_t states = 0;
+
+    while (index < glob->component_count)
+    {
+        states |= (uint64_t) 1 << index;
+
+        if (!__c_make_glob_is_recursive(glob->components[index]))
+        {
+            break;
+        }
+
+        index += 1;
+    }
+
+    return states;
+}
+
+static void
+__c_make_glob_push_work(CMakeGlobWorker *worker, const char *path, size_t path_length, uint64_t states)
+{
+    CMakeGlob *glob = worker->glob;
+    CMakeGlobWork *work = (CMakeGlobWork *) c_make_memory_allocate(&worker->memory, sizeof(CMakeGlobWork));
+
+    work->path = path;
+    work->path_length = path_length;
+    work->states = states;
+
+    __c_make_glob_lock(glob);
+
+    work->next = glob->first_work;
+    glob->first_work = work;
+    glob->pending_count += 1;
+
+    __c_make_glob_unlock(glob, true);
+}
+
+static void
+__c_make_glob_add_entry(CMakeGlobWorker *worker, CMakeGlobWork *work, const char *name, size_t name_length,
+                        bool is_directory, bool is_symbolic_link)
+{
+    CMakeGlob *glob = worker->glob;
+
+    if ((name[0] == '.') && (!name[1] || ((name[1] == '.') && !name[2])))
+    {
+        return;
+    }
+
+    uint64_t next_states = 0;
+    bool matches = false;
+
+    for (size_t i = 0; i < glob->component_count; i += 1)
+    {
+        if (!(work->states & ((uint64_t) 1 << i)))
+        {
+            continue;
+        }
+
+        CMakeString component = glob->components[i];
+        bool is_last = (i + 1) == glob->component_count;
+
+        if (__c_make_glob_is_recursive(component))
+        {
+            // '**' skips hidden entries and does not follow symbolic links to
+            // directories, which could form a cycle.
+            if (name[0] == '.')
+            {
+                continue;
+            }
+
+            if (is_directory)
+            {
+                if (!is_symbolic_link)
+                {
+                    next_states |= __c_make_glob_get_states(glob, i);
+                }
+            }
+            else if (is_last)
+            {
+                matches = true;
+            }
+        }
+        else if (__c_make_glob_match(component, name))
+        {
+            if (is_last)
+            {
+                matches = matches || !is_directory;
+            }
+            else if (is_directory)
+            {
+                next_states |= __c_make_glob_get_states(glob, i + 1);
+            }
+        }
+    }
+
+    if (!matches && !next_states)
+    {
+        return;
+    }
+
+    size_t path_length = work->path_length + name_length;
+    char *path = (char *) c_make_memory_allocate(&worker->memory, path_length + 2);
+
+    memcpy(path, work->path, work->path_length);
+    memcpy(path + work->path_length, name, name_length);
+    path[path_length] = 0;
+
+    if (matches)
+    {
+        if (worker->count == worker->allocated)
+        {
+            size_t old_count = worker->allocated;
+            worker->allocated = worker->allocated ? (2 * worker->allocated) : 256;
+            worker->items = (const char **) c_make_memory_reallocate(&worker->memory, worker->items,
+                                                                    old_count * sizeof(*worker->items),
+                                                                    worker->allocated * sizeof(*worker->items));
+        }
+
+        worker->items[worker->count++] = path;
+    }
+
+    if (next_states)
+    {
+        char *directory_path = path;
+
+        if (matches)
+        {
+            directory_path = (char *) c_make_memory_allocate(&worker->memory, path_length + 2);
+            memcpy(directory_path, path, path_length);
+        }
+
+        directory_path[path_length] = __C_MAKE_PATH_SEPARATOR;
+        directory_path[path_length + 1] = 0;
+
+        __c_make_glob_push_work(worker, directory_path, path_length + 1, next_states);
+    }
+}
+
+static void
+__c_make_glob_add_directory(CMakeGlobWorker *worker, CMakeGlobWork *work)
+{
+    if (!_c_make_context.build_log.is_recording && !_c_make_context.watcher.is_active)
+    {
+        return;
+    }
+
+    if (worker->directory_count == worker->directory_allocated)
+    {
+        size_t old_count = worker->directory_allocated;
+        worker->directory_allocated = worker->directory_allocated ? (2 * worker->directory_allocated) : 64;
+        worker->directories = (const char **) c_make_memory_reallocate(&worker->memory, worker->directories,
+                                                                      old_count * sizeof(*worker->directories),
+                                                                      worker->directory_allocated * sizeof(*worker->directories));
+    }
+
+    worker->directories[worker->directory_count++] = work->path_length ? work->path : ".";
+}
+
+// Reads all entries of one directory. The entry type comes with the directory
+// entries on all platforms, so only symbolic links and file systems that don't
+// report a type need an extra stat.
+static void
+__c_make_glob_read_directory(CMakeGlobWorker *worker, CMakeGlobWork *work)
+{
+#if C_MAKE_PLATFORM_WINDOWS
+    char *search_path = (char *) c_make_memory_allocate(&worker->memory, work->path_length + 2);
+    memcpy(search_path, work->path, work->path_length);
+    search_path[work->path_length] = '*';
+    search_path[work->path_length + 1] = 0;
+
+    WIN32_FIND_DATA find_data;
+    HANDLE handle = FindFirstFileEx(c_make_c_string_utf8_to_utf16(&worker->memory, search_path), FindExInfoBasic,
+                                    &find_data, FindExSearchNameMatch, 0, FIND_FIRST_EX_LARGE_FETCH);
+
+    if (handle == INVALID_HANDLE_VALUE)
+    {
+        return;
+    }
+
+    __c_make_glob_add_directory(worker, work);
+
+    do
+    {
+        const char *name = c_make_c_string_utf16_to_utf8(&worker->memory, find_data.cFileName, wcslen(find_data.cFileName));
+
+        __c_make_glob_add_entry(worker, work, name, c_make_get_c_string_length(name),
+                                (find_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0,
+                                (find_data.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) != 0);
+    }
+    while (FindNextFile(handle, &find_data));
+
+    FindClose(handle);
+#elif C_MAKE_PLATFORM_ANDROID || C_MAKE_PLATFORM_LINUX
+    long syscall(long, ...);
+    int fstatat(int, const char *, struct stat *, int);
+
+    int fd = open(work->path_length ? work->path : ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+    if (fd < 0)
+    {
+        return;
+    }
+
+    __c_make_glob_add_directory(worker, work);
+
+    // getdents64 returns many entries per system call instead of one readdir at a time.
+    union
+    {
+        uint64_t align;
+        char data[32 * 1024];
+    } buffer;
+
+    for (;;)
+    {
+        long size = syscall(SYS_getdents64, fd, buffer.data, sizeof(buffer.data));
+
+        if (size <= 0)
+        {
+            break;
+        }
+
+        for (long offset = 0; offset < size;)
+        {
+            // struct linux_dirent64 { u64 d_ino; s64 d_off; u16 d_reclen; u8 d_type; char d_name[]; }
+            char *entry = buffer.data + offset;
+            unsigned short record_length;
+            unsigned char type = (unsigned char) entry[18];
+            const char *name = entry + 19;
+
+            memcpy(&record_length, entry + 16, sizeof(record_length));
+            offset += record_length;
+
+            bool is_directory = (type == DT_DIR);
+            bool is_symbolic_link = (type == DT_LNK);
+
+            if ((type == DT_UNKNOWN) || is_symbolic_link)
+            {
+                struct stat stat_buffer;
+
+                if (!fstatat(fd, name, &stat_buffer, 0))
+                {
+                    is_directory = S_ISDIR(stat_buffer.st_mode);
+                }
+            }
+
+            __c_make_glob_add_entry(worker, work, name, strlen(name), is_directory, is_symbolic_link);
+        }
+    }
+
+    close(fd);
+#elif C_MAKE_PLATFORM_FREEBSD || C_MAKE_PLATFORM_MACOS
+    DIR *dir = opendir(work->path_length ? work->path : ".");
+
+    if (!dir)
+    {
+        return;
+    }
+
+    __c_make_glob_add_directory(worker, work);
+
+    struct dirent *entry;
+
+    while ((entry = readdir(dir)))
+    {
+        bool is_directory = (entry->d_type == DT_DIR);
+        bool is_symbolic_link = (entry->d_type == DT_LNK);
+
+        if ((entry->d_type == DT_UNKNOWN) || is_symbolic_link)
+        {
+            struct stat stat_buffer;
+
+            if (!fstatat(dirfd(dir), entry->d_name, &stat_buffer, 0))
+            {
+                is_directory = S_ISDIR(stat_buffer.st_mode);
+            }
+        }
+
+        __c_make_glob_add_entry(worker, work, entry->d_name, strlen(entry->d_name), is_directory, is_symbolic_link);
+    }
+
+    closedir(dir);
+#endif
+}
+
+static void
+__c_make_glob_run_worker(CMakeGlobWorker *worker)
+{
+    CMakeGlob *glob = worker->glob;
+
+    for (;;)
+    {
+        __c_make_glob_lock(glob);
+
+        while (!glob->first_work && glob->pending_count)
+        {
+            __c_make_glob_wait(glob);
+        }
+
+        CMakeGlobWork *work = glob->first_work;
+
+        if (work)
+        {
+            glob->first_work = work->next;
+        }
+
+        __c_make_glob_unlock(glob, false);
+
+        if (!work)
+        {
+            break;
+        }
+
+        __c_make_glob_read_directory(worker, work);
+
+        __c_make_glob_lock(glob);
+        glob->pending_count -= 1;
+        __c_make_glob_unlock(glob, glob->pending_count == 0);
+    }
+}
+
+#if __C_MAKE_HAS_THREADS
+#  if C_MAKE_PLATFORM_WINDOWS
+static DWORD WINAPI
+__c_make_glob_thread(LPVOID parameter)
+{
+    __c_make_glob_run_worker((CMakeGlobWorker *) parameter);
+    return 0;
+}
+#  else
+static void *
+__c_make_glob_thread(void *parameter)
+{
+    __c_make_glob_run_worker((CMakeGlobWorker *) parameter);
+    return 0;
+}
+#  endif
+#endif
+
+static int
+__c_make_compare_c_strings(const void *a, const void *b)
+{
+    return strcmp(*(const char **) a, *(const char **) b);
+}
+
+// Returns all files that match 'pattern', sorted by path. A path component can
+// contain '*' and '?', and '**' matches any number of directories, for example
+// 'src/**/*.c'. Hidden files and directories are only matched by components that
+// start with a '.'. With 'parallel' the directories are read by multiple threads.
+C_MAKE_DEF CMakeFileList
+c_make_glob_files(CMakeMemory *memory, const char *pattern, bool parallel)
+{
+    CMakeFileList result = { 0, 0 };
+
+    CMakeGlob glob;
+    glob.component_count = 0;
+    glob.is_parallel = false;
+    glob.first_work = 0;
+    glob.pending_count = 0;
+
+    // The leading components without wildcards are the directory to start in.
+    CMakeString remaining = CMakeCString(pattern);
+    size_t base_length = 0;
+    bool has_wildcard = false;
+
+    while (remaining.count)
+    {
+        size_t length = 0;
+
+        while ((length < remaining.count) && (remaining.data[length] != '/') && (remaining.data[length] != '\\'))
+        {
+            length += 1;
+        }
+
+        CMakeString component = remaining;
+        component.count = length;
+
+        remaining.count -= length;
+        remaining.data += length;
+
+        bool has_separator = remaining.count > 0;
+
+        if (has_separator)
+        {
+            remaining.count -= 1;
+            remaining.data += 1;
+        }
+
+        if (!has_wildcard && __c_make_glob_has_wildcard(component))
+        {
+            has_wildcard = true;
+        }
+
+        if (!has_wildcard)
+        {
+            base_length = component.data + length + (has_separator ? 1 : 0) - pattern;
+        }
+        else if (component.count)
+        {
+            if (glob.component_count == CMakeArrayCount(glob.components))
+            {
+                c_make_log(CMakeLogLevelError, "glob pattern '%s' has too many components\n", pattern);
+                return result;
+            }
+
+            glob.components[glob.component_count++] = component;
+        }
+    }
+
+    if (!has_wildcard)
+    {
+        if (c_make_file_exists(pattern))
+        {
+            result.count = 1;
+            result.items = (const char **) c_make_memory_allocate(memory, sizeof(*result.items));
+            result.items[0] = c_make_copy_string(memory, CMakeCString(pattern)).data;
+        }
+
+        return result;
+    }
+
+    size_t worker_count = 1;
+
+#if __C_MAKE_HAS_THREADS
+    if (parallel)
+    {
+        int processor_count = c_make_get_processor_count();
+        worker_count = (processor_count > 16) ? 16 : (size_t) processor_count;
+    }
+#else
+    (void) parallel;
+#endif
+
+    CMakeTemporaryMemory temp_memory = c_make_begin_temporary_memory(1, &memory);
+    CMakeGlobWorker *workers = (CMakeGlobWorker *) c_make_memory_allocate(temp_memory.memory, worker_count * sizeof(*workers));
+
+    for (size_t i = 0; i < worker_count; i += 1)
+    {
+        CMakeGlobWorker *worker = workers + i;
+
+        worker->glob = &glob;
+        worker->memory.used = 0;
+        worker->memory.allocated = 0;
+        worker->memory.base = 0;
+        worker->memory.block = 0;
+        worker->count = 0;
+        worker->allocated = 0;
+        worker->items = 0;
+        worker->directory_count = 0;
+        worker->directory_allocated = 0;
+        worker->directories = 0;
+    }
+
+    CMakeString base = CMakeCString(pattern);
+    base.count = base_length;
+
+    const char *base_path = c_make_string_to_c_string_with_memory(&workers[0].memory, base);
+    __c_make_glob_push_work(workers, base_path, base_length, __c_make_glob_get_states(&glob, 0));
+
+#if __C_MAKE_HAS_THREADS
+    if (worker_count > 1)
+    {
+        glob.is_parallel = true;
+
+#  if C_MAKE_PLATFORM_WINDOWS
+        InitializeCriticalSection(&glob.mutex);
+        InitializeConditionVariable(&glob.condition);
+
+        for (size_t i = 1; i < worker_count; i += 1)
+        {
+            workers[i].thread = CreateThread(0, 0, __c_make_glob_thread, workers + i, 0, 0);
+        }
+#  else
+        pthread_mutex_init(&glob.mutex, 0);
+        pthread_cond_init(&glob.condition, 0);
+
+        for (size_t i = 1; i < worker_count; i += 1)
+        {
+            if (pthread_create(&workers[i].thread, 0, __c_make_glob_thread, workers + i))
+            {
+                workers[i].thread = pthread_self();
+            }
+        }
+#  endif
+    }
+#endif
+
+    __c_make_glob_run_worker(workers);
+
+#if __C_MAKE_HAS_THREADS
+    if (worker_count > 1)
+    {
+#  if C_MAKE_PLATFORM_WINDOWS
+        for (size_t i = 1; i < worker_count; i += 1)
+        {
+            if (workers[i].thread)
+            {
+                WaitForSingleObject(workers[i].thread, INFINITE);
+                CloseHandle(workers[i].thread);
+            }
+        }
+
+        DeleteCriticalSection(&glob.mutex);
+#  else
+        for (size_t i = 1; i < worker_count; i += 1)
+        {
+            if (!pthread_equal(workers[i].thread, pthread_self()))
+            {
+                pthread_join(workers[i].thread, 0);
+            }
+        }
+
+        pthread_cond_destroy(&glob.condition);
+        pthread_mutex_destroy(&glob.mutex);
+#  endif
+    }
+#endif
+
+    for (size_t i = 0; i < worker_count; i += 1)
+    {
+        result.count += workers[i].count;
+    }
+
+    result.items = (const char **) c_make_memory_allocate(memory, result.count * sizeof(*result.items));
+
+    size_t index = 0;
+
+    for (size_t i = 0; i < worker_count; i += 1)
+    {
+        for (size_t j = 0; j < workers[i].count; j += 1)
+        {
+            result.items[index++] = c_make_copy_string(memory, CMakeCString(workers[i].items[j])).data;
+        }
+
+        for (size_t j = 0; j < workers[i].directory_count; j += 1)
+        {
+            if (_c_make_context.build_log.is_recording)
+            {
+                __c_make_build_log_add_file(&_c_make_context.build_log, workers[i].directories[j]);
+            }
+
+            __c_make_watch_add_listed_directory(workers[i].directories[j]);
+        }
+
+        __c_make_memory_release(&workers[i].memory);
+    }
+
+    c_make_end_temporary_memory(temp_memory);
+
+    qsort(result.items, result.count, sizeof(*result.items), __c_make_compare_c_strings);
+
+    return result;
+}
+
+C_MAKE_DEF bool
+c_make_file_exists(const char *file_name)
+{
+    CMakeFileStatus status = __c_make_get_file_status(file_name);
+
+    return !status.error && status.is_regular_file;
+}
+
+C_MAKE_DEF bool
+c_make_directory_exists(const char *directory_name)
+{
+    CMakeFileStatus status = __c_make_get_file_status(directory_name);
+
+    return !status.error && status.is_directory;
+}
+
+C_MAKE_DEF bool
+c_make_create_directory(const char *directory_name)
+{
+    __c_make_invalidate_file_status_cache();
+
+#if C_MAKE_PLATFORM_WINDOWS
+    CMakeTemporaryMemory temp_memory = c_make_begin_temporary_memory(0, 0);
+
+    LPWSTR utf16_directory_name = c_make_c_string_utf8_to_utf16(temp_memory.memory, directory_name);
+
+    if (!CreateDirectory(utf16_directory_name, 0))
+    {
+        c_make_end_temporary_memory(temp_memory);
+
+        if (GetLastError() == ERROR_ALREADY_EXISTS)
+        {
+            return true;
+        }
+
+        return false;
+    }
+
+    c_make_end_temporary_memory(temp_memory);
+
+    return true;
+#elif C_MAKE_PLATFORM_ANDROID || C_MAKE_PLATFORM_FREEBSD || C_MAKE_PLATFORM_LINUX || C_MAKE_PLATFORM_MACOS
+    if (!mkdir(directory_name, 0775))
+    {
+        return true;
+    }
+
+    if (errno == EEXIST)
+    {
+        return true;
+    }
+
+    return false;
+#endif
+}
+
+C_MAKE_DEF bool
+c_make_create_directory_recursively(const char *directory_name)
+{
+#if C_MAKE_PLATFORM_WINDOWS
+    CMakeTemporaryMemory temp_memory = c_make_begin_temporary_memory(0, 0);
+
+    LPWSTR utf16_directory_name = c_make_c_string_utf8_to_utf16(temp_memory.memory, directory_name);
+    DWORD file_attributes = GetFileAttributes(utf16_directory_name);
+
+    if ((file_attributes == INVALID_FILE_ATTRIBUTES) || !(file_attributes & FILE_ATTRIBUTE_DIRECTORY))
+    {
+        CMakeString parent_string = CMakeCString(directory_name);
+        c_make_string_split_right_path_separator(&parent_string);
+
+        if (parent_string.count > 0)
+        {
+            const char *parent_directory = c_make_string_to_c_string_with_memory(temp_memory.memory, parent_string);
+
+            if (!c_make_create_directory_recursively(parent_directory))
+            {
+                c_make_end_temporary_memory(temp_memory);
+                return false;
+            }
+        }
+
+        if (!CreateDirectory(utf16_directory_name, 0) && (GetLastError() != ERROR_ALREADY_EXISTS))
+        {
+            c_make_end_temporary_memory(temp_memory);
+            return false;
+        }
+    }
+
+    c_make_end_temporary_memory(temp_memory);
+#elif C_MAKE_PLATFORM_ANDROID || C_MAKE_PLATFORM_FREEBSD || C_MAKE_PLATFORM_LINUX || C_MAKE_PLATFORM_MACOS
+    struct stat stats;
+
+    if (stat(directory_name, &stats) || S_ISDIR(stats.st_mode))
+    {
+        CMakeString parent_string = CMakeCString(directory_name);
+        c_make_string_split_right_path_separator(&parent_string);
+
+        if (parent_string.count > 0)
+        {
+            CMakeTemporaryMemory temp_memory = c_make_begin_temporary_memory(0, 0);
+
+            const char *parent_directory = c_make_string_to_c_string_with_memory(temp_memory.memory, parent_string);
+            bool result = c_make_create_directory_recursively(parent_directory);
+
+            c_make_end_temporary_memory(temp_memory);
+
+            if (!result)
+            {
+                return false;
+            }
+        }
+
+        if (mkdir(directory_name, 0775) && (errno != EEXIST))
+        {
+            return false;
+        }
+    }
+#endif
+
+    return true;
+}
+
+C_MAKE_DEF bool
+c_make_read_entire_file(const char *file_name, CMakeString *content)
+{
+#if C_MAKE_PLATFORM_WINDOWS
+    CMakeTemporaryMemory temp_memory = c_make_begin_temporary_memory(0, 0);
+
+    LPWSTR utf16_file_name = c_make_c_string_utf8_to_utf16(temp_memory.memory, file_name);
+    HANDLE file = CreateFile(utf16_file_name, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, 0, 0);
+
+    c_make_end_temporary_memory(temp_memory);
+
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    LARGE_INTEGER file_size;
+
+    if (!GetFileSizeEx(file, &file_size))
+    {
+        CloseHandle(file);
+        return false;
+    }
+
+    size_t public_used = c_make_memory_get_used(&_c_make_context.public_memory);
+
+    content->count = file_size.QuadPart;
+    content->data = (char *) c_make_memory_allocate(&_c_make_context.public_memory, content->count + 1);
+
+    size_t index = 0;
+
+    while (index < content->count)
+    {
+        DWORD bytes_read = 0;
+        if (!ReadFile(file, content->data + index, content->count - index, &bytes_read, 0))
+        {
+            c_make_memory_set_used(&_c_make_context.public_memory, public_used);
+            CloseHandle(file);
+            return false;
+        }
+
+        index += bytes_read;
+    }
+
+    content->data[content->count] = 0;
+
+    CloseHandle(file);
+    return true;
+#elif C_MAKE_PLATFORM_ANDROID || C_MAKE_PLATFORM_FREEBSD || C_MAKE_PLATFORM_LINUX || C_MAKE_PLATFORM_MACOS
+    int fd = open(file_name, O_RDONLY);
+
+    if (fd >= 0)
+    {
+        struct stat stats;
+
+        if (fstat(fd, &stats) < 0)
+        {
+            close(fd);
+            return false;
+        }
+
+        size_t public_used = c_make_memory_get_used(&_c_make_context.public_memory);
+
+        content->count = stats.st_size;
+        content->data = (char *) c_make_memory_allocate(&_c_make_context.public_memory, content->count + 1);
+
+        size_t index = 0;
+
+        while (index < content->count)
+        {
+            ssize_t read_bytes = read(fd, content->data + index, content->count - index);
+
+            if (read_bytes < 0)
+            {
+                c_make_memory_set_used(&_c_make_context.public_memory, public_used);
+                close(fd);
+                return false;
+            }
+
+            index += read_bytes;
+        }
+
+        content->data[content->count] = 0;
+
+        close(fd);
+        return true;
+    }
+    else
+    {
+        return false;
+    }
+#endif
+}
+
+C_MAKE_DEF bool
+c_make_write_entire_file(const char *file_name, CMakeString content)
+{
+    __c_make_invalidate_file_status_cache();
+
+#if C_MAKE_PLATFORM_WINDOWS
+    CMakeTemporaryMemory temp_memory = c_make_begin_temporary_memory(0, 0);
+
+    LPWSTR utf16_file_name = c_make_c_string_utf8_to_utf16(temp_memory.memory, file_name);
+    HANDLE file = CreateFile(utf16_file_name, GENERIC_WRITE, 0, 0,
+                             CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0);
+
+    c_make_end_temporary_memory(temp_memory);
+
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    while (content.count)
+    {
+        DWORD bytes_written = 0;
+        if (!WriteFile(file, content.data, content.count, &bytes_written, 0))
+        {
+            CloseHandle(file);
+            return false;
+        }
+
+        content.data += bytes_written;
+        content.count -= bytes_written;
+    }
+
+    CloseHandle(file);
+    return true;
+#elif C_MAKE_PLATFORM_ANDROID || C_MAKE_PLATFORM_FREEBSD || C_MAKE_PLATFORM_LINUX || C_MAKE_PLATFORM_MACOS
+    int fd = open(file_name, O_WRONLY | O_TRUNC | O_CREAT, 0664);
+
+    if (fd >= 0)
+    {
+        while (content.count)
+        {
+            ssize_t written_bytes = write(fd, content.data, content.count);
+
+            if (written_bytes < 0)
+            {
+                close(fd);
+                return false;
+            }
+
+            content.data += written_bytes;
+            content.count -= written_bytes;
+        }
+
+        close(fd);
+        return true;
+    }
+    else
+    {
+        return false;
+    }
+#endif
+}
+
+#if C_MAKE_PLATFORM_ANDROID || C_MAKE_PLATFORM_FREEBSD || C_MAKE_PLATFORM_LINUX || C_MAKE_PLATFORM_MACOS
+
+static bool
+__c_make_write_all(int fd, const unsigned char *data, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t written_bytes = write(fd, data, size);
+
+        if (written_bytes < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            return false;
+        }
+
+        data += written_bytes;
+        size -= written_bytes;
+    }
+
+    return true;
+}
+
+// Copies the content of 'src_fd' to 'dst_fd', both starting at their current file offset.
+// The fastest available method is tried first: a reflink shares the data blocks with the
+// source, copy_file_range and sendfile copy inside the kernel. Every method continues where
+// the previous one stopped, the last one is a plain read/write loop.
+static bool
+__c_make_copy_file_descriptor(int src_fd, int dst_fd, uint64_t size)
+{
+    uint64_t index = 0;
+    bool reached_end_of_file = (size == 0);
+
+#if C_MAKE_PLATFORM_ANDROID || C_MAKE_PLATFORM_LINUX
+    if (!reached_end_of_file && (ioctl(dst_fd, FICLONE, src_fd) == 0))
+    {
+        return true;
+    }
+#endif
+
+#if C_MAKE_PLATFORM_LINUX && defined(SYS_copy_file_range)
+    // The system call is used directly, glibc only declares copy_file_range with
+    // _GNU_SOURCE and since version 2.27.
+    long syscall(long, ...);
+
+    while (!reached_end_of_file && (index < size))
+    {
+        ssize_t copied_bytes = syscall(SYS_copy_file_range, src_fd, (void *) 0, dst_fd, (void *) 0, (size_t) (size - index), 0u);
+
+        if (copied_bytes < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            break;
+        }
+
+        if (copied_bytes == 0)
+        {
+            reached_end_of_file = true;
+        }
+
+        index += copied_bytes;
+    }
+#endif
+
+#if C_MAKE_PLATFORM_ANDROID || C_MAKE_PLATFORM_LINUX
+    while (!reached_end_of_file && (index < size))
+    {
+        uint64_t remaining_size = size - index;
+        ssize_t copied_bytes = sendfile(dst_fd, src_fd, 0, (remaining_size < 0x40000000) ? remaining_size : 0x40000000);
+
+        if (copied_bytes < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            break;
+        }
+
+        if (copied_bytes == 0)
+        {
+            reached_end_of_file = true;
+        }
+
+        index += copied_bytes;
+    }
+#endif
+
+    if (reached_end_of_file || (index >= size))
+    {
+        return true;
+    }
+
+    // The buffer is not taken from a c_make memory, because installs copy on multiple threads.
+    size_t buffer_size = 1024 * 1024;
+    unsigned char *buffer = (unsigned char *) c_make_malloc(buffer_size);
+
+    if (!buffer)
+    {
+        return false;
+    }
+
+    bool result = true;
+
+    // Short reads are fine, the loop only stops at the end of the file.
+    for (;;)
+    {
+        ssize_t read_bytes = read(src_fd, buffer, buffer_size);
+
+        if (read_bytes < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            result = false;
+            break;
+        }
+
+        if (read_bytes == 0)
+        {
+            break;
+        }
+
+        if (!__c_make_write_all(dst_fd, buffer, read_bytes))
+        {
+            result = false;
+            break;
+        }
+    }
+
+    c_make_free(buffer);
+
+    return result;
+}
+
+#endif
+
+C_MAKE_DEF bool
+c_make_copy_file(const char *src_file_name, const char *dst_file_name)
+{
+    __c_make_invalidate_file_status_cache();
+
+#if C_MAKE_PLATFORM_WINDOWS
+    CMakeTemporaryMemory temp_memory = c_make_begin_temporary_memory(0, 0);
+
+    LPWSTR utf16_src_file_name = c_make_c_string_utf8_to_utf16(temp_memory.memory, src_file_name);
+    LPWSTR utf16_dst_file_name = c_make_c_string_utf8_to_utf16(temp_memory.memory, dst_file_name);
+
+    if (!CopyFile(utf16_src_file_name, utf16_dst_file_name, FALSE))
+    {
+        c_make_end_temporary_memory(temp_memory);
+        return false;
+    }
+
+    c_make_end_temporary_memory(temp_memory);
+
+    return true;
+#elif C_MAKE_PLATFORM_ANDROID || C_MAKE_PLATFORM_FREEBSD || C_MAKE_PLATFORM_LINUX || C_MAKE_PLATFORM_MACOS
+    int fchmod(int, mode_t);
+
+    int src_fd = open(src_file_name, O_RDONLY);
+
+    if (src_fd < 0)
+    {
+        c_make_log(CMakeLogLevelError, "could not open file '%s': %s\n", src_file_name, strerror(errno));
+        return false;
+    }
+
+    struct stat stats;
+
+    if (fstat(src_fd, &stats) < 0)
+    {
+        c_make_log(CMakeLogLevelError, "could not get file stats on '%s': %s\n", src_file_name, strerror(errno));
+        close(src_fd);
+        return false;
+    }
+
+    int dst_fd = open(dst_file_name, O_WRONLY | O_TRUNC | O_CREAT, stats.st_mode & 07777);
+
+    if (dst_fd < 0)
+    {
+        c_make_log(CMakeLogLevelError, "could not create file '%s': %s\n", dst_file_name, strerror(errno));
+        close(src_fd);
+        return false;
+    }
+
+    if (!__c_make_copy_file_descriptor(src_fd, dst_fd, (uint64_t) stats.st_size))
+    {
+        c_make_log(CMakeLogLevelError, "could not copy '%s' to '%s': %s\n", src_file_name, dst_file_name, strerror(errno));
+        close(src_fd);
+        close(dst_fd);
+        return false;
+    }
+
+    // The mode passed to open is masked by the umask and ignored for existing files.
+    if (fchmod(dst_fd, stats.st_mode & 07777) < 0)
+    {
+        c_make_log(CMakeLogLevelWarning, "could not set the mode of '%s': %s\n", dst_file_name, strerror(errno));
+    }
+
+    close(dst_fd);
+    close(src_fd);
+    return true;
+#endif
+}
+
+C_MAKE_DEF bool
+c_make_rename_file(const char *old_file_name, const char *new_file_name)
+{
+    __c_make_invalidate_file_status_cache();
+
+#if C_MAKE_PLATFORM_WINDOWS
+    CMakeTemporaryMemory temp_memory = c_make_begin_temporary_memory(0, 0);
+
+    LPWSTR utf16_old_file_name = c_make_c_string_utf8_to_utf16(temp_memory.memory, old_file_name);
+    LPWSTR utf16_new_file_name = c_make_c_string_utf8_to_utf16(temp_memory.memory, new_file_name);
+
+    bool result =
+        MoveFileEx(utf16_old_file_name, utf16_new_file_name, MOVEFILE_REPLACE_EXISTING) ? true : false;
+
+    c_make_end_temporary_memory(temp_memory);
+
+    return result;
+#elif C_MAKE_PLATFORM_ANDROID || C_MAKE_PLATFORM_FREEBSD || C_MAKE_PLATFORM_LINUX || C_MAKE_PLATFORM_MACOS
+    if (rename(old_file_name, new_file_name))
+    {
+        return false;
+    }
+
+    return true;
+#endif
+}
+
+C_MAKE_DEF bool
+c_make_delete_file(const char *file_name)
+{
+    __c_make_invalidate_file_status_cache();
+
+#if C_MAKE_PLATFORM_WINDOWS
+    CMakeTemporaryMemory temp_memory = c_make_begin_temporary_memory(0, 0);
+
+    LPWSTR utf16_file_name = c_make_c_string_utf8_to_utf16(temp_memory.memory, file_name);
+
+    bool result = DeleteFile(utf16_file_name) ? true : false;
+
+    if (!result && (GetLastError() == ERROR_FILE_NOT_FOUND))
+    {
+        result = true;
+    }
+
+    c_make_end_temporary_memory(temp_memory);
+
+    return result;
+#elif C_MAKE_PLATFORM_ANDROID || C_MAKE_PLATFORM_FREEBSD || C_MAKE_PLATFORM_LINUX || C_MAKE_PLATFORM_MACOS
+    if (unlink(file_name))
+    {
+        if (errno == ENOENT)
+        {
+            return true;
+        }
+
+        return false;
+    }
+
+    return true;
+#endif
+}
+
+// A file that c_make_install has to copy. All paths are prepared before the copies
+// run on multiple threads, which don't touch the c_make memories.
+typedef struct CMakeInstallCopy
+{
+    const char *source;
+    const char *destination;
+    const char *temp_file;
+    uint32_t mode;
+
+#if C_MAKE_PLATFORM_WINDOWS
+    LPWSTR utf16_source;
+    LPWSTR utf16_destination;
+    LPWSTR utf16_temp_file;
+#endif
+
+    bool succeeded;
+    int error;
+} CMakeInstallCopy;
+
+typedef struct CMakeInstall
+{
+    size_t count;
+    CMakeInstallCopy *items;
+    size_t next_index;
+
+    bool is_parallel;
+
+#if __C_MAKE_HAS_THREADS
+#  if C_MAKE_PLATFORM_WINDOWS
+    CRITICAL_SECTION mutex;
+#  else
+    pthread_mutex_t mutex;
+#  endif
+#endif
+} CMakeInstall;
+
+// The destination only changes with the final rename, so an interrupted install never
+// leaves a partially written file behind.
+static void
+__c_make_install_copy_file(CMakeInstallCopy *copy)
+{
+#if C_MAKE_PLATFORM_WINDOWS
+    copy->succeeded = CopyFile(copy->utf16_source, copy->utf16_temp_file, FALSE) &&
+                      MoveFileEx(copy->utf16_temp_file, copy->utf16_destination, MOVEFILE_REPLACE_EXISTING);
+
+    if (!copy->succeeded)
+    {
+        copy->error = (int) GetLastError();
+        DeleteFile(copy->utf16_temp_file);
+    }
+#elif C_MAKE_PLATFORM_ANDROID || C_MAKE_PLATFORM_FREEBSD || C_MAKE_PLATFORM_LINUX || C_MAKE_PLATFORM_MACOS
+    int fchmod(int, mode_t);
+
+    copy->succeeded = false;
+
+    int src_fd = open(copy->source, O_RDONLY | O_CLOEXEC);
+
+    if (src_fd < 0)
+    {
+        copy->error = errno;
+        return;
+    }
+
+    struct stat stats;
+
+    if (fstat(src_fd, &stats) == 0)
+    {
+        mode_t mode = copy->mode ? (mode_t) copy->mode : (stats.st_mode & 07777);
+
+        unlink(copy->temp_file);
+
+        int dst_fd = open(copy->temp_file, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+
+        if (dst_fd >= 0)
+        {
+            copy->succeeded = __c_make_copy_file_descriptor(src_fd, dst_fd, (uint64_t) stats.st_size) &&
+                              (fchmod(dst_fd, mode) == 0);
+            copy->error = errno;
+
+            close(dst_fd);
+
+            if (copy->succeeded && rename(copy->temp_file, copy->destination))
+            {
+                copy->succeeded = false;
+                copy->error = errno;
+            }
+
+            if (!copy->succeeded)
+            {
+                unlink(copy->temp_file);
+            }
+        }
+        else
+        {
+            copy->error = errno;
+        }
+    }
+    else
+    {
+        copy->error = errno;
+    }
+
+    close(src_fd);
+#endif
+}
+
+static void
+__c_make_install_run_worker(CMakeInstall *install)
+{
+    for (;;)
+    {
+#if __C_MAKE_HAS_THREADS
+        if (install->is_parallel)
+        {
+#  if C_MAKE_PLATFORM_WINDOWS
+            EnterCriticalSection(&install->mutex);
+#  else
+            pthread_mutex_lock(&install->mutex);
+#  endif
+        }
+#endif
+
+        size_t index = install->next_index;
+
+        if (index < install->count)
+        {
+            install->next_index += 1;
+        }
+
+#if __C_MAKE_HAS_THREADS
+        if (install->is_parallel)
+        {
+#  if C_MAKE_PLATFORM_WINDOWS
+            LeaveCriticalSection(&install->mutex);
+#  else
+            pthread_mutex_unlock(&install->mutex);
+#  endif
+        }
+#endif
+
+        if (index >= install->count)
+        {
+            break;
+        }
+
+        __c_make_install_copy_file(install->items + index);
+    }
+}
+
+#if __C_MAKE_HAS_THREADS
+#  if C_MAKE_PLATFORM_WINDOWS
+static DWORD WINAPI
+__c_make_install_thread(LPVOID parameter)
+{
+    __c_make_install_run_worker((CMakeInstall *) parameter);
+    return 0;
+}
+#  else
+static void *
+__c_make_install_thread(void *parameter)
+{
+    __c_make_install_run_worker((CMakeInstall *) parameter);
+    return 0;
+}
+#  endif
+#endif
+
+static bool
+__c_make_path_is_absolute(const char *path)
+{
+#if C_MAKE_PLATFORM_WINDOWS
+    return (path[0] == '/') || (path[0] == '\\') || (path[0] && (path[1] == ':'));
+#else
+    return path[0] == '/';
+#endif
+}
+
+// Adds a file to an install manifest. A relative 'destination' is relative to the
+// install prefix. 'mode' are the permission bits of the installed file, 0 keeps the
+// mode of the source. The strings are not copied.
+C_MAKE_DEF void
+c_make_install_manifest_add(CMakeInstallManifest *manifest, const char *source, const char *destination, uint32_t mode)
+{
+    if (manifest->count == manifest->allocated)
+    {
+        size_t old_count = manifest->allocated;
+        manifest->allocated += 16;
+        manifest->items = (CMakeInstallFile *) c_make_memory_reallocate(&_c_make_context.public_memory, manifest->items,
+                                                                        old_count * sizeof(*manifest->items),
+                                                                        manifest->allocated * sizeof(*manifest->items));
+    }
+
+    CMakeInstallFile *file = manifest->items + manifest->count;
+    manifest->count += 1;
+
+    file->source = source;
+    file->destination = destination;
+    file->mode = mode;
+}
+
+// Installs all files of the manifest. A file is skipped if the destination has the same
+// size and content hash. The content hashes are kept in the hash database, so unchanged
+// files are not even read again. The other files are copied in parallel.
+C_MAKE_DEF bool
+c_make_install(CMakeInstallManifest manifest)
+{
+    bool result = true;
+
+    CMakeTemporaryMemory temp_memory = c_make_begin_temporary_memory(0, 0);
+
+    const char *install_prefix = c_make_get_install_prefix();
+    CMakeHashDatabase *database = __c_make_get_hash_database();
+
+    CMakeInstall install;
+    install.count = 0;
+    install.items = (CMakeInstallCopy *) c_make_memory_allocate(temp_memory.memory, manifest.count * sizeof(*install.items));
+    install.next_index = 0;
+    install.is_parallel = false;
+
+    for (size_t i = 0; i < manifest.count; i += 1)
+    {
+        CMakeInstallFile *file = manifest.items + i;
+
+        const char *destination = file->destination;
+
+        if (!__c_make_path_is_absolute(destination))
+        {
+            destination = c_make_c_string_path_concat_with_memory(temp_memory.memory, install_prefix, destination);
+        }
+
+        uint64_t size, modification_time;
+
+        if (!__c_make_get_file_info(file->source, &size, &modification_time))
+        {
+            c_make_log(CMakeLogLevelError, "could not install '%s': %s\n", file->source, strerror(errno));
+            result = false;
+            continue;
+        }
+
+        uint64_t destination_size, destination_modification_time;
+
+        if (__c_make_get_file_info(destination, &destination_size, &destination_modification_time) &&
+            (destination_size == size))
+        {
+            uint64_t hash = __c_make_get_file_hash(database, file->source);
+
+            if (hash && (hash == __c_make_get_file_hash(database, destination)))
+            {
+#if C_MAKE_PLATFORM_ANDROID || C_MAKE_PLATFORM_FREEBSD || C_MAKE_PLATFORM_LINUX || C_MAKE_PLATFORM_MACOS
+                struct stat source_stats, destination_stats;
+
+                if (!stat(file->source, &source_stats) && !stat(destination, &destination_stats))
+                {
+                    mode_t mode = file->mode ? (mode_t) file->mode : (source_stats.st_mode & 07777);
+
+                    if (((destination_stats.st_mode & 07777) != mode) && chmod(destination, mode))
+                    {
+                        c_make_log(CMakeLogLevelWarning, "could not set the mode of '%s': %s\n", destination, strerror(errno));
+                    }
+                }
+#endif
+
+                continue;
+            }
+        }
+
+        CMakeString directory = CMakeCString(destination);
+        c_make_string_split_right_path_separator(&directory);
+
+        if (directory.count)
+        {
+            c_make_create_directory_recursively(c_make_string_to_c_string_with_memory(temp_memory.memory, directory));
+        }
+
+        CMakeInstallCopy *copy = install.items + install.count;
+        install.count += 1;
+
+        copy->source = file->source;
+        copy->destination = destination;
+        copy->temp_file = c_make_c_string_concat_with_memory(temp_memory.memory, destination, ".c_make_tmp");
+        copy->mode = file->mode;
+#if C_MAKE_PLATFORM_WINDOWS
+        copy->utf16_source = c_make_c_string_utf8_to_utf16(temp_memory.memory, copy->source);
+        copy->utf16_destination = c_make_c_string_utf8_to_utf16(temp_memory.memory, copy->destination);
+        copy->utf16_temp_file = c_make_c_string_utf8_to_utf16(temp_memory.memory, copy->temp_file);
+#endif
+        copy->succeeded = false;
+        copy->error = 0;
+    }
+
+    size_t worker_count = 1;
+
+#if __C_MAKE_HAS_THREADS
+    int processor_count = c_make_get_processor_count();
+    worker_count = (processor_count > 16) ? 16 : (size_t) processor_count;
+
+    if (worker_count > install.count)
+    {
+        worker_count = install.count;
+    }
+
+    if (worker_count > 1)
+    {
+        install.is_parallel = true;
+
+#  if C_MAKE_PLATFORM_WINDOWS
+        HANDLE *threads = (HANDLE *) c_make_memory_allocate(temp_memory.memory, worker_count * sizeof(*threads));
+
+        InitializeCriticalSection(&install.mutex);
+
+        for (size_t i = 1; i < worker_count; i += 1)
+        {
+            threads[i] = CreateThread(0, 0, __c_make_install_thread, &install, 0, 0);
+        }
+
+        __c_make_install_run_worker(&install);
+
+        for (size_t i = 1; i < worker_count; i += 1)
+        {
+            if (threads[i])
+            {
+                WaitForSingleObject(threads[i], INFINITE);
+                CloseHandle(threads[i]);
+            }
+        }
+
+        DeleteCriticalSection(&install.mutex);
+#  else
+        pthread_t *threads = (pthread_t *) c_make_memory_allocate(temp_memory.memory, worker_count * sizeof(*threads));
+
+        pthread_mutex_init(&install.mutex, 0);
+
+        for (size_t i = 1; i < worker_count; i += 1)
+        {
+            if (pthread_create(threads + i, 0, __c_make_install_thread, &install))
+            {
+                threads[i] = pthread_self();
+            }
+        }
+
+        __c_make_install_run_worker(&install);
+
+        for (size_t i = 1; i < worker_count; i += 1)
+        {
+            if (!pthread_equal(threads[i], pthread_self()))
+            {
+                pthread_join(threads[i], 0);
+            }
+        }
+
+        pthread_mutex_destroy(&install.mutex);
+#  endif
+    }
+    else
+#endif
+    {
+        __c_make_install_run_worker(&install);
+    }
+
+    __c_make_invalidate_file_status_cache();
+
+    for (size_t i = 0; i < install.count; i += 1)
+    {
+        CMakeInstallCopy *copy = install.items + i;
+
+        if (copy->succeeded)
+        {
+            c_make_log(CMakeLogLevelInfo, "install '%s'\n", copy->destination);
+
+            // The destination has the content of the source, so it doesn't need to be hashed.
+            uint64_t hash = __c_make_get_file_hash(database, copy->source);
+            CMakeFileHash *destination = __c_make_hash_database_get_file(database, CMakeCString(copy->destination));
+
+            if (hash && __c_make_get_file_info(copy->destination, &destination->size, &destination->modification_time))
+            {
+                destination->hash = hash;
+                database->is_dirty = true;
+            }
+        }
+        else
+        {
+#if C_MAKE_PLATFORM_WINDOWS
+            c_make_log(CMakeLogLevelError, "could not install '%s' to '%s' (GetLastError = %d)\n", copy->source, copy->destination, copy->error);
+#else
+            c_make_log(CMakeLogLevelError, "could not install '%s' to '%s': %s\n", copy->source, copy->destination, strerror(copy->error));
+#endif
+            result = false;
+        }
+    }
+
+    if (!result)
+    {
+        _c_make_context.did_fail = true;
+    }
+
+    c_make_end_temporary_memory(temp_memory);
+
+    return result;
+}
+
+C_MAKE_DEF bool
+c_make_has_slash_or_backslash(const char *path)
+{
+    if (path)
+    {
+        while (*path)
+        {
+            if ((*path == '/') || (*path == '\\'))
+            {
+                return true;
+            }
+
+            path += 1;
+        }
+
+        return false;
+    }
+    else
+    {
+        return false;
+    }
+}
+
+C_MAKE_DEF CMakeString
+c_make_get_environment_variable(CMakeMemory *memory, const char *variable_name)
+{
+    CMakeString result = { 0, 0 };
+
+#if C_MAKE_PLATFORM_WINDOWS
+    CMakeTemporaryMemory temp_memory = c_make_begin_temporary_memory(1, &memory);
+
+    wchar_t *utf16_variable_name = c_make_c_string_utf8_to_utf16(temp_memory.memory, variable_name);
+    DWORD variable_size = GetEnvironmentVariable(utf16_variable_name, 0, 0);
+
+    if (variable_size > 0)
+    {
+        wchar_t *variable = (wchar_t *) c_make_memory_allocate(temp_memory.memory, sizeof(wchar_t) * variable_size);
+        DWORD ret = GetEnvironmentVariable(utf16_variable_name, variable, variable_size);
+
+        if ((ret > 0) && (ret < variable_size))
+        {
+            result = c_make_string_utf16_to_utf8(memory, variable, ret);
+        }
+    }
+
+    c_make_end_temporary_memory(temp_memory);
+#elif C_MAKE_PLATFORM_ANDROID || C_MAKE_PLATFORM_FREEBSD || C_MAKE_PLATFORM_LINUX || C_MAKE_PLATFORM_MACOS
+    (void) memory;
+
+    char *variable = getenv(variable_name);
+
+    if (variable)
+    {
+        result = CMakeCString(variable);
+    }
+#endif
+
+    return result;
+}
+
+C_MAKE_DEF const char *
+c_make_find_program(const char *program_name)
+{
+    // Found programs are remembered in the config as 'program.<name>'. The config is
+    // stored during setup, so later runs don't have to search the PATH again.
+    const char *config_key = c_make_c_string_concat("program.", program_name);
+    CMakeConfigValue cached_path = c_make_config_get(config_key);
+
+    if (cached_path.is_valid && c_make_file_exists(cached_path.val))
+    {
+        return cached_path.val;
+    }
+
+    CMakeTemporaryMemory temp_memory = c_make_begin_temporary_memory(0, 0);
+    CMakeString paths = c_make_get_environment_variable(temp_memory.memory, "PATH");
+
+    size_t public_used = c_make_memory_get_used(&_c_make_context.public_memory);
+    size_t memory_used = c_make_memory_get_used(temp_memory.memory);
+
+    while (paths.count)
+    {
+#if C_MAKE_PLATFORM_WINDOWS
+        char *path = c_make_string_to_c_string_with_memory(temp_memory.memory, c_make_string_split_left(&paths, ';'));
+#elif C_MAKE_PLATFORM_ANDROID || C_MAKE_PLATFORM_FREEBSD || C_MAKE_PLATFORM_LINUX || C_MAKE_PLATFORM_MACOS
+        char *path = c_make_string_to_c_string_with_memory(temp_memory.memory, c_make_string_split_left(&paths, ':'));
+#endif
+
+        char *full_path = c_make_c_string_path_concat(path, program_name);
+
+        c_make_memory_set_used(temp_memory.memory, memory_used);
+
+        // TODO: is executable?
+        if (c_make_file_exists(full_path))
+        {
+            c_make_end_temporary_memory(temp_memory);
+            c_make_config_set(config_key, full_path);
+            return full_path;
+        }
+
+        c_make_memory_set_used(&_c_make_context.public_memory, public_used);
+    }
+
+    c_make_end_temporary_memory(temp_memory);
+
+    return 0;
+}
+
+C_MAKE_DEF const char *
+c_make_get_executable(const char *config_name, const char *fallback_executable)
+{
+    CMakeConfigValue value = c_make_config_get(config_name);
+    const char *result = 0;
+
+    if (value.is_valid)
+    {
+        result = value.val;
+
+        if (!c_make_has_slash_or_backslash(result))
+        {
+            result = c_make_find_program(result);
+        }
+    }
+    else
+    {
+        result = c_make_find_program(fallback_executable);
+    }
+
+    return result;
+}
+
+C_MAKE_DEF CMakeString
+c_make_string_concat_va(CMakeMemory *memory, size_t count, ...)
+{
+    CMakeString result = { 0, 0 };
+
+    va_list args;
+    va_start(args, count);
+
+    for (size_t i = 0; i < count; i += 1)
+    {
+        CMakeString str = va_arg(args, CMakeString);
+        result.count += str.count;
+    }
+
+    va_end(args);
+
+    result.data = (char *) c_make_memory_allocate(memory, result.count + 1);
+    char *dst = result.data;
+
+    va_start(args, count);
+
+    for (size_t i = 0; i < count; i += 1)
+    {
+        CMakeString str = va_arg(args, CMakeString);
+
+        for (size_t j = 0; j < str.count; j += 1)
+        {
+            *dst++ = str.data[j];
+        }
+    }
+
+    va_end(args);
+
+    result.data[result.count] = 0;
+
+    return result;
+}
+
+C_MAKE_DEF CMakeString
+c_make_string_path_concat_va(CMakeMemory *memory, size_t count, ...)
+{
+    CMakeTemporaryMemory temp_memory = c_make_begin_temporary_memory(1, &memory);
+
+    CMakeString *strings = (CMakeString *) c_make_memory_allocate(temp_memory.memory, count * sizeof(*strings));
+
+    va_list args;
+    va_start(args, count);
+
+    for (size_t i = 0; i < count; i += 1)
+    {
+        strings[i] = va_arg(args, CMakeString);
+    }
+
+    va_end(args);
+
+    CMakeString result = c_make_path_concat(memory, count, strings);
+
+    c_make_end_temporary_memory(temp_memory);
+
+    return result;
+}
+
+C_MAKE_DEF char *
+c_make_c_string_concat_va(CMakeMemory *memory, size_t count, ...)
+{
+    size_t length = 1;
+
+    va_list args;
+    va_start(args, count);
+
+    for (size_t i = 0; i < count; i += 1)
+    {
+        const char *str = va_arg(args, const char *);
+        length += c_make_get_c_string_length(str);
+    }
+
+    va_end(args);
+
+    char *result = (char *) c_make_memory_allocate(memory, length);
+    char *dst = result;
+
+    va_start(args, count);
+
+    for (size_t i = 0; i < count; i += 1)
+    {
+        const char *str = va_arg(args, const char *);
+        while (*str) *dst++ = *str++;
+    }
+
+    va_end(args);
+
+    *dst = 0;
+
+    return result;
+}
+
+C_MAKE_DEF char *
+c_make_c_string_path_concat_va(CMakeMemory *memory, size_t count, ...)
+{
+    CMakeTemporaryMemory temp_memory = c_make_begin_temporary_memory(1, &memory);
+
+    CMakeString *strings = (CMakeString *) c_make_memory_allocate(temp_memory.memory, count * sizeof(*strings));
+
+    va_list args;
+    va_start(args, count);
+
+    for (size_t i = 0; i < count; i += 1)
+    {
+        const char *str = va_arg(args, const char *);
+        strings[i] = CMakeCString(str);
+    }
+
+    va_end(args);
+
+    CMakeString result = c_make_path_concat(memory, count, strings);
+
+    c_make_end_temporary_memory(temp_memory);
+
+    return result.data;
+}
+
+static uint64_t
+__c_make_get_time_in_microseconds(void)
+{
+#if C_MAKE_PLATFORM_WINDOWS
+    LARGE_INTEGER frequency, counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+
+    return (uint64_t) ((counter.QuadPart / frequency.QuadPart) * 1000000 +
+                       ((counter.QuadPart % frequency.QuadPart) * 1000000) / frequency.QuadPart);
+#else
+    int clock_gettime(clockid_t, struct timespec *);
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return ((uint64_t) now.tv_sec * 1000000) + ((uint64_t) now.tv_nsec / 1000);
+#endif
+}
+
+// Trace events are named after the program and its output file, e.g. 'cc system_info'.
+static const char *
+__c_make_get_trace_name(CMakeMemory *memory, CMakeCommand command)
+{
+    CMakeString program = CMakeCString(command.items[0]);
+    CMakeString program_name = c_make_string_split_right_path_separator(&program);
+    CMakeString output_name = { 0, 0 };
+
+    for (size_t i = 1; i < command.count; i += 1)
+    {
+        CMakeString argument = CMakeCString(command.items[i]);
+
+        if ((c_make_strings_are_equal(argument, CMakeStringLiteral("-o")) ||
+             c_make_strings_are_equal(argument, CMakeStringLiteral("-Fe")) ||
+             c_make_strings_are_equal(argument, CMakeStringLiteral("-Fo"))) && ((i + 1) < command.count))
+        {
+            CMakeString output = CMakeCString(command.items[i + 1]);
+            output_name = c_make_string_split_right_path_separator(&output);
+        }
+        else if (c_make_string_starts_with(argument, CMakeStringLiteral("-Fe")) ||
+                 c_make_string_starts_with(argument, CMakeStringLiteral("-Fo")))
+        {
+            CMakeString output = argument;
+            output.count -= 3;
+            output.data += 3;
+            output_name = c_make_string_split_right_path_separator(&output);
+        }
+    }
+
+    if (output_name.count)
+    {
+        return c_make_string_concat_with_memory(memory, program_name, CMakeStringLiteral(" "), output_name).data;
+    }
+
+    return c_make_copy_string(memory, program_name).data;
+}
+
+#if C_MAKE_PLATFORM_ANDROID || C_MAKE_PLATFORM_FREEBSD || C_MAKE_PLATFORM_LINUX || C_MAKE_PLATFORM_MACOS
+
+// Both ends are close-on-exec, so that other commands don't inherit them and keep the
+// pipe open. The read end is non-blocking, so it can be drained without blocking.
+static bool
+__c_make_create_pipe(int fds[2])
+{
+    if (pipe(fds) < 0)
+    {
+        return false;
+    }
+
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+
+    return true;
+}
+
+// sigaction is missing in strict modes like -std=c99, where waiting falls back to waking
+// up regularly.
+#if defined(SA_NOCLDSTOP) && defined(SA_RESTART)
+
+static void
+__c_make_child_signal_handler(int signal_number)
+{
+    (void) signal_number;
+
+    int saved_errno = errno;
+    char byte = 0;
+    ssize_t written_bytes = write(_c_make_context.child_signal_pipe[1], &byte, 1);
+    (void) written_bytes;
+    errno = saved_errno;
+}
+
+#endif
+
+// Installs the SIGCHLD handler before the first wait. A process that exited before is
+// found by the wait4 that precedes every poll.
+static void
+__c_make_install_child_signal_handler(void)
+{
+#if defined(SA_NOCLDSTOP) && defined(SA_RESTART)
+    int fds[2];
+
+    if (_c_make_context.child_signal_installed || !__c_make_create_pipe(fds))
+    {
+        return;
+    }
+
+    // The handler must never block on a full pipe.
+    fcntl(fds[1], F_SETFL, fcntl(fds[1], F_GETFL) | O_NONBLOCK);
+
+    _c_make_context.child_signal_pipe[0] = fds[0];
+    _c_make_context.child_signal_pipe[1] = fds[1];
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = __c_make_child_signal_handler;
+    action.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+    sigemptyset(&action.sa_mask);
+
+    if (sigaction(SIGCHLD, &action, 0) == 0)
+    {
+        _c_make_context.child_signal_installed = true;
+    }
+    else
+    {
+        close(fds[0]);
+        close(fds[1]);
+    }
+#endif
+}
+
+// Reads all output that is available right now. The pipe is closed at the end of the file.
+static void
+__c_make_read_output(CMakeOutputBuffer *buffer)
+{
+    while (buffer->fd >= 0)
+    {
+        if (buffer->count == buffer->allocated)
+        {
+            size_t new_allocated = buffer->allocated ? (2 * buffer->allocated) : 4096;
+            char *new_data = (char *) c_make_malloc(new_allocated);
+
+            if (!new_data)
+            {
+                close(buffer->fd);
+                buffer->fd = -1;
+                break;
+            }
+
+            if (buffer->data)
+            {
+                memcpy(new_data, buffer->data, buffer->count);
+                c_make_free(buffer->data);
+            }
+
+            buffer->allocated = new_allocated;
+            buffer->data = new_data;
+        }
+
+        ssize_t read_bytes = read(buffer->fd, buffer->data + buffer->count, buffer->allocated - buffer->count);
+
+        if (read_bytes > 0)
+        {
+            buffer->count += read_bytes;
+        }
+        else if ((read_bytes < 0) && (errno == EINTR))
+        {
+            continue;
+        }
+        else if ((read_bytes < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK)))
+        {
+            break;
+        }
+        else
+        {
+            close(buffer->fd);
+            buffer->fd = -1;
+        }
+    }
+}
+
+// Waits up to 'timeout' milliseconds, or without limit if it is negative, until a process
+// exits, a running process writes output or 'extra_fd' gets readable. The output is read.
+// Returns true if 'extra_fd' is readable.
+static bool
+__c_make_poll_output(int timeout, int extra_fd)
+{
+    CMakeTemporaryMemory temp_memory = c_make_begin_temporary_memory(0, 0);
+
+    size_t fd_count = 0;
+    struct pollfd *fds = (struct pollfd *) c_make_memory_allocate(temp_memory.memory, (2 * _c_make_context.process_group.count + 2) * sizeof(struct pollfd));
+
+    if (_c_make_context.child_signal_installed)
+    {
+        fds[fd_count].fd = _c_make_context.child_signal_pipe[0];
+        fds[fd_count].events = POLLIN;
+        fds[fd_count].revents = 0;
+        fd_count += 1;
+    }
+    else if ((timeout < 0) || (timeout > 10))
+    {
+        // Without the signal handler nothing wakes up poll when a process exits.
+        timeout = 10;
+    }
+
+    size_t extra_index = fd_count;
+
+    if (extra_fd >= 0)
+    {
+        fds[fd_count].fd = extra_fd;
+        fds[fd_count].events = POLLIN;
+        fds[fd_count].revents = 0;
+        fd_count += 1;
+    }
+
+    for (size_t i = 0; i < _c_make_context.process_group.count; i += 1)
+    {
+        CMakeProcess *process = _c_make_context.process_group.items + i;
+
+        for (int j = 0; j < 2; j += 1)
+        {
+            if (process->output[j].fd >= 0)
+            {
+                fds[fd_count].fd = process->output[j].fd;
+                fds[fd_count].events = POLLIN;
+                fds[fd_count].revents = 0;
+                fd_count += 1;
+            }
+        }
+    }
+
+    bool result = false;
+
+    if (poll(fds, fd_count, timeout) > 0)
+    {
+        if (_c_make_context.child_signal_installed && fds[0].revents)
+        {
+            char buffer[64];
+            while (read(_c_make_context.child_signal_pipe[0], buffer, sizeof(buffer)) > 0);
+        }
+
+        result = (extra_fd >= 0) && fds[extra_index].revents;
+
+        for (size_t i = 0; i < _c_make_context.process_group.count; i += 1)
+        {
+            CMakeProcess *process = _c_make_context.process_group.items + i;
+
+            for (int j = 0; j < 2; j += 1)
+            {
+                __c_make_read_output(process->output + j);
+            }
+        }
+    }
+
+    c_make_end_temporary_memory(temp_memory);
+
+    return result;
+}
+
+#endif
+
+// Prints the captured output of a process in one piece and releases it.
+static void
+__c_make_flush_output(CMakeProcess *process)
+{
+#if C_MAKE_PLATFORM_ANDROID || C_MAKE_PLATFORM_FREEBSD || C_MAKE_PLATFORM_LINUX || C_MAKE_PLATFORM_MACOS
+    for (int i = 0; i < 2; i += 1)
+    {
+        CMakeOutputBuffer *buffer = process->output + i;
+
+        // Grandchildren might still hold the pipe open, so only read what is there.
+        if (buffer->fd >= 0)
+        {
+            __c_make_read_output(buffer);
+
+            if (buffer->fd >= 0)
+            {
+                close(buffer->fd);
+                buffer->fd = -1;
+            }
+        }
+
+        if (buffer->count)
+        {
+            FILE *file = (i == 0) ? stdout : stderr;
+
+            fflush(stdout);
+            fwrite(buffer->data, 1, buffer->count, file);
+            fflush(file);
+        }
+
+        if (buffer->data)
+        {
+            c_make_free(buffer->data);
+        }
+
+        buffer->count = 0;
+        buffer->allocated = 0;
+        buffer->data = 0;
+    }
+#else
+    (void) process;
+#endif
+}
+
+static size_t
+__c_make_get_running_process_count(void)
+{
+    size_t result = 0;
+
+    for (size_t i = 0; i < _c_make_context.process_group.count; i += 1)
+    {
+        if (!_c_make_context.process_group.items[i].exited)
+        {
+            result += 1;
+        }
+    }
+
+    return result;
+}
+
+static bool
+__c_make_has_running_process_without_token(void)
+{
+    for (size_t i = 0; i < _c_make_context.process_group.count; i += 1)
+    {
+        if (!_c_make_context.process_group.items[i].exited && !_c_make_context.process_group.items[i].has_token)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static uint64_t
+__c_make_get_running_memory_weight(void)
+{
+    uint64_t result = 0;
+
+    for (size_t i = 0; i < _c_make_context.process_group.count; i += 1)
+    {
+        if (!_c_make_context.process_group.items[i].exited)
+        {
+            result += _c_make_context.process_group.items[i].memory_weight;
+        }
+    }
+
+    return result;
+}
+
+// The budget is 'memory_budget' megabytes if set. Otherwise it is the memory that was
+// available when the first command was run. It is only read once, because the memory
+// taken by running commands is already accounted for by their weights.
+static uint64_t
+__c_make_get_memory_budget(void)
+{
+    if (_c_make_context.memory_budget_is_set)
+    {
+        return _c_make_context.memory_budget;
+    }
+
+    _c_make_context.memory_budget_is_set = true;
+    _c_make_context.memory_budget = 0;
+
+    CMakeConfigValue memory_budget = c_make_config_get("memory_budget");
+
+    if (memory_budget.is_valid)
+    {
+        CMakeString value = c_make_string_trim(CMakeCString(memory_budget.val));
+        uint64_t megabytes;
+
+        if (__c_make_parse_u64(&value, 10, &megabytes) && !value.count)
+        {
+            _c_make_context.memory_budget = 1024 * megabytes;
+        }
+        else
+        {
+            c_make_log(CMakeLogLevelWarning, "invalid memory_budget '%s', expected a size in megabytes\n", memory_budget.val);
+        }
+
+        return _c_make_context.memory_budget;
+    }
+
+#if C_MAKE_PLATFORM_WINDOWS
+    MEMORYSTATUSEX status;
+    status.dwLength = sizeof(status);
+
+    if (GlobalMemoryStatusEx(&status))
+    {
+        _c_make_context.memory_budget = status.ullAvailPhys / 1024;
+    }
+#elif C_MAKE_PLATFORM_ANDROID || C_MAKE_PLATFORM_LINUX
+    int fd = open("/proc/meminfo", O_RDONLY | O_CLOEXEC);
+
+    if (fd >= 0)
+    {
+        char buffer[4096];
+        ssize_t count = read(fd, buffer, sizeof(buffer));
+        close(fd);
+
+        CMakeString content = c_make_make_string(buffer, (count > 0) ? (size_t) count : 0);
+
+        while (content.count)
+        {
+            CMakeString line = c_make_string_split_left(&content, '\n');
+            CMakeString key = c_make_string_split_left(&line, ':');
+
+            if (c_make_strings_are_equal(key, CMakeStringLiteral("MemAvailable")))
+            {
+                line = c_make_string_trim(line);
+                uint64_t kilobytes;
+
+                if (__c_make_parse_u64(&line, 10, &kilobytes))
+                {
+                    _c_make_context.memory_budget = kilobytes;
+                }
+
+                break;
+            }
+        }
+    }
+#endif
+
+    return _c_make_context.memory_budget;
+}
+
+static uint64_t
+__c_make_hash_command(CMakeCommand command)
+{
+    uint64_t hash = 0;
+
+    for (size_t i = 0; i < command.count; i += 1)
+    {
+        // Include the terminating zero, so that 'a b' and 'ab' hash differently.
+        hash = c_make_hash_data(hash, command.items[i], c_make_get_c_string_length(command.items[i]) + 1);
+    }
+
+    return hash;
+}
+
+static CMakeCommandHistory *
+__c_make_history_get_command(CMakeHistory *history, CMakeString command_hash, bool create)
+{
+    size_t index = __c_make_map_find(&history->map, command_hash);
+
+    if (index < history->count)
+    {
+        return history->items + index;
+    }
+
+    if (!create)
+    {
+        return 0;
+    }
+
+    if (history->count == history->allocated)
+    {
+        size_t old_count = history->allocated;
+        history->allocated = history->allocated ? (2 * history->allocated) : 64;
+        history->items =
+            (CMakeCommandHistory *) c_make_memory_reallocate(&_c_make_context.permanent_memory, history->items,
+                                                             old_count * sizeof(*history->items),
+                                                             history->allocated * sizeof(*history->items));
+    }
+
+    CMakeCommandHistory *command = history->items + history->count;
+
+    command->command_hash = c_make_copy_string(&_c_make_context.permanent_memory, command_hash);
+    command->max_resident_size = 0;
+    command->wall_time = 0;
+
+    __c_make_map_insert(&_c_make_context.permanent_memory, &history->map, command->command_hash, history->count);
+    history->count += 1;
+
+    return command;
+}
+
+static const char *
+__c_make_get_history_file_name(CMakeMemory *memory)
+{
+    return c_make_c_string_path_concat_with_memory(memory, _c_make_context.build_path, "c_make_history.txt");
+}
+
+// The history records what was measured for commands in earlier builds. It is a text
+// file with one entry per line:
+//
+//   m <command hash> <max resident size in kilobytes>
+//   t <command hash> <wall time in microseconds>
+static CMakeHistory *
+__c_make_get_history(void)
+{
+    CMakeHistory *history = &_c_make_context.history;
+
+    if (!history->is_loaded && _c_make_context.build_path)
+    {
+        history->is_loaded = true;
+
+        size_t public_used = c_make_memory_get_used(&_c_make_context.public_memory);
+
+        CMakeString content;
+
+        if (c_make_read_entire_file(__c_make_get_history_file_name(&_c_make_context.public_memory), &content))
+        {
+            while (content.count)
+            {
+                CMakeString line = c_make_string_split_left(&content, '\n');
+                CMakeString kind = c_make_string_split_left(&line, ' ');
+                CMakeString command_hash = c_make_string_split_left(&line, ' ');
+
+                if (c_make_strings_are_equal(kind, CMakeStringLiteral("m")))
+                {
+                    uint64_t max_resident_size;
+
+                    if ((command_hash.count == 16) && __c_make_parse_u64(&line, 10, &max_resident_size) && !line.count)
+                    {
+                        __c_make_history_get_command(history, command_hash, true)->max_resident_size = max_resident_size;
+                    }
+                }
+                else if (c_make_strings_are_equal(kind, CMakeStringLiteral("t")))
+                {
+                    uint64_t wall_time;
+
+                    if ((command_hash.count == 16) && __c_make_parse_u64(&line, 10, &wall_time) && !line.count)
+                    {
+                        __c_make_history_get_command(history, command_hash, true)->wall_time = wall_time;
+                    }
+                }
+            }
+        }
+
+        c_make_memory_set_used(&_c_make_context.public_memory, public_used);
+    }
+
+    return history;
+}
+
+static CMakeCommandHistory *
+__c_make_get_command_history(uint64_t command_hash, bool create)
+{
+    char buffer[17];
+    sprintf(buffer, "%016llx", (unsigned long long) command_hash);
+
+    return __c_make_history_get_command(__c_make_get_history(), c_make_make_string(buffer, 16), create);
+}
+
+#if C_MAKE_PLATFORM_ANDROID || C_MAKE_PLATFORM_FREEBSD || C_MAKE_PLATFORM_LINUX || C_MAKE_PLATFORM_MACOS
+
+// Opens the jobserver that is announced in MAKEFLAGS. Both the fifo variant
+// '--jobserver-auth=fifo:<path>' and the pipe variant '--jobserver-auth=<read fd>,<write fd>'
+// ('--jobserver-fds' before make 4.2) are supported. The pipe is only usable if the parent
+// passed its file descriptors on, otherwise the jobserver is ignored.
+static bool
+__c_make_jobserver_open(CMakeJobserver *jobserver)
+{
+    CMakeTemporaryMemory temp_memory = c_make_begin_temporary_memory(0, 0);
+
+    CMakeString makeflags = c_make_get_environment_variable(temp_memory.memory, "MAKEFLAGS");
+    CMakeString auth = { 0, 0 };
+
+    while (makeflags.count)
+    {
+        CMakeString flag = c_make_string_split_left(&makeflags, ' ');
+
+        if (c_make_string_starts_with(flag, CMakeStringLiteral("--jobserver-auth=")))
+        {
+            auth = c_make_make_string(flag.data + 17, flag.count - 17);
+        }
+        else if (c_make_string_starts_with(flag, CMakeStringLiteral("--jobserver-fds=")))
+        {
+            auth = c_make_make_string(flag.data + 16, flag.count - 16);
+        }
+    }
+
+    bool result = false;
+
+    if (c_make_string_starts_with(auth, CMakeStringLiteral("fifo:")))
+    {
+        const char *fifo_path = c_make_string_to_c_string_with_memory(temp_memory.memory, c_make_make_string(auth.data + 5, auth.count - 5));
+
+        // Opened for reading and writing, so that the open doesn't block and the fifo
+        // keeps its tokens even if no other process has it open.
+        int fd = open(fifo_path, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+
+        if (fd >= 0)
+        {
+            jobserver->read_fd = fd;
+            jobserver->write_fd = fd;
+            result = true;
+        }
+    }
+    else if (auth.count)
+    {
+        uint64_t read_fd, write_fd;
+
+        if (__c_make_parse_u64(&auth, 10, &read_fd) && (c_make_string_split_left(&auth, ',').count == 0) &&
+            __c_make_parse_u64(&auth, 10, &write_fd) && !auth.count &&
+            (fcntl((int) read_fd, F_GETFD) >= 0) && (fcntl((int) write_fd, F_GETFD) >= 0))
+        {
+            jobserver->read_fd = (int) read_fd;
+            jobserver->write_fd = (int) write_fd;
+
+#  if C_MAKE_PLATFORM_ANDROID || C_MAKE_PLATFORM_LINUX
+            // The read end is shared with other processes, so it must not be made non-blocking.
+            // Reopening it through /proc gives a file description of its own.
+            char fd_path[32];
+            sprintf(fd_path, "/proc/self/fd/%d", (int) read_fd);
+
+            int fd = open(fd_path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+
+            if (fd >= 0)
+            {
+                jobserver->read_fd = fd;
+            }
+#  endif
+
+            result = true;
+        }
+    }
+
+    c_make_end_temporary_memory(temp_memory);
+
+    return result;
+}
+
+// The tokens of a fifo are lost with the last open file descriptor, so a process that
+// is started with exec must not find the jobserver in MAKEFLAGS.
+static void
+__c_make_jobserver_remove_fifo(void)
+{
+    int setenv(const char *, const char *, int);
+    int unsetenv(const char *);
+
+    if (_c_make_context.jobserver.fifo_path)
+    {
+        unlink(_c_make_context.jobserver.fifo_path);
+
+        if (_c_make_context.jobserver.saved_makeflags)
+        {
+            setenv("MAKEFLAGS", _c_make_context.jobserver.saved_makeflags, 1);
+        }
+        else
+        {
+            unsetenv("MAKEFLAGS");
+        }
+
+        _c_make_context.jobserver.fifo_path = 0;
+    }
+}
+
+// Adds the jobserver to the flags the user already has in MAKEFLAGS, like '-k' or 's'.
+// Earlier job flags are dropped. The first word keeps its place, because make reads it as
+// single letter flags, and variable definitions after '--' stay at the end.
+static const char *
+__c_make_jobserver_get_makeflags(CMakeMemory *memory, const char *jobserver_flags)
+{
+    CMakeString makeflags = c_make_get_environment_variable(memory, "MAKEFLAGS");
+
+    const char *flags = "";
+    const char *variables = "";
+
+    while (makeflags.count)
+    {
+        CMakeString flag = c_make_string_split_left(&makeflags, ' ');
+
+        if (!flag.count)
+        {
+            continue;
+        }
+
+        if (c_make_strings_are_equal(flag, CMakeStringLiteral("--")))
+        {
+            variables = c_make_c_string_concat_with_memory(memory, " -- ", c_make_string_to_c_string_with_memory(memory, makeflags));
+            break;
+        }
+
+        if (!c_make_string_starts_with(flag, CMakeStringLiteral("-j")) &&
+            !c_make_string_starts_with(flag, CMakeStringLiteral("--jobs")) &&
+            !c_make_string_starts_with(flag, CMakeStringLiteral("--jobserver-auth=")) &&
+            !c_make_string_starts_with(flag, CMakeStringLiteral("--jobserver-fds=")))
+        {
+            flags = c_make_c_string_concat_with_memory(memory, flags, c_make_string_to_c_string_with_memory(memory, flag), " ");
+        }
+    }
+
+    return c_make_c_string_concat_with_memory(memory, flags, jobserver_flags, variables);
+}
+
+// Creates a jobserver with 'token_count' tokens and announces it in MAKEFLAGS, which all
+// commands inherit. The option 'jobserver' selects a 'fifo' (default) or a 'pipe'.
+static bool
+__c_make_jobserver_create(CMakeJobserver *jobserver, size_t token_count)
+{
+    int setenv(const char *, const char *, int);
+
+    CMakeConfigValue style = c_make_config_get("jobserver");
+
+    bool use_pipe = style.is_valid && !c_make_strcmp(style.val, "pipe");
+
+    if (style.is_valid && !use_pipe && c_make_strcmp(style.val, "fifo"))
+    {
+        if (c_make_strcmp(style.val, "off"))
+        {
+            c_make_log(CMakeLogLevelWarning, "invalid jobserver '%s', expected 'fifo', 'pipe' or 'off'\n", style.val);
+        }
+
+        return false;
+    }
+
+    CMakeTemporaryMemory temp_memory = c_make_begin_temporary_memory(0, 0);
+
+    const char *saved_makeflags = getenv("MAKEFLAGS");
+
+    if (saved_makeflags)
+    {
+        jobserver->saved_makeflags = c_make_copy_string(&_c_make_context.permanent_memory, CMakeCString(saved_makeflags)).data;
+    }
+
+    const char *auth = 0;
+    char buffer[64];
+
+    if (use_pipe)
+    {
+        // Not close-on-exec, commands have to inherit the pipe.
+        int fds[2];
+
+        if (pipe(fds) == 0)
+        {
+            sprintf(buffer, "--jobserver-auth=%d,%d", fds[0], fds[1]);
+            auth = buffer;
+        }
+    }
+    else
+    {
+        CMakeString temp_path = c_make_get_environment_variable(temp_memory.memory, "TMPDIR");
+
+        if (!temp_path.count)
+        {
+            temp_path = CMakeStringLiteral("/tmp");
+        }
+
+        sprintf(buffer, "c_make_jobserver_%d", (int) getpid());
+
+        const char *fifo_path = c_make_c_string_path_concat_with_memory(&_c_make_context.permanent_memory,
+                                                                        c_make_string_to_c_string_with_memory(temp_memory.memory, temp_path),
+                                                                        buffer);
+
+        unlink(fifo_path);
+
+        if (mkfifo(fifo_path, 0600) == 0)
+        {
+            jobserver->fifo_path = fifo_path;
+            atexit(__c_make_jobserver_remove_fifo);
+
+            auth = c_make_c_string_concat_with_memory(temp_memory.memory, "--jobserver-auth=fifo:", fifo_path);
+        }
+    }
+
+    bool result = false;
+
+    if (auth)
+    {
+        char max_jobs[32];
+        sprintf(max_jobs, "-j%d", (int) (token_count + 1));
+
+        const char *makeflags = __c_make_jobserver_get_makeflags(temp_memory.memory,
+                                                                 c_make_c_string_concat_with_memory(temp_memory.memory, max_jobs, " ", auth));
+
+        if ((setenv("MAKEFLAGS", makeflags, 1) == 0) && __c_make_jobserver_open(jobserver))
+        {
+            result = true;
+
+            for (size_t i = 0; i < token_count; i += 1)
+            {
+                if (write(jobserver->write_fd, "+", 1) != 1)
+                {
+                    result = false;
+                    break;
+                }
+            }
+        }
+    }
+
+    if (!result)
+    {
+        c_make_log(CMakeLogLevelWarning, "could not create a jobserver (errno = %d: %s)\n", errno, strerror(errno));
+        __c_make_jobserver_remove_fifo();
+    }
+
+    c_make_end_temporary_memory(temp_memory);
+
+    return result;
+}
+
+#endif
+
+// The jobserver of a parent process is used if there is one. Otherwise c_make creates one
+// for its commands, so that nested builds share the 'max_jobs' of the outermost build.
+static CMakeJobserver *
+__c_make_get_jobserver(void)
+{
+    CMakeJobserver *jobserver = &_c_make_context.jobserver;
+
+    if (!jobserver->is_initialized)
+    {
+        jobserver->is_initialized = true;
+        jobserver->read_fd = -1;
+        jobserver->write_fd = -1;
+
+#if C_MAKE_PLATFORM_ANDROID || C_MAKE_PLATFORM_FREEBSD || C_MAKE_PLATFORM_LINUX || C_MAKE_PLATFORM_MACOS
+        int max_jobs = c_make_get_max_jobs();
+
+        jobserver->is_active = __c_make_jobserver_open(jobserver) ||
+                               ((max_jobs > 1) && __c_make_jobserver_create(jobserver, (size_t) (max_jobs - 1)));
+#endif
+    }
+
+    return jobserver;
+}
+
+// Takes a token without blocking.
+static bool
+__c_make_jobserver_acquire(CMakeJobserver *jobserver, char *token)
+{
+#if C_MAKE_PLATFORM_ANDROID || C_MAKE_PLATFORM_FREEBSD || C_MAKE_PLATFORM_LINUX || C_MAKE_PLATFORM_MACOS
+    // An inherited pipe can't be reopened on all platforms. Polling first keeps the read from
+    // blocking, unless another process takes the token in between.
+    struct pollfd fd;
+    fd.fd = jobserver->read_fd;
+    fd.events = POLLIN;
+    fd.revents = 0;
+
+    return (poll(&fd, 1, 0) > 0) && (read(jobserver->read_fd, token, 1) == 1);
+#else
+    (void) jobserver;
+    (void) token;
+    return false;
+#endif
+}
+
+static void
+__c_make_jobserver_release(CMakeJobserver *jobserver, char token)
+{
+#if C_MAKE_PLATFORM_ANDROID || C_MAKE_PLATFORM_FREEBSD || C_MAKE_PLATFORM_LINUX || C_MAKE_PLATFORM_MACOS
+    while ((write(jobserver->write_fd, &token, 1) < 0) && (errno == EINTR));
+#else
+    (void) jobserver;
+    (void) token;
+#endif
+}
+
+static void
+__c_make_cancel_all_processes(void)
+{
+#if C_MAKE_PLATFORM_ANDROID || C_MAKE_PLATFORM_FREEBSD || C_MAKE_PLATFORM_LINUX || C_MAKE_PLATFORM_MACOS
+    int kill(pid_t, int);
+#endif
+
+    _c_make_context.cancelled = true;
+
+    for (size_t i = 0; i < _c_make_context.process_group.count; i += 1)
+    {
+        CMakeProcess *process = _c_make_context.process_group.items + i;
+
+        if (!process->exited)
+        {
+            process->cancelled = true;
+
+#if C_MAKE_PLATFORM_WINDOWS
+            TerminateProcess(process->id, 1);
+#else
+            kill(process->id, SIGTERM);
+#endif
+        }
+    }
+}
+
+static void __c_make_read_dependency_file(const char *dependency_file);
+
+static void
+__c_make_process_exited(CMakeProcess *process, bool succeeded, const char *reason, int code)
+{
+    process->exited = true;
+    process->succeeded = succeeded;
+
+    if (process->has_token)
+    {
+        __c_make_jobserver_release(&_c_make_context.jobserver, process->token);
+        process->has_token = false;
+    }
+
+    __c_make_invalidate_file_status_cache();
+
+    uint64_t end_time = __c_make_get_time_in_microseconds();
+    process->wall_time = end_time - process->start_time;
+
+    if (_c_make_context.trace_enabled)
+    {
+        CMakeTrace *trace = &_c_make_context.trace;
+
+        if (trace->count == trace->allocated)
+        {
+            size_t old_count = trace->allocated;
+            trace->allocated = trace->allocated ? (2 * trace->allocated) : 64;
+            trace->items = (CMakeTraceEvent *) c_make_memory_reallocate(&_c_make_context.permanent_memory, trace->items,
+                                                                        old_count * sizeof(*trace->items),
+                                                                        trace->allocated * sizeof(*trace->items));
+        }
+
+        CMakeTraceEvent *event = trace->items + trace->count;
+        trace->count += 1;
+
+        event->name = c_make_copy_string(&trace->memory, CMakeCString(process->trace_name)).data;
+        event->command = c_make_copy_string(&trace->memory, CMakeCString(process->command)).data;
+        event->status = reason;
+        event->code = code;
+        event->slot = process->trace_slot;
+        event->start_time = process->start_time - trace->start_time;
+        event->end_time = end_time - trace->start_time;
+        event->user_time = process->user_time;
+        event->system_time = process->system_time;
+        event->max_resident_size = process->max_resident_size;
+    }
+
+    if (succeeded && process->dependency_file)
+    {
+        __c_make_read_dependency_file(process->dependency_file);
+    }
+
+    // Only the largest measurement of the memory is kept. A command that was answered from
+    // the cache uses much less memory than the command itself. The wall time is averaged,
+    // so that a single cache hit doesn't make a command look short.
+    if (succeeded)
+    {
+        CMakeCommandHistory *command = __c_make_get_command_history(process->command_hash, true);
+
+        if (process->max_resident_size > command->max_resident_size)
+        {
+            command->max_resident_size = process->max_resident_size;
+        }
+
+        command->wall_time = command->wall_time ? ((command->wall_time + process->wall_time) / 2) : process->wall_time;
+
+        _c_make_context.history.is_dirty = true;
+    }
+
+    if (!succeeded)
+    {
+        _c_make_context.did_fail = true;
+
+        if (!process->cancelled)
+        {
+            c_make_log(CMakeLogLevelError, "command %s %d: %s\n", reason, code, process->command ? process->command : "(nil)");
+
+            if (_c_make_context.fail_fast || c_make_config_is_enabled("fail_fast", false))
+            {
+                __c_make_cancel_all_processes();
+            }
+        }
+    }
+}
+
+// Kills all running processes whose timeout has passed. Returns the milliseconds until the
+// next timeout of a running process, or -1 if none has one. Waiting for processes must wake
+// up by then to check it.
+static int
+__c_make_kill_timed_out_processes(void)
+{
+#if C_MAKE_PLATFORM_ANDROID || C_MAKE_PLATFORM_FREEBSD || C_MAKE_PLATFORM_LINUX || C_MAKE_PLATFORM_MACOS
+    int kill(pid_t, int);
+#endif
+
+    int result = -1;
+    uint64_t now = 0;
+
+    for (size_t i = 0; i < _c_make_context.process_group.count; i += 1)
+    {
+        CMakeProcess *process = _c_make_context.process_group.items + i;
+
+        if (process->exited || !process->timeout_time || process->timed_out)
+        {
+            continue;
+        }
+
+        if (!now)
+        {
+            now = __c_make_get_time_in_microseconds();
+        }
+
+        if (now < process->timeout_time)
+        {
+            // Rounded up, so that the timeout has passed when the wait returns.
+            uint64_t remaining = (process->timeout_time - now + 999) / 1000;
+            int milliseconds = (remaining < 0x7fffffff) ? (int) remaining : 0x7fffffff;
+
+            if ((result < 0) || (milliseconds < result))
+            {
+                result = milliseconds;
+            }
+        }
+        else
+        {
+            process->timed_out = true;
+
+#if C_MAKE_PLATFORM_WINDOWS
+            TerminateProcess(process->id, 1);
+#else
+            if (kill(-process->id, SIGKILL))
+            {
+                kill(process->id, SIGKILL);
+            }
+#endif
+        }
+    }
+
+    return result;
+}
+
+#if C_MAKE_PLATFORM_ANDROID || C_MAKE_PLATFORM_FREEBSD || C_MAKE_PLATFORM_LINUX || C_MAKE_PLATFORM_MACOS
+
+// Marks the process 'pid' as exited after wait4 returned it. Returns false if the pid is
+// not one of the running processes or if the process didn't terminate.
+static bool
+__c_make_process_reaped(pid_t pid, int status, struct rusage *usage)
+{
+    CMakeProcess *process = 0;
+
+    for (size_t i = 0; i < _c_make_context.process_group.count; i += 1)
+    {
+        if (_c_make_context.process_group.items[i].id == pid)
+        {
+            process = _c_make_context.process_group.items + i;
+            break;
+        }
+    }
+
+    if (!process || process->exited)
+    {
+        return false;
+    }
+
+    __c_make_flush_output(process);
+
+    process->user_time = ((uint64_t) usage->ru_utime.tv_sec * 1000000) + (uint64_t) usage->ru_utime.tv_usec;
+    process->system_time = ((uint64_t) usage->ru_stime.tv_sec * 1000000) + (uint64_t) usage->ru_stime.tv_usec;
+#  if C_MAKE_PLATFORM_MACOS
+    process->max_resident_size = (uint64_t) usage->ru_maxrss / 1024;
+#  else
+    process->max_resident_size = (uint64_t) usage->ru_maxrss;
+#  endif
+
+    if (WIFEXITED(status))
+    {
+        int exit_code = WEXITSTATUS(status);
+        __c_make_process_exited(process, exit_code == 0, "exited with code", exit_code);
+        return true;
+    }
+
+    if (WIFSIGNALED(status))
+    {
+        __c_make_process_exited(process, false, process->timed_out ? "timed out and was killed by signal" : "was terminated by signal",
+                                WTERMSIG(status));
+        return true;
+    }
+
+    return false;
+}
+
+#endif
+
+// Blocks until any of the running processes has exited. The process is marked as exited,
+// but stays in the process group until someone waits on it.
+static void
+__c_make_process_wait_any(void)
+{
+    if (!__c_make_get_running_process_count())
+    {
+        return;
+    }
+
+#if C_MAKE_PLATFORM_WINDOWS
+    size_t indices[MAXIMUM_WAIT_OBJECTS];
+    HANDLE handles[MAXIMUM_WAIT_OBJECTS];
+    DWORD handle_count = 0;
+
+    for (size_t i = 0; (i < _c_make_context.process_group.count) && (handle_count < MAXIMUM_WAIT_OBJECTS); i += 1)
+    {
+        if (!_c_make_context.process_group.items[i].exited)
+        {
+            indices[handle_count] = i;
+            handles[handle_count] = _c_make_context.process_group.items[i].id;
+            handle_count += 1;
+        }
+    }
+
+    // With a timeout the wait returns when it is due, every caller waits again if nothing exited.
+    int timeout = __c_make_kill_timed_out_processes();
+    DWORD wait_result = WaitForMultipleObjects(handle_count, handles, FALSE, (timeout < 0) ? INFINITE : (DWORD) timeout);
+
+    if (wait_result == WAIT_TIMEOUT)
+    {
+        return;
+    }
+
+    if (wait_result < (WAIT_OBJECT_0 + handle_count))
+    {
+        CMakeProcess *process = _c_make_context.process_group.items + indices[wait_result - WAIT_OBJECT_0];
+        DWORD exit_code = 0;
+
+        FILETIME creation_time, exit_time, kernel_time, user_time;
+
+        if (GetProcessTimes(process->id, &creation_time, &exit_time, &kernel_time, &user_time))
+        {
+            // FILETIME counts in units of 100 nanoseconds.
+            process->user_time = ((((uint64_t) user_time.dwHighDateTime) << 32) | user_time.dwLowDateTime) / 10;
+            process->system_time = ((((uint64_t) kernel_time.dwHighDateTime) << 32) | kernel_time.dwLowDateTime) / 10;
+        }
+
+        if (!GetExitCodeProcess(process->id, &exit_code))
+        {
+            __c_make_process_exited(process, false, "failed with error code", (int) GetLastError());
+        }
+        else if (process->timed_out)
+        {
+            __c_make_process_exited(process, false, "timed out and was terminated with code", (int) exit_code);
+        }
+        else
+        {
+            __c_make_process_exited(process, exit_code == 0, "exited with code", (int) exit_code);
+        }
+
+        CloseHandle(process->id);
+    }
+    else
+    {
+        DWORD error = GetLastError();
+
+        for (DWORD i = 0; i < handle_count; i += 1)
+        {
+            __c_make_process_exited(_c_make_context.process_group.items + indices[i], false, "could not be waited on, error code", (int) error);
+        }
+    }
+#else
+    pid_t wait4(pid_t, int *, int, struct rusage *);
+
+    __c_make_install_child_signal_handler();
+
+    for (;;)
+    {
+        int status;
+        struct rusage usage;
+        pid_t pid = wait4(-1, &status, WNOHANG, &usage);
+
+        // While commands are running their output is read. Poll also wakes up through
+        // SIGCHLD when a process exits and when the next timeout is due.
+        if (pid == 0)
+        {
+            __c_make_poll_output(__c_make_kill_timed_out_processes(), -1);
+            continue;
+        }
+
+        if (pid < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            for (size_t i = 0; i < _c_make_context.process_group.count; i += 1)
+            {
+                CMakeProcess *process = _c_make_context.process_group.items + i;
+
+                if (!process->exited)
+                {
+                    __c_make_flush_output(process);
+                    __c_make_process_exited(process, false, "could not be waited on, errno", errno);
+                }
+            }
+
+            break;
+        }
+
+        if (__c_make_process_reaped(pid, status, &usage))
+        {
+            break;
+        }
+    }
+#endif
+}
+
+// Waits until a running process has exited or the jobserver might have a token again.
+static void
+__c_make_jobserver_wait(CMakeJobserver *jobserver)
+{
+#if C_MAKE_PLATFORM_ANDROID || C_MAKE_PLATFORM_FREEBSD || C_MAKE_PLATFORM_LINUX || C_MAKE_PLATFORM_MACOS
+    pid_t wait4(pid_t, int *, int, struct rusage *);
+
+    __c_make_install_child_signal_handler();
+
+    for (;;)
+    {
+        int status;
+        struct rusage usage;
+        pid_t pid = wait4(-1, &status, WNOHANG, &usage);
+
+        if (pid > 0)
+        {
+            if (__c_make_process_reaped(pid, status, &usage))
+            {
+                return;
+            }
+
+            continue;
+        }
+
+        if (pid < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            // Let the regular wait report the error.
+            __c_make_process_wait_any();
+            return;
+        }
+
+        if (__c_make_poll_output(__c_make_kill_timed_out_processes(), jobserver->read_fd))
+        {
+            return;
+        }
+    }
+#else
+    (void) jobserver;
+    __c_make_process_wait_any();
+#endif
+}
+
+static size_t
+__c_make_process_wait(CMakeProcessId process_id)
+{
+    if (process_id == CMakeInvalidProcessId)
+    {
+        _c_make_context.did_fail = true;
+        return -1;
+    }
+
+    size_t index = _c_make_context.process_group.count;
+
+    for (size_t i = 0; i < _c_make_context.process_group.count; i += 1)
+    {
+        if (_c_make_context.process_group.items[i].id == process_id)
+        {
+            index = i;
+            break;
+        }
+    }
+
+    if (index < _c_make_context.process_group.count)
+    {
+        // Wait on all processes, so failures of other commands are reported right away.
+        while (!_c_make_context.process_group.items[index].exited)
+        {
+            __c_make_process_wait_any();
+        }
+    }
+
+    return index;
+}
+
+static void
+__c_make_process_remove(size_t index)
+{
+    _c_make_context.process_group.count -= 1;
+    _c_make_context.process_group.items[index] = _c_make_context.process_group.items[_c_make_context.process_group.count];
+
+    if (!_c_make_context.process_group.count)
+    {
+        c_make_memory_set_used(&_c_make_context.process_memory, 0);
+    }
+}
+
+#if C_MAKE_PLATFORM_ANDROID || C_MAKE_PLATFORM_FREEBSD || C_MAKE_PLATFORM_LINUX || C_MAKE_PLATFORM_MACOS
+
+// Options of gcc and clang that take their value as the next argument.
+static const char *__c_make_compiler_options_with_value[] = {
+    "-o", "-MF", "-MT", "-MQ", "-I", "-D", "-U", "-include", "-imacros", "-isystem", "-iquote",
+    "-idirafter", "-isysroot", "--sysroot", "-L", "-l", "-framework", "-arch", "-target",
+    "-Xlinker", "-Xclang", "-Xpreprocessor", "-u", "-T", "-e",
+};
+
+// Options that make the result of a compile depend on something else than its inputs
+// and the command line, or that don't produce a single output file.
+static const char *__c_make_uncacheable_compiler_options[] = {
+    "-", "-E", "-M", "-MM", "-x", "--coverage", "-ftest-coverage", "-fprofile-arcs",
+};
+
+static bool
+__c_make_is_source_file(const char *file_name)
+{
+    CMakeString name = CMakeCString(file_name);
+    CMakeString extension = c_make_string_split_right(&name, '.');
+
+    return (name.count > 0) &&
+           (c_make_strings_are_equal(extension, CMakeStringLiteral("c")) ||
+            c_make_strings_are_equal(extension, CMakeStringLiteral("cc")) ||
+            c_make_strings_are_equal(extension, CMakeStringLiteral("cpp")) ||
+            c_make_strings_are_equal(extension, CMakeStringLiteral("cxx")) ||
+            c_make_strings_are_equal(extension, CMakeStringLiteral("m")) ||
+            c_make_strings_are_equal(extension, CMakeStringLiteral("mm")));
+}
+
+static bool
+__c_make_compiler_option_has_value(const char *argument)
+{
+    for (size_t i = 0; i < CMakeArrayCount(__c_make_compiler_options_with_value); i += 1)
+    {
+        if (!c_make_strcmp(argument, __c_make_compiler_options_with_value[i]))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Only compile and link commands get colored diagnostics. These are commands that run one
+// of the configured compilers, or that compile with '-c' or a source file. Other tools
+// like 'gcc-ar' don't accept the option.
+static bool
+__c_make_command_supports_diagnostics_color(CMakeCommand command)
+{
+    const char *compilers[] = {
+        c_make_get_host_c_compiler(), c_make_get_target_c_compiler(),
+        c_make_get_host_cpp_compiler(), c_make_get_target_cpp_compiler(),
+    };
+
+    for (size_t i = 0; i < CMakeArrayCount(compilers); i += 1)
+    {
+        if (compilers[i] && !c_make_strcmp(command.items[0], compilers[i]))
+        {
+            return true;
+        }
+    }
+
+    for (size_t i = 1; i < command.count; i += 1)
+    {
+        const char *argument = command.items[i];
+
+        if (__c_make_compiler_option_has_value(argument))
+        {
+            i += 1;
+        }
+        else if (!c_make_strcmp(argument, "-c") || ((argument[0] != '-') && __c_make_is_source_file(argument)))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static const char *
+__c_make_get_cache_directory(void)
+{
+    CMakeConfigValue cache_directory = c_make_config_get("cache_directory");
+
+    if (cache_directory.is_valid && cache_directory.val[0])
+    {
+        return cache_directory.val;
+    }
+
+    return 0;
+}
+
+// A command can be served from the cache if it is a gcc or clang compile ('-c') with a single
+// output. Link commands are never cached, their libraries and linker scripts are found through
+// search paths and the cache key would only contain their names.
+static bool
+__c_make_command_is_cacheable(CMakeCommand command)
+{
+    if (!__c_make_get_cache_directory() || c_make_compiler_is_msvc(command.items[0]))
+    {
+        return false;
+    }
+
+    const char *output_file = 0;
+    size_t source_count = 0;
+    bool has_dependency_file = false;
+    bool is_compile = false;
+
+    for (size_t i = 1; i < command.count; i += 1)
+    {
+        const char *argument = command.items[i];
+
+        if (!c_make_strcmp(argument, "-c"))
+        {
+            is_compile = true;
+        }
+
+        for (size_t j = 0; j < CMakeArrayCount(__c_make_uncacheable_compiler_options); j += 1)
+        {
+            if (!c_make_strcmp(argument, __c_make_uncacheable_compiler_options[j]))
+            {
+                return false;
+            }
+        }
+
+        if (c_make_string_starts_with(CMakeCString(argument), CMakeStringLiteral("-fprofile-")) ||
+            c_make_string_starts_with(CMakeCString(argument), CMakeStringLiteral("-save-temps")))
+        {
+            return false;
+        }
+
+        if (__c_make_compiler_option_has_value(argument) && ((i + 1) < command.count))
+        {
+            if (!c_make_strcmp(argument, "-o"))
+            {
+                output_file = command.items[i + 1];
+            }
+            else if (!c_make_strcmp(argument, "-MF"))
+            {
+                has_dependency_file = true;
+            }
+
+            i += 1;
+        }
+        else if ((argument[0] != '-') && __c_make_is_source_file(argument))
+        {
+            source_count += 1;
+        }
+    }
+
+    // With more than one source file there would be more than one dependency file.
+    return is_compile && output_file && (source_count > 0) && (!has_dependency_file || (source_count == 1));
+}
+
+static int
+__c_make_run_and_wait(char **command_line, int stdout_fd, int stderr_fd)
+{
+    pid_t pid = fork();
+
+    if (pid < 0)
+    {
+        return 1;
+    }
+
+    if (pid == 0)
+    {
+        if (stdout_fd >= 0)
+        {
+            dup2(stdout_fd, STDOUT_FILENO);
+        }
+
+        if (stderr_fd >= 0)
+        {
+            dup2(stderr_fd, STDERR_FILENO);
+        }
+
+        execvp(command_line[0], command_line);
+        fprintf(stderr, "Could not execvp: %s\n", strerror(errno));
+        _exit(1);
+    }
+
+    for (;;)
+    {
+        int status;
+
+        if (waitpid(pid, &status, 0) < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            return 1;
+        }
+
+        if (WIFEXITED(status))
+        {
+            return WEXITSTATUS(status);
+        }
+
+        if (WIFSIGNALED(status))
+        {
+            return 128 + WTERMSIG(status);
+        }
+    }
+}
+
+// Computes the cache key of a compile command. The key is made of the compiler identity
+// (path, size and modification time), the command line without the output paths, the
+// preprocessed source files and the content of all other input files.
+static bool
+__c_make_get_cache_key(CMakeMemory *memory, CMakeCommand command, uint64_t *key, const char **output_file)
+{
+    const char *compiler = command.items[0];
+
+    if (!c_make_has_slash_or_backslash(compiler))
+    {
+        compiler = c_make_find_program(compiler);
+
+        if (!compiler)
+        {
+            return false;
+        }
+    }
+
+    uint64_t compiler_size, compiler_modification_time;
+
+    if (!__c_make_get_file_info(compiler, &compiler_size, &compiler_modification_time))
+    {
+        return false;
+    }
+
+    uint64_t hash = c_make_hash_data(0, "c_make cache 1", sizeof("c_make cache 1") - 1);
+    hash = c_make_hash_data(hash, compiler, c_make_get_c_string_length(compiler));
+    hash = c_make_hash_data(hash, &compiler_size, sizeof(compiler_size));
+    hash = c_make_hash_data(hash, &compiler_modification_time, sizeof(compiler_modification_time));
+
+    // The preprocessor runs with the same options, but without output and linker options.
+    CMakeCommand preprocess_command = { 0, 0, 0 };
+    preprocess_command.items = (const char **) c_make_memory_allocate(memory, (command.count + 3) * sizeof(const char *));
+    preprocess_command.items[preprocess_command.count++] = command.items[0];
+    preprocess_command.items[preprocess_command.count++] = "-E";
+
+    size_t source_index = preprocess_command.count;
+    preprocess_command.count += 1;
+
+    size_t source_count = 0;
+    const char **sources = (const char **) c_make_memory_allocate(memory, command.count * sizeof(const char *));
+
+    for (size_t i = 1; i < command.count; i += 1)
+    {
+        const char *argument = command.items[i];
+
+        if (__c_make_compiler_option_has_value(argument) && ((i + 1) < command.count))
+        {
+            const char *value = command.items[i + 1];
+
+            if (!c_make_strcmp(argument, "-o"))
+            {
+                *output_file = value;
+            }
+            else if (!c_make_strcmp(argument, "-MF") || !c_make_strcmp(argument, "-MT") || !c_make_strcmp(argument, "-MQ"))
+            {
+                preprocess_command.items[preprocess_command.count++] = argument;
+                preprocess_command.items[preprocess_command.count++] = value;
+            }
+            else
+            {
+                hash = c_make_hash_data(hash, argument, c_make_get_c_string_length(argument) + 1);
+                hash = c_make_hash_data(hash, value, c_make_get_c_string_length(value) + 1);
+
+                if (c_make_strcmp(argument, "-L") && c_make_strcmp(argument, "-l") && c_make_strcmp(argument, "-framework") &&
+                    c_make_strcmp(argument, "-Xlinker") && c_make_strcmp(argument, "-u") && c_make_strcmp(argument, "-T") &&
+                    c_make_strcmp(argument, "-e"))
+                {
+                    preprocess_command.items[preprocess_command.count++] = argument;
+                    preprocess_command.items[preprocess_command.count++] = value;
+                }
+            }
+
+            i += 1;
+        }
+        else if (c_make_string_starts_with(CMakeCString(argument), CMakeStringLiteral("-fdiagnostics-color")))
+        {
+            // Colored diagnostics depend on the terminal, not on the output.
+            preprocess_command.items[preprocess_command.count++] = argument;
+        }
+        else if (argument[0] == '-')
+        {
+            hash = c_make_hash_data(hash, argument, c_make_get_c_string_length(argument) + 1);
+
+            if (c_make_strcmp(argument, "-c") && !c_make_string_starts_with(CMakeCString(argument), CMakeStringLiteral("-l")) &&
+                !c_make_string_starts_with(CMakeCString(argument), CMakeStringLiteral("-L")) &&
+                !c_make_string_starts_with(CMakeCString(argument), CMakeStringLiteral("-Wl,")))
+            {
+                preprocess_command.items[preprocess_command.count++] = argument;
+            }
+        }
+        else if (__c_make_is_source_file(argument))
+        {
+            sources[source_count++] = argument;
+        }
+        else
+        {
+            uint64_t input_hash = 0;
+
+            hash = c_make_hash_data(hash, argument, c_make_get_c_string_length(argument) + 1);
+
+            if (c_make_hash_file(argument, &input_hash))
+            {
+                hash = c_make_hash_data(hash, &input_hash, sizeof(input_hash));
+            }
+        }
+    }
+
+    preprocess_command.items[preprocess_command.count] = 0;
+
+    int null_fd = open("/dev/null", O_WRONLY);
+
+    for (size_t i = 0; i < source_count; i += 1)
+    {
+        int pipe_fds[2];
+
+        if (pipe(pipe_fds))
+        {
+            close(null_fd);
+            return false;
+        }
+
+        preprocess_command.items[source_index] = sources[i];
+
+        pid_t pid = fork();
+
+        if (pid < 0)
+        {
+            close(pipe_fds[0]);
+            close(pipe_fds[1]);
+            close(null_fd);
+            return false;
+        }
+
+        if (pid == 0)
+        {
+            close(pipe_fds[0]);
+            dup2(pipe_fds[1], STDOUT_FILENO);
+            dup2(null_fd, STDERR_FILENO);
+            execvp(preprocess_command.items[0], (char **) preprocess_command.items);
+            _exit(1);
+        }
+
+        close(pipe_fds[1]);
+
+        uint64_t source_hash = 0;
+        bool hashed = __c_make_hash_file_descriptor(pipe_fds[0], &source_hash);
+
+        close(pipe_fds[0]);
+
+        int status;
+
+        while ((waitpid(pid, &status, 0) < 0) && (errno == EINTR));
+
+        if (!hashed || !WIFEXITED(status) || (WEXITSTATUS(status) != 0))
+        {
+            close(null_fd);
+            return false;
+        }
+
+        hash = c_make_hash_data(hash, sources[i], c_make_get_c_string_length(sources[i]) + 1);
+        hash = c_make_hash_data(hash, &source_hash, sizeof(source_hash));
+    }
+
+    close(null_fd);
+
+    *key = hash;
+
+    return true;
+}
+
+static bool
+__c_make_copy_file_atomically(const char *src_file_name, const char *dst_file_name, bool hard_link)
+{
+    char *temp_file_name = c_make_c_string_concat(dst_file_name, ".c_make_tmp");
+
+    c_make_delete_file(temp_file_name);
+
+    if (hard_link)
+    {
+        if (!link(src_file_name, temp_file_name) && c_make_rename_file(temp_file_name, dst_file_name))
+        {
+            return true;
+        }
+
+        c_make_delete_file(temp_file_name);
+    }
+
+    if (c_make_copy_file(src_file_name, temp_file_name) && c_make_rename_file(temp_file_name, dst_file_name))
+    {
+        return true;
+    }
+
+    c_make_delete_file(temp_file_name);
+
+    return false;
+}
+
+// This runs in a child process of c_make. On a cache hit the cached output is linked or copied
+// to the output path, otherwise the compiler runs and its output gets stored in the cache.
+static int
+__c_make_run_cached_command(CMakeCommand command)
+{
+    char **command_line = (char **) c_make_memory_allocate(&_c_make_context.public_memory, (command.count + 1) * sizeof(char *));
+
+    for (size_t i = 0; i < command.count; i += 1)
+    {
+        command_line[i] = (char *) command.items[i];
+    }
+
+    command_line[command.count] = 0;
+
+    uint64_t key = 0;
+    const char *output_file = 0;
+
+    if (!__c_make_get_cache_key(&_c_make_context.public_memory, command, &key, &output_file))
+    {
+        return __c_make_run_and_wait(command_line, -1, -1);
+    }
+
+    char key_string[17];
+    snprintf(key_string, sizeof(key_string), "%016llx", (unsigned long long) key);
+
+    char key_directory[3] = { key_string[0], key_string[1], 0 };
+
+    const char *cache_directory = c_make_c_string_path_concat(__c_make_get_cache_directory(), key_directory);
+    const char *cache_file = c_make_c_string_path_concat(cache_directory, key_string);
+
+    bool hard_link = c_make_config_is_enabled("cache_hard_link", false);
+
+    if (c_make_file_exists(cache_file) && __c_make_copy_file_atomically(cache_file, output_file, hard_link))
+    {
+        // Update the modification time, which is used for the least recently used eviction.
+        utimes(cache_file, 0);
+        return 0;
+    }
+
+    int exit_code = __c_make_run_and_wait(command_line, -1, -1);
+
+    if ((exit_code == 0) && c_make_create_directory_recursively(cache_directory))
+    {
+        __c_make_copy_file_atomically(output_file, cache_file, false);
+    }
+
+    return exit_code;
+}
+
+#endif
+
+typedef struct CMakeCacheFile
+{
+    const char *path;
+    uint64_t size;
+    uint64_t modification_time;
+} CMakeCacheFile;
+
+#if !defined(C_MAKE_NO_ENTRY_POINT)
+
+static int
+__c_make_compare_cache_files(const void *a, const void *b)
+{
+    const CMakeCacheFile *file_a = (const CMakeCacheFile *) a;
+    const CMakeCacheFile *file_b = (const CMakeCacheFile *) b;
+
+    if (file_a->modification_time < file_b->modification_time) return -1;
+    if (file_a->modification_time > file_b->modification_time) return 1;
+
+    return 0;
+}
+
+// Deletes the least recently used files from the compile cache until it
+// is smaller than 90% of 'cache_max_size'.
+static void
+__c_make_evict_cache(void)
+{
+#if C_MAKE_PLATFORM_ANDROID || C_MAKE_PLATFORM_FREEBSD || C_MAKE_PLATFORM_LINUX || C_MAKE_PLATFORM_MACOS
+    const char *cache_directory = __c_make_get_cache_directory();
+
+    if (!cache_directory || !_c_make_context.cache_was_used)
+    {
+        return;
+    }
+
+    uint64_t max_size = 5 * 1024;
+    CMakeConfigValue cache_max_size = c_make_config_get("cache_max_size");
+
+    if (cache_max_size.is_valid)
+    {
+        CMakeString value = CMakeCString(cache_max_size.val);
+
+        if (!__c_make_parse_u64(&value, 10, &max_size) || value.count)
+        {
+            c_make_log(CMakeLogLevelWarning, "invalid cache_max_size '%s'\n", cache_max_size.val);
+            return;
+        }
+    }
+
+    max_size *= 1024 * 1024;
+
+    CMakeTemporaryMemory temp_memory = c_make_begin_temporary_memory(0, 0);
+
+    size_t file_count = 0;
+    size_t file_allocated = 0;
+    CMakeCacheFile *files = 0;
+    uint64_t total_size = 0;
+
+    for (int i = 0; i < 256; i += 1)
+    {
+        char key_directory[3];
+        snprintf(key_directory, sizeof(key_directory), "%02x", i);
+
+        const char *directory_name = c_make_c_string_path_concat_with_memory(temp_memory.memory, cache_directory, key_directory);
+        CMakeDirectory *directory = c_make_directory_open(temp_memory.memory, directory_name);
+
+        if (!directory)
+        {
+            continue;
+        }
+
+        CMakeDirectoryEntry *entry;
+
+        while ((entry = c_make_directory_get_next_entry(temp_memory.memory, directory)))
+        {
+            if (entry->name.data[0] == '.')
+            {
+                continue;
+            }
+
+            const char *path = c_make_c_string_path_concat_with_memory(temp_memory.memory, directory_name, entry->name.data);
+
+            uint64_t size, modification_time;
+
+            if (__c_make_get_file_info(path, &size, &modification_time))
+            {
+                if (file_count == file_allocated)
+                {
+                    size_t old_count = file_allocated;
+                    file_allocated = file_allocated ? (2 * file_allocated) : 256;
+                    files = (CMakeCacheFile *) c_make_memory_reallocate(temp_memory.memory, files,
+                                                                        old_count * sizeof(*files),
+                                                                        file_allocated * sizeof(*files));
+                }
+
+                files[file_count].path = path;
+                files[file_count].size = size;
+                files[file_count].modification_time = modification_time;
+                file_count += 1;
+
+                total_size += size;
+            }
+        }
+
+        c_make_directory_close(directory);
+    }
+
+    if (total_size > max_size)
+    {
+        qsort(files, file_count, sizeof(*files), __c_make_compare_cache_files);
+
+        uint64_t target_size = max_size - (max_size / 10);
+
+        for (size_t i = 0; (i < file_count) && (total_size > target_size); i += 1)
+        {
+            if (c_make_delete_file(files[i].path))
+            {
+                total_size -= files[i].size;
+            }
+        }
+    }
+
+    c_make_end_temporary_memory(temp_memory);
+#endif
+}
+
+#endif
+
+#if C_MAKE_PLATFORM_ANDROID || C_MAKE_PLATFORM_FREEBSD || C_MAKE_PLATFORM_LINUX || C_MAKE_PLATFORM_MACOS
+
+// Used in child processes between fork and exec. If both outputs go to
+// the same file it is only opened once, so that they don't overwrite each other.
+// Outputs that don't go to a file are connected to the capture pipes, if any.
+static bool
+__c_make_redirect_output(const char *stdout_file, const char *stderr_file, int stdout_pipe, int stderr_pipe)
+{
+    if ((stdout_pipe >= 0) && (dup2(stdout_pipe, STDOUT_FILENO) < 0))
+    {
+        return false;
+    }
+
+    if ((stderr_pipe >= 0) && (dup2(stderr_pipe, STDERR_FILENO) < 0))
+    {
+        return false;
+    }
+
+    if (stdout_file)
+    {
+        int fd = open(stdout_file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+        if ((fd < 0) || (dup2(fd, STDOUT_FILENO) < 0))
+        {
+            return false;
+        }
+
+        close(fd);
+    }
+
+    if (stderr_file)
+    {
+        if (stdout_file && !c_make_strcmp(stdout_file, stderr_file))
+        {
+            return dup2(STDOUT_FILENO, STDERR_FILENO) >= 0;
+        }
+
+        int fd = open(stderr_file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+        if ((fd < 0) || (dup2(fd, STDERR_FILENO) < 0))
+        {
+            return false;
+        }
+
+        close(fd);
+    }
+
+    return true;
+}
+
+// Starts a process without copying the address space of c_make. posix_spawnp reports
+// a failing exec as its return value, so errors are handled the same as failing forks.
+static pid_t
+__c_make_spawn_process(char **command_line, const char *stdout_file, const char *stderr_file, int stdout_pipe, int stderr_pipe,
+                       bool new_process_group)
+{
+#if C_MAKE_PLATFORM_FREEBSD || C_MAKE_PLATFORM_LINUX || C_MAKE_PLATFORM_MACOS
+    extern char **environ;
+
+    posix_spawn_file_actions_t file_actions;
+    posix_spawn_file_actions_t *file_actions_ptr = 0;
+
+    if (stdout_file || stderr_file || (stdout_pipe >= 0) || (stderr_pipe >= 0))
+    {
+        posix_spawn_file_actions_init(&file_actions);
+        file_actions_ptr = &file_actions;
+
+        if (stdout_pipe >= 0)
+        {
+            posix_spawn_file_actions_adddup2(&file_actions, stdout_pipe, STDOUT_FILENO);
+        }
+
+        if (stderr_pipe >= 0)
+        {
+            posix_spawn_file_actions_adddup2(&file_actions, stderr_pipe, STDERR_FILENO);
+        }
+
+        if (stdout_file)
+        {
+            posix_spawn_file_actions_addopen(&file_actions, STDOUT_FILENO, stdout_file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        }
+
+        if (stderr_file)
+        {
+            if (stdout_file && !c_make_strcmp(stdout_file, stderr_file))
+            {
+                posix_spawn_file_actions_adddup2(&file_actions, STDOUT_FILENO, STDERR_FILENO);
+            }
+            else
+            {
+                posix_spawn_file_actions_addopen(&file_actions, STDERR_FILENO, stderr_file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            }
+        }
+    }
+
+    posix_spawnattr_t attributes;
+    posix_spawnattr_t *attributes_ptr = 0;
+
+    if (new_process_group)
+    {
+        posix_spawnattr_init(&attributes);
+        posix_spawnattr_setflags(&attributes, POSIX_SPAWN_SETPGROUP);
+        posix_spawnattr_setpgroup(&attributes, 0);
+        attributes_ptr = &attributes;
+    }
+
+    pid_t pid;
+    int error = posix_spawnp(&pid, command_line[0], file_actions_ptr, attributes_ptr, command_line, environ);
+
+    if (file_actions_ptr)
+    {
+        posix_spawn_file_actions_destroy(file_actions_ptr);
+    }
+
+    if (attributes_ptr)
+    {
+        posix_spawnattr_destroy(attributes_ptr);
+    }
+
+    if (error)
+    {
+        errno = error;
+        return -1;
+    }
+
+    return pid;
+#else
+    pid_t pid = fork();
+
+    if (pid == 0)
+    {
+        if (new_process_group)
+        {
+            setpgid(0, 0);
+        }
+
+        if (!__c_make_redirect_output(stdout_file, stderr_file, stdout_pipe, stderr_pipe))
+        {
+            fprintf(stderr, "Could not redirect output: %s\n", strerror(errno));
+            _exit(1);
+        }
+
+        execvp(command_line[0], command_line);
+        fprintf(stderr, "Could not execvp: %s\n", strerror(errno));
+        _exit(1);
+    }
+
+    // Also set in the parent, so that the group exists before anyone tries to kill it.
+    if ((pid > 0) && new_process_group)
+    {
+        setpgid(pid, pid);
+    }
+
+    return pid;
+#endif
+}
+
+#endif
+
+// The memory use that was measured for 'command' in earlier builds replaces the estimate.
+static uint64_t
+__c_make_get_command_memory_weight(CMakeCommand command, uint64_t memory_weight)
+{
+    CMakeCommandHistory *command_history = __c_make_get_command_history(__c_make_hash_command(command), false);
+
+    if (command_history && command_history->max_resident_size)
+    {
+        memory_weight = command_history->max_resident_size;
+    }
+
+    return memory_weight;
+}
+
+// Returns true if a command with 'memory_weight' can start without exceeding 'max_jobs' or
+// the memory budget. Tokens of a jobserver are not considered.
+static bool
+__c_make_has_free_job_slot(uint64_t memory_weight)
+{
+    uint64_t memory_budget = __c_make_get_memory_budget();
+
+    return (__c_make_get_running_process_count() < (size_t) c_make_get_max_jobs()) &&
+           (!memory_budget || ((__c_make_get_running_memory_weight() + memory_weight) <= memory_budget));
+}
+
+// Commands are only started while the memory they are expected to use fits into the memory
+// budget together with the running commands. 'memory_weight' is an estimate in kilobytes,
+// which is replaced by the memory use that was measured for the command in earlier builds.
+// A command that doesn't fit at all runs alone. A command that runs longer than 'timeout'
+// microseconds is killed, 0 means no timeout.
+static CMakeProcessId
+__c_make_command_run(CMakeCommand command, const char *stdout_file, const char *stderr_file, uint64_t memory_weight,
+                     uint64_t timeout)
+{
+    if (command.count == 0)
+    {
+        return CMakeInvalidProcessId;
+    }
+
+    for (size_t i = 0; i < command.count; i += 1)
+    {
+        if (!command.items[i])
+        {
+            return CMakeInvalidProcessId;
+        }
+    }
+
+    uint64_t command_hash = __c_make_hash_command(command);
+    memory_weight = __c_make_get_command_memory_weight(command, memory_weight);
+
+    CMakeJobserver *jobserver = __c_make_get_jobserver();
+    bool has_token = false;
+    char token = 0;
+
+    for (;;)
+    {
+        if (_c_make_context.cancelled || !__c_make_get_running_process_count())
+        {
+            break;
+        }
+
+        if (__c_make_has_free_job_slot(memory_weight))
+        {
+            // Every process may run one job without a token.
+            if (!jobserver->is_active || !__c_make_has_running_process_without_token())
+            {
+                break;
+            }
+
+            if (__c_make_jobserver_acquire(jobserver, &token))
+            {
+                has_token = true;
+                break;
+            }
+
+            __c_make_jobserver_wait(jobserver);
+            continue;
+        }
+
+        __c_make_process_wait_any();
+    }
+
+    if (_c_make_context.cancelled)
+    {
+        if (has_token)
+        {
+            __c_make_jobserver_release(jobserver, token);
+        }
+
+        return CMakeInvalidProcessId;
+    }
+
+    // Only commands that really start are printed, not the ones fail-fast cancelled.
+    if (_c_make_context.verbose)
+    {
+        CMakeTemporaryMemory temp_memory = c_make_begin_temporary_memory(0, 0);
+
+        CMakeString command_string = c_make_command_to_string(temp_memory.memory, command);
+        c_make_log(CMakeLogLevelRaw, "%" CMakeStringFmt "\n", CMakeStringArg(command_string));
+
+        c_make_end_temporary_memory(temp_memory);
+    }
+
+    uint64_t start_time = __c_make_get_time_in_microseconds();
+    CMakeProcessId process_id;
+
+#if C_MAKE_PLATFORM_WINDOWS
+    CMakeTemporaryMemory temp_memory = c_make_begin_temporary_memory(0, 0);
+
+    HANDLE stdout_handle = INVALID_HANDLE_VALUE;
+    HANDLE stderr_handle = INVALID_HANDLE_VALUE;
+
+    SECURITY_ATTRIBUTES security_attributes = { 0 };
+    security_attributes.nLength = sizeof(security_attributes);
+    security_attributes.bInheritHandle = TRUE;
+
+    if (stdout_file)
+    {
+        stdout_handle = CreateFile(c_make_c_string_utf8_to_utf16(temp_memory.memory, stdout_file), GENERIC_WRITE,
+                                   FILE_SHARE_READ | FILE_SHARE_WRITE, &security_attributes, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0);
+    }
+
+    if (stderr_file)
+    {
+        if (stdout_file && !c_make_strcmp(stdout_file, stderr_file))
+        {
+            DuplicateHandle(GetCurrentProcess(), stdout_handle, GetCurrentProcess(), &stderr_handle, 0, TRUE, DUPLICATE_SAME_ACCESS);
+        }
+        else
+        {
+            stderr_handle = CreateFile(c_make_c_string_utf8_to_utf16(temp_memory.memory, stderr_file), GENERIC_WRITE,
+                                       FILE_SHARE_READ | FILE_SHARE_WRITE, &security_attributes, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0);
+        }
+    }
+
+    STARTUPINFO start_info = { 0 };
+    start_info.cb = sizeof(start_info);
+    start_info.hStdError  = (stderr_handle != INVALID_HANDLE_VALUE) ? stderr_handle : GetStdHandle(STD_ERROR_HANDLE);
+    start_info.hStdOutput = (stdout_handle != INVALID_HANDLE_VALUE) ? stdout_handle : GetStdHandle(STD_OUTPUT_HANDLE);
+    start_info.hStdInput  = GetStdHandle(STD_INPUT_HANDLE);
+    start_info.dwFlags    = STARTF_USESTDHANDLES;
+
+    PROCESS_INFORMATION process_info = { 0 };
+
+    CMakeString command_line = c_make_command_to_string(temp_memory.memory, command);
+
+    int wide_command_line_size = 2 * command_line.count;
+    LPWSTR wide_command_line = (LPWSTR) c_make_memory_allocate(temp_memory.memory, wide_command_line_size);
+
+    int wide_count = MultiByteToWideChar(CP_UTF8, 0, command_line.data, command_line.count, wide_command_line, wide_command_line_size);
+    wide_command_line[wide_count] = 0;
+
+    BOOL result = CreateProcess(0, wide_command_line, 0, 0, TRUE, 0, 0, 0, &start_info, &process_info);
+
+    if (stdout_handle != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(stdout_handle);
+    }
+
+    if (stderr_handle != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(stderr_handle);
+    }
+
+    c_make_end_temporary_memory(temp_memory);
+
+    if (!result)
+    {
+        CMakeTemporaryMemory temp_memory = c_make_begin_temporary_memory(0, 0);
+
+        CMakeString command_string = c_make_command_to_string(temp_memory.memory, command);
+        c_make_log(CMakeLogLevelError, "could not run command (GetLastError = %lu): %" CMakeStringFmt "\n", GetLastError(), CMakeStringArg(command_string));
+
+        c_make_end_temporary_memory(temp_memory);
+        return CMakeInvalidProcessId;
+    }
+
+    CloseHandle(process_info.hThread);
+
+    process_id = process_info.hProcess;
+#else
+    CMakeTemporaryMemory temp_memory = c_make_begin_temporary_memory(0, 0);
+
+    // The output of commands is captured through pipes and printed in one piece when
+    // the command exits, so that the output of parallel commands doesn't interleave.
+    int output_pipes[2][2] = { { -1, -1 }, { -1, -1 } };
+    const char *output_files[2] = { stdout_file, stderr_file };
+
+    if (c_make_config_is_enabled("capture_output", true))
+    {
+        for (int i = 0; i < 2; i += 1)
+        {
+            if (!output_files[i] && !__c_make_create_pipe(output_pipes[i]))
+            {
+                output_pipes[i][0] = -1;
+                output_pipes[i][1] = -1;
+            }
+        }
+    }
+
+    CMakeCommand run_command;
+    run_command.count = command.count;
+    run_command.allocated = command.count + 2;
+    run_command.items = (const char **) c_make_memory_allocate(temp_memory.memory, run_command.allocated * sizeof(const char *));
+
+    for (size_t i = 0; i < command.count; i += 1)
+    {
+        run_command.items[i] = command.items[i];
+    }
+
+    // Compilers only use colors if they write to a terminal themselves.
+    if ((output_pipes[1][1] >= 0) && isatty(STDERR_FILENO) && __c_make_command_supports_diagnostics_color(command))
+    {
+        run_command.items[run_command.count++] = "-fdiagnostics-color=always";
+    }
+
+    run_command.items[run_command.count] = 0;
+
+    char **command_line = (char **) run_command.items;
+
+    bool use_cache = __c_make_command_is_cacheable(run_command);
+
+    if (use_cache)
+    {
+        _c_make_context.cache_was_used = true;
+    }
+
+    pid_t pid;
+
+    if (use_cache)
+    {
+        // The cache lookup runs in its own process, so it needs a real fork.
+        pid = fork();
+
+        if (pid == 0)
+        {
+            if (!__c_make_redirect_output(stdout_file, stderr_file, output_pipes[0][1], output_pipes[1][1]))
+            {
+                fprintf(stderr, "Could not redirect output: %s\n", strerror(errno));
+                _exit(1);
+            }
+
+            int exit_code = __c_make_run_cached_command(run_command);
+            fflush(stdout);
+            fflush(stderr);
+            _exit(exit_code);
+        }
+    }
+    else
+    {
+        pid = __c_make_spawn_process(command_line, stdout_file, stderr_file, output_pipes[0][1], output_pipes[1][1], timeout > 0);
+    }
+
+    c_make_end_temporary_memory(temp_memory);
+
+    for (int i = 0; i < 2; i += 1)
+    {
+        if (output_pipes[i][1] >= 0)
+        {
+            close(output_pipes[i][1]);
+        }
+
+        if ((pid < 0) && (output_pipes[i][0] >= 0))
+        {
+            close(output_pipes[i][0]);
+        }
+    }
+
+    if (pid < 0)
+    {
+        _c_make_context.did_fail = true;
+
+        if (has_token)
+        {
+            __c_make_jobserver_release(jobserver, token);
+        }
+
+        CMakeTemporaryMemory temp_memory = c_make_begin_temporary_memory(0, 0);
+
+        CMakeString command_string = c_make_command_to_string(temp_memory.memory, command);
+        c_make_log(CMakeLogLevelError, "could not run command (errno = %d: %s): %" CMakeStringFmt "\n", errno, strerror(errno), CMakeStringArg(command_string));
+
+        c_make_end_temporary_memory(temp_memory);
+        return CMakeInvalidProcessId;
+    }
+
+    process_id = pid;
+#endif
+
+    if (_c_make_context.process_group.count == _c_make_context.process_group.allocated)
+    {
+        size_t old_count = _c_make_context.process_group.allocated;
+        _c_make_context.process_group.allocated += 16;
+        _c_make_context.process_group.items =
+            (CMakeProcess *) c_make_memory_reallocate(&_c_make_context.permanent_memory,
+                                                      _c_make_context.process_group.items,
+                                                      old_count * sizeof(*_c_make_context.process_group.items),
+                                                      _c_make_context.process_group.allocated * sizeof(*_c_make_context.process_group.items));
+    }
+
+    CMakeProcess *process = _c_make_context.process_group.items + _c_make_context.process_group.count;
+    _c_make_context.process_group.count += 1;
+
+    process->id = process_id;
+    process->exited = false;
+    process->succeeded = true;
+    process->cancelled = false;
+    process->command = c_make_command_to_string(&_c_make_context.process_memory, command).data;
+    process->dependency_file = 0;
+    process->command_hash = command_hash;
+    process->memory_weight = memory_weight;
+    process->has_token = has_token;
+    process->token = token;
+    process->timeout_time = timeout ? (start_time + timeout) : 0;
+    process->timed_out = false;
+
+    for (int i = 0; i < 2; i += 1)
+    {
+#if C_MAKE_PLATFORM_WINDOWS
+        process->output[i].fd = -1;
+#else
+        process->output[i].fd = output_pipes[i][0];
+#endif
+        process->output[i].count = 0;
+        process->output[i].allocated = 0;
+        process->output[i].data = 0;
+    }
+    process->trace_name = 0;
+    process->trace_slot = 0;
+    process->start_time = start_time;
+    process->wall_time = 0;
+    process->user_time = 0;
+    process->system_time = 0;
+    process->max_resident_size = 0;
+
+    if (_c_make_context.trace_enabled)
+    {
+        process->trace_name = __c_make_get_trace_name(&_c_make_context.process_memory, command);
+
+        // Use the lowest slot that is not taken by a running command.
+        for (;;)
+        {
+            bool slot_is_used = false;
+
+            for (size_t i = 0; (i + 1) < _c_make_context.process_group.count; i += 1)
+            {
+                CMakeProcess *other = _c_make_context.process_group.items + i;
+
+                if (!other->exited && (other->trace_slot == process->trace_slot))
+                {
+                    slot_is_used = true;
+                    break;
+                }
+            }
+
+            if (!slot_is_used)
+            {
+                break;
+            }
+
+            process->trace_slot += 1;
+        }
+    }
+
+    for (size_t i = 0; (i + 1) < command.count; i += 1)
+    {
+        if (!c_make_strcmp(command.items[i], "-MF"))
+        {
+            process->dependency_file = c_make_copy_string(&_c_make_context.process_memory, CMakeCString(command.items[i + 1])).data;
+        }
+    }
+
+    if (_c_make_context.sequential)
+    {
+        __c_make_process_wait(process_id);
+    }
+
+    return process_id;
+}
+
+// Runs a command like c_make_command_run, but writes the standard output and standard error
+// of the command to the given files. A file name of 0 keeps the output of c_make.
+C_MAKE_DEF CMakeProcessId
+c_make_command_run_with_redirect(CMakeCommand command, const char *stdout_file, const char *stderr_file)
+{
+    // The build log can't tell if a command outside of the build graph has to run again.
+    _c_make_context.build_log.is_valid = false;
+
+    return __c_make_command_run(command, stdout_file, stderr_file, 0, 0);
+}
+
+C_MAKE_DEF CMakeProcessId
+c_make_command_run(CMakeCommand command)
+{
+    return c_make_command_run_with_redirect(command, 0, 0);
+}
+
+C_MAKE_DEF CMakeProcessId
+c_make_command_run_and_reset(CMakeCommand *command)
+{
+    CMakeProcessId process_id = c_make_command_run(*command);
+    command->count = 0;
+    return process_id;
+}
+
+C_MAKE_DEF bool
+c_make_process_wait(CMakeProcessId process_id)
+{
+    size_t index = __c_make_process_wait(process_id);
+
+    if (index < _c_make_context.process_group.count)
+    {
+        CMakeProcess *process = _c_make_context.process_group.items + index;
+
+        assert(process->exited);
+        bool succeeded = process->succeeded;
+
+        __c_make_process_remove(index);
+
+        return succeeded;
+    }
+
+    return false;
+}
+
+C_MAKE_DEF bool
+c_make_command_run_and_reset_and_wait(CMakeCommand *command)
+{
+    CMakeProcessId process_id = c_make_command_run(*command);
+    command->count = 0;
+    return c_make_process_wait(process_id);
+}
+
+C_MAKE_DEF bool
+c_make_command_run_and_wait(CMakeCommand command)
+{
+    CMakeProcessId process_id = c_make_command_run(command);
+    return c_make_process_wait(process_id);
+}
+
+C_MAKE_DEF bool
+c_make_process_wait_for_all(void)
+{
+    bool result = true;
+
+    while (_c_make_context.process_group.count)
+    {
+        __c_make_process_wait_any();
+
+        size_t index = 0;
+
+        while (index < _c_make_context.process_group.count)
+        {
+            CMakeProcess *process = _c_make_context.process_group.items + index;
+
+            if (process->exited)
+            {
+                result = result && process->succeeded;
+                __c_make_process_remove(index);
+            }
+            else
+            {
+                index += 1;
+            }
+        }
+    }
+
+    return result;
+}
+
+static const char **
+__c_make_copy_c_string_array(CMakeMemory *memory, size_t count, const char **items)
+{
+    const char **result = (const char **) c_make_memory_allocate(memory, (count + 1) * sizeof(const char *));
+
+    for (size_t i = 0; i < count; i += 1)
+    {
+        result[i] = c_make_copy_string(memory, CMakeCString(items[i])).data;
+    }
+
+    result[count] = 0;
+
+    return result;
+}
+
+// Adds an action to the build graph. The command runs once all actions that produce
+// one of its inputs have finished, and only if one of its outputs is out of date.
+// The graph is run with c_make_graph_run() or at the end of the current target.
+C_MAKE_DEF void
+c_make_graph_add_action(const char *description, CMakeCommand command,
+                        size_t input_count, const char **inputs,
+                        size_t output_count, const char **outputs)
+{
+    CMakeGraph *graph = &_c_make_context.graph;
+
+    if (graph->count == graph->allocated)
+    {
+        size_t old_count = graph->allocated;
+        graph->allocated += 64;
+        graph->items = (CMakeAction *) c_make_memory_reallocate(&_c_make_context.permanent_memory, graph->items,
+                                                                old_count * sizeof(*graph->items),
+                                                                graph->allocated * sizeof(*graph->items));
+    }
+
+    CMakeAction *action = graph->items + graph->count;
+    graph->count += 1;
+
+    action->description = description ? c_make_copy_string(&graph->memory, CMakeCString(description)).data : 0;
+    action->command.count = command.count;
+    action->command.allocated = command.count + 1;
+    action->command.items = __c_make_copy_c_string_array(&graph->memory, command.count, command.items);
+    action->input_count = input_count;
+    action->inputs = __c_make_copy_c_string_array(&graph->memory, input_count, inputs);
+    action->output_count = output_count;
+    action->outputs = __c_make_copy_c_string_array(&graph->memory, output_count, outputs);
+    action->state = CMakeActionStateWaiting;
+    action->process_id = CMakeInvalidProcessId;
+    action->memory_weight = 0;
+    action->input_changed = false;
+    action->pending_input_count = 0;
+    action->dependent_count = 0;
+    action->dependent_allocated = 0;
+    action->dependents = 0;
+}
+
+// Sets the memory in megabytes that the action added last is expected to use. This keeps
+// parallel builds from running out of memory with commands like big links, before their
+// memory use was measured once.
+C_MAKE_DEF void
+c_make_graph_set_memory_estimate(uint64_t megabytes)
+{
+    CMakeGraph *graph = &_c_make_context.graph;
+
+    if (graph->count)
+    {
+        graph->items[graph->count - 1].memory_weight = 1024 * megabytes;
+    }
+}
+
+// Adds one action per source file that compiles it to its own object file in the build
+// directory, and an action that links all objects to 'output_path'. Every object is checked
+// for a rebuild on its own, so the link only runs if one of the objects changed.
+// 'compile_command' is the compiler followed by all compiler flags. The link appends the
+// default linker flags after the objects, followed by 'link_flags' (e.g. libraries).
+// 'inputs' are additional inputs of every compile, like a config file.
+C_MAKE_DEF void
+c_make_graph_add_executable(const char *output_path, CMakeCommand compile_command,
+                            size_t source_count, const char **sources,
+                            size_t input_count, const char **inputs,
+                            CMakeCommand link_flags)
+{
+    if (!compile_command.count || !compile_command.items[0])
+    {
+        c_make_log(CMakeLogLevelWarning, "%s: you need to append a c/c++ compiler command as the first argument\n", __func__);
+        return;
+    }
+
+    CMakePlatform platform = c_make_get_target_platform();
+    const char *object_extension = ((platform == CMakePlatformWindows) || c_make_compiler_is_msvc(compile_command.items[0])) ? ".obj" : ".o";
+
+    CMakeString output_name = CMakeCString(output_path);
+    output_name = c_make_string_split_right_path_separator(&output_name);
+    const char *name = c_make_copy_string(&_c_make_context.public_memory, output_name).data;
+
+    const char **compile_inputs = (const char **) c_make_memory_allocate(&_c_make_context.public_memory, (input_count + 1) * sizeof(const char *));
+    const char **objects = (const char **) c_make_memory_allocate(&_c_make_context.public_memory, source_count * sizeof(const char *));
+
+    for (size_t i = 0; i < input_count; i += 1)
+    {
+        compile_inputs[i + 1] = inputs[i];
+    }
+
+    CMakeCommand command = { 0, 0, 0 };
+
+    for (size_t i = 0; i < source_count; i += 1)
+    {
+        CMakeString source_directory = CMakeCString(sources[i]);
+        CMakeString stem = c_make_string_split_right_path_separator(&source_directory);
+
+        CMakeString source_name = stem;
+        c_make_string_split_right(&stem, '.');
+
+        if (!stem.count)
+        {
+            stem = source_name;
+        }
+
+        // The object is named after the executable too, so that two executables can share
+        // a source file name. A hash of the source directory keeps 'a/util.c' and 'b/util.c'
+        // apart, e.g. 'prog-util-1f0e3dad.o'.
+        char directory_hash[16];
+        sprintf(directory_hash, "-%08x", (unsigned int) (c_make_hash_data(0, source_directory.data, source_directory.count) & 0xffffffff));
+
+        const char *object_path = c_make_c_string_path_concat(c_make_get_build_path(),
+                                                              c_make_c_string_concat(name, "-", c_make_copy_string(&_c_make_context.public_memory, stem).data,
+                                                                                     directory_hash));
+        objects[i] = c_make_c_string_concat(object_path, object_extension);
+
+        c_make_command_append_slice(&command, compile_command.count, compile_command.items);
+        c_make_command_append(&command, "-c");
+        c_make_command_append_dependency_file(&command, objects[i]);
+        c_make_command_append_output_object(&command, object_path, platform);
+        c_make_command_append(&command, sources[i]);
+
+        compile_inputs[0] = sources[i];
+
+        c_make_graph_add_action(c_make_c_string_concat("compile '", c_make_copy_string(&_c_make_context.public_memory, source_name).data, "'"), command,
+                                input_count + 1, compile_inputs, 1, &objects[i]);
+        command.count = 0;
+    }
+
+    const char *executable_path = (platform == CMakePlatformWindows) ? c_make_c_string_concat(output_path, ".exe") : output_path;
+
+    c_make_command_append_slice(&command, compile_command.count, compile_command.items);
+    c_make_command_append_output_executable(&command, output_path, platform);
+    c_make_command_append_slice(&command, source_count, objects);
+    c_make_command_append_default_linker_flags(&command, c_make_get_target_architecture());
+    c_make_command_append_slice(&command, link_flags.count, link_flags.items);
+
+    c_make_graph_add_action(c_make_c_string_concat("link '", name, "'"), command,
+                            source_count, objects, 1, &executable_path);
+}
+
+static bool
+__c_make_action_needs_rebuild(CMakeAction *action)
+{
+    if (!action->output_count)
+    {
+        return true;
+    }
+
+    bool result = false;
+    uint64_t command_hash = __c_make_hash_command(action->command);
+
+    // Every output has to be checked, so that all of them get their input hashes recorded.
+    for (size_t i = 0; i < action->output_count; i += 1)
+    {
+        uint64_t previous_command_hash;
+
+        if (__c_make_needs_rebuild(action->outputs[i], action->input_count, action->inputs))
+        {
+            result = true;
+        }
+        else if (__c_make_build_log_get_previous_command_hash(&_c_make_context.build_log, action->outputs[i], &previous_command_hash) &&
+                 (previous_command_hash != command_hash))
+        {
+            result = true;
+
+            // The inputs didn't change, but the output will. Its content hash is recorded
+            // again once the build succeeded.
+            if (c_make_config_is_enabled("content_hash", false))
+            {
+                CMakeOutputHash *output = __c_make_hash_database_get_output(__c_make_get_hash_database(), CMakeCString(action->outputs[i]));
+
+                if (output->has_inputs_hash && !output->is_pending)
+                {
+                    output->is_pending = true;
+                    output->pending_inputs_hash = output->inputs_hash;
+                }
+            }
+        }
+    }
+
+    return result;
+}
+
+// Records the actions of a graph in the build log. The inputs include the dependencies
+// from the dependency files of the outputs.
+static void
+__c_make_build_log_add_graph(CMakeBuildLog *build_log, CMakeGraph *graph)
+{
+    for (size_t i = 0; i < graph->count; i += 1)
+    {
+        CMakeAction *action = graph->items + i;
+
+        // An action without outputs runs on every build.
+        if (!action->output_count)
+        {
+            build_log->is_valid = false;
+            continue;
+        }
+
+        uint64_t command_hash = __c_make_hash_command(action->command);
+
+        // An action that failed or didn't run keeps the command hash of the previous build,
+        // so that it still runs next time if its command changed.
+        if ((action->state != CMakeActionStateFinished) &&
+            !__c_make_build_log_get_previous_command_hash(build_log, action->outputs[0], &command_hash))
+        {
+            continue;
+        }
+
+        size_t input_count = action->input_count;
+
+        for (size_t j = 0; j < action->output_count; j += 1)
+        {
+            CMakeDependencies *dependencies = __c_make_get_dependencies(action->outputs[j]);
+
+            if (dependencies)
+            {
+                input_count += dependencies->count;
+            }
+        }
+
+        CMakeBuildLogAction *log_action = __c_make_build_log_add_action(build_log, command_hash, input_count, action->output_count);
+
+        size_t index = 0;
+
+        for (size_t j = 0; j < action->input_count; j += 1)
+        {
+            log_action->files[index++] = __c_make_build_log_add_file(build_log, action->inputs[j]);
+        }
+
+        for (size_t j = 0; j < action->output_count; j += 1)
+        {
+            CMakeDependencies *dependencies = __c_make_get_dependencies(action->outputs[j]);
+
+            for (size_t k = 0; dependencies && (k < dependencies->count); k += 1)
+            {
+                log_action->files[index++] = __c_make_build_log_add_file(build_log, dependencies->items[k].data);
+            }
+        }
+
+        for (size_t j = 0; j < action->output_count; j += 1)
+        {
+            log_action->files[index++] = __c_make_build_log_add_file(build_log, action->outputs[j]);
+        }
+    }
+}
+
+// Marks all actions that depend on 'action_index' (directly or indirectly) as skipped.
+static void
+__c_make_graph_skip_dependents(CMakeGraph *graph, size_t *stack, size_t action_index)
+{
+    size_t stack_count = 0;
+    stack[stack_count++] = action_index;
+
+    while (stack_count)
+    {
+        CMakeAction *action = graph->items + stack[--stack_count];
+
+        for (size_t i = 0; i < action->dependent_count; i += 1)
+        {
+            CMakeAction *dependent = graph->items + action->dependents[i];
+
+            if (dependent->state == CMakeActionStateWaiting)
+            {
+                dependent->state = CMakeActionStateSkipped;
+                stack[stack_count++] = action->dependents[i];
+            }
+        }
+    }
+}
+
+// The ready actions are kept in a binary heap, so that the action with the highest
+// priority is started first.
+static void
+__c_make_graph_push_ready(CMakeGraph *graph, size_t *heap, size_t *count, size_t action_index)
+{
+    size_t index = *count;
+    *count += 1;
+
+    while (index)
+    {
+        size_t parent = (index - 1) / 2;
+
+        if (graph->items[heap[parent]].priority >= graph->items[action_index].priority)
+        {
+            break;
+        }
+
+        heap[index] = heap[parent];
+        index = parent;
+    }
+
+    heap[index] = action_index;
+}
+
+static size_t
+__c_make_graph_pop_ready(CMakeGraph *graph, size_t *heap, size_t *count)
+{
+    size_t result = heap[0];
+
+    *count -= 1;
+    size_t last = heap[*count];
+    size_t index = 0;
+
+    for (;;)
+    {
+        size_t child = (2 * index) + 1;
+
+        if (child >= *count)
+        {
+            break;
+        }
+
+        if (((child + 1) < *count) && (graph->items[heap[child + 1]].priority > graph->items[heap[child]].priority))
+        {
+            child += 1;
+        }
+
+        if (graph->items[last].priority >= graph->items[heap[child]].priority)
+        {
+            break;
+        }
+
+        heap[index] = heap[child];
+        index = child;
+    }
+
+    heap[index] = last;
+
+    return result;
+}
+
+// Prints the longest chain of commands by their measured wall time. No number of cores
+// can make the build faster than this chain.
+static void
+__c_make_graph_print_report(CMakeGraph *graph, size_t order_count, size_t *order, uint64_t elapsed_time)
+{
+    CMakeTemporaryMemory temp_memory = c_make_begin_temporary_memory(0, 0);
+
+    uint64_t *path_times = (uint64_t *) c_make_memory_allocate(temp_memory.memory, graph->count * sizeof(uint64_t));
+    size_t *next_actions = (size_t *) c_make_memory_allocate(temp_memory.memory, graph->count * sizeof(size_t));
+
+    uint64_t work_time = 0;
+    size_t command_count = 0;
+    size_t first_action = (size_t) -1;
+
+    for (size_t i = order_count; i > 0; i -= 1)
+    {
+        size_t action_index = order[i - 1];
+        CMakeAction *action = graph->items + action_index;
+
+        uint64_t longest_time = 0;
+        next_actions[action_index] = (size_t) -1;
+
+        for (size_t j = 0; j < action->dependent_count; j += 1)
+        {
+            if (path_times[action->dependents[j]] > longest_time)
+            {
+                longest_time = path_times[action->dependents[j]];
+                next_actions[action_index] = action->dependents[j];
+            }
+        }
+
+        path_times[action_index] = action->wall_time + longest_time;
+
+        if (action->wall_time)
+        {
+            work_time += action->wall_time;
+            command_count += 1;
+        }
+
+        if ((first_action == (size_t) -1) || (path_times[action_index] > path_times[first_action]))
+        {
+            first_action = action_index;
+        }
+    }
+
+    if (command_count)
+    {
+        uint64_t critical_time = path_times[first_action];
+
+        c_make_log(CMakeLogLevelInfo, "critical path of %.2fs, the build took %.2fs for %.2fs of work in %llu commands:\n",
+                   critical_time / 1000000.0, elapsed_time / 1000000.0, work_time / 1000000.0, (unsigned long long) command_count);
+
+        for (size_t action_index = first_action; action_index != (size_t) -1; action_index = next_actions[action_index])
+        {
+            CMakeAction *action = graph->items + action_index;
+
+            if (action->wall_time)
+            {
+                const char *name = action->description;
+
+                if (!name)
+                {
+                    name = action->output_count ? action->outputs[0] : action->command.items[0];
+                }
+
+                c_make_log(CMakeLogLevelRaw, "  %8.2fs  %s\n", action->wall_time / 1000000.0, name);
+            }
+        }
+
+        c_make_log(CMakeLogLevelInfo, "more cores could make this build up to %.2fx faster, it has an average parallelism of %.2f\n",
+                   (double) elapsed_time / (double) critical_time, (double) work_time / (double) critical_time);
+    }
+
+    c_make_end_temporary_memory(temp_memory);
+}
+
+static void
+__c_make_graph_reset(CMakeGraph *graph)
+{
+    graph->count = 0;
+    c_make_memory_set_used(&graph->memory, 0);
+}
+
+C_MAKE_DEF bool
+c_make_graph_run(void)
+{
+    CMakeGraph *graph = &_c_make_context.graph;
+
+    if (!graph->count)
+    {
+        return true;
+    }
+
+    bool result = true;
+    CMakeMap output_map = { 0, 0, 0 };
+    size_t graph_used = c_make_memory_get_used(&graph->memory);
+    uint64_t start_time = __c_make_get_time_in_microseconds();
+
+    for (size_t i = 0; i < graph->count; i += 1)
+    {
+        CMakeAction *action = graph->items + i;
+
+        action->state = CMakeActionStateWaiting;
+        action->process_id = CMakeInvalidProcessId;
+        action->is_outdated = false;
+        action->priority = 0;
+        action->wall_time = 0;
+        action->pending_input_count = 0;
+        action->dependent_count = 0;
+        action->dependent_allocated = 0;
+        action->dependents = 0;
+
+        for (size_t j = 0; j < action->output_count; j += 1)
+        {
+            CMakeString output = CMakeCString(action->outputs[j]);
+            size_t producer = __c_make_map_find(&output_map, output);
+
+            if (producer != (size_t) -1)
+            {
+                c_make_log(CMakeLogLevelError, "'%s' is an output of more than one action\n", action->outputs[j]);
+                _c_make_context.did_fail = true;
+                __c_make_graph_reset(graph);
+                return false;
+            }
+
+            __c_make_map_insert(&graph->memory, &output_map, output, i);
+        }
+    }
+
+    for (size_t i = 0; i < graph->count; i += 1)
+    {
+        CMakeAction *action = graph->items + i;
+
+        for (size_t j = 0; j < action->input_count; j += 1)
+        {
+            size_t producer_index = __c_make_map_find(&output_map, CMakeCString(action->inputs[j]));
+
+            if (producer_index != (size_t) -1)
+            {
+                CMakeAction *producer = graph->items + producer_index;
+
+                if (producer->dependent_count == producer->dependent_allocated)
+                {
+                    size_t old_count = producer->dependent_allocated;
+                    producer->dependent_allocated = producer->dependent_allocated ? (2 * producer->dependent_allocated) : 8;
+                    producer->dependents = (size_t *) c_make_memory_reallocate(&graph->memory, producer->dependents,
+                                                                               old_count * sizeof(*producer->dependents),
+                                                                               producer->dependent_allocated * sizeof(*producer->dependents));
+                }
+
+                producer->dependents[producer->dependent_count++] = i;
+                action->pending_input_count += 1;
+            }
+        }
+    }
+
+    // The actions in topological order. Actions in a dependency cycle are left out.
+    size_t *order = (size_t *) c_make_memory_allocate(&graph->memory, graph->count * sizeof(size_t));
+    size_t order_count = 0;
+
+    for (size_t i = 0; i < graph->count; i += 1)
+    {
+        if (!graph->items[i].pending_input_count)
+        {
+            order[order_count++] = i;
+        }
+
+        // Temporarily used as the count of inputs that are not yet in the order.
+        graph->items[i].wall_time = graph->items[i].pending_input_count;
+    }
+
+    for (size_t i = 0; i < order_count; i += 1)
+    {
+        CMakeAction *action = graph->items + order[i];
+
+        for (size_t j = 0; j < action->dependent_count; j += 1)
+        {
+            if (--graph->items[action->dependents[j]].wall_time == 0)
+            {
+                order[order_count++] = action->dependents[j];
+            }
+        }
+    }
+
+    // The priority of an action is the predicted wall time of the longest chain of actions
+    // that starts with it. Commands that never ran count with the average wall time.
+    uint64_t known_time = 0;
+    size_t known_count = 0;
+
+    for (size_t i = 0; i < graph->count; i += 1)
+    {
+        CMakeAction *action = graph->items + i;
+        CMakeCommandHistory *command_history = __c_make_get_command_history(__c_make_hash_command(action->command), false);
+
+        action->wall_time = 0;
+
+        if (command_history && command_history->wall_time)
+        {
+            action->priority = command_history->wall_time;
+            known_time += command_history->wall_time;
+            known_count += 1;
+        }
+    }
+
+    uint64_t default_time = known_count ? (known_time / known_count) : 1;
+
+    for (size_t i = order_count; i > 0; i -= 1)
+    {
+        CMakeAction *action = graph->items + order[i - 1];
+        uint64_t longest_time = 0;
+
+        for (size_t j = 0; j < action->dependent_count; j += 1)
+        {
+            if (graph->items[action->dependents[j]].priority > longest_time)
+            {
+                longest_time = graph->items[action->dependents[j]].priority;
+            }
+        }
+
+        action->priority = (action->priority ? action->priority : default_time) + longest_time;
+    }
+
+    size_t *ready_queue = (size_t *) c_make_memory_allocate(&graph->memory, graph->count * sizeof(size_t));
+    size_t *skip_stack = (size_t *) c_make_memory_allocate(&graph->memory, graph->count * sizeof(size_t));
+    size_t ready_count = 0;
+    size_t running_count = 0;
+
+    for (size_t i = 0; i < graph->count; i += 1)
+    {
+        if (!graph->items[i].pending_input_count)
+        {
+            graph->items[i].state = CMakeActionStateReady;
+            __c_make_graph_push_ready(graph, ready_queue, &ready_count, i);
+        }
+    }
+
+    for (;;)
+    {
+        while (ready_count && !_c_make_context.cancelled)
+        {
+            size_t action_index = __c_make_graph_pop_ready(graph, ready_queue, &ready_count);
+            CMakeAction *action = graph->items + action_index;
+
+            if (!action->is_outdated &&
+                ((graph->only_changed_inputs && !action->input_changed) || !__c_make_action_needs_rebuild(action)))
+            {
+                action->state = CMakeActionStateFinished;
+            }
+            else
+            {
+                // The action goes back into the queue until a job slot is free. The dependents
+                // of actions that finish meanwhile compete for the slot by their priority.
+                if (running_count &&
+                    !__c_make_has_free_job_slot(__c_make_get_command_memory_weight(action->command, action->memory_weight)))
+                {
+                    action->is_outdated = true;
+                    __c_make_graph_push_ready(graph, ready_queue, &ready_count, action_index);
+                    break;
+                }
+
+                if (action->description)
+                {
+                    c_make_log(CMakeLogLevelInfo, "%s\n", action->description);
+                }
+
+                action->process_id = __c_make_command_run(action->command, 0, 0, action->memory_weight, 0);
+
+                if (action->process_id == CMakeInvalidProcessId)
+                {
+                    _c_make_context.did_fail = true;
+                    action->state = CMakeActionStateFailed;
+                    __c_make_graph_skip_dependents(graph, skip_stack, action_index);
+                    result = false;
+                }
+                else
+                {
+                    action->state = CMakeActionStateRunning;
+                    running_count += 1;
+                }
+
+                continue;
+            }
+
+            for (size_t i = 0; i < action->dependent_count; i += 1)
+            {
+                CMakeAction *dependent = graph->items + action->dependents[i];
+
+                if (--dependent->pending_input_count == 0)
+                {
+                    dependent->state = CMakeActionStateReady;
+                    __c_make_graph_push_ready(graph, ready_queue, &ready_count, action->dependents[i]);
+                }
+            }
+        }
+
+        if (!running_count)
+        {
+            break;
+        }
+
+        __c_make_process_wait_any();
+
+        for (size_t i = 0; i < graph->count; i += 1)
+        {
+            CMakeAction *action = graph->items + i;
+
+            if (action->state != CMakeActionStateRunning)
+            {
+                continue;
+            }
+
+            size_t process_index = _c_make_context.process_group.count;
+
+            for (size_t j = 0; j < _c_make_context.process_group.count; j += 1)
+            {
+                if (_c_make_context.process_group.items[j].id == action->process_id)
+                {
+                    process_index = j;
+                    break;
+                }
+            }
+
+            bool succeeded = false;
+
+            if (process_index < _c_make_context.process_group.count)
+            {
+                CMakeProcess *process = _c_make_context.process_group.items + process_index;
+
+                if (!process->exited)
+                {
+                    continue;
+                }
+
+                succeeded = process->succeeded;
+                action->wall_time = process->wall_time;
+                __c_make_process_remove(process_index);
+            }
+
+            running_count -= 1;
+
+            if (succeeded)
+            {
+                action->state = CMakeActionStateFinished;
+
+                for (size_t j = 0; j < action->dependent_count; j += 1)
+                {
+                    CMakeAction *dependent = graph->items + action->dependents[j];
+                    dependent->input_changed = true;
+
+                    if (--dependent->pending_input_count == 0)
+                    {
+                        dependent->state = CMakeActionStateReady;
+                        __c_make_graph_push_ready(graph, ready_queue, &ready_count, action->dependents[j]);
+                    }
+                }
+            }
+            else
+            {
+                action->state = CMakeActionStateFailed;
+                __c_make_graph_skip_dependents(graph, skip_stack, i);
+                result = false;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < graph->count; i += 1)
+    {
+        CMakeAction *action = graph->items + i;
+
+        if ((action->state == CMakeActionStateWaiting) && !_c_make_context.cancelled)
+        {
+            c_make_log(CMakeLogLevelError, "action '%s' could not run because of a dependency cycle\n",
+                       action->description ? action->description : action->command.items[0]);
+            _c_make_context.did_fail = true;
+            result = false;
+        }
+    }
+
+    if (_c_make_context.report_enabled)
+    {
+        __c_make_graph_print_report(graph, order_count, order, __c_make_get_time_in_microseconds() - start_time);
+    }
+
+    if (_c_make_context.build_log.is_recording)
+    {
+        if (!result)
+        {
+            _c_make_context.build_log.is_valid = false;
+        }
+
+        __c_make_build_log_add_graph(&_c_make_context.build_log, graph);
+    }
+
+    if (graph->keep_actions)
+    {
+        for (size_t i = 0; i < graph->count; i += 1)
+        {
+            graph->items[i].input_changed = false;
+            graph->items[i].dependents = 0;
+            graph->items[i].dependent_count = 0;
+            graph->items[i].dependent_allocated = 0;
+        }
+
+        c_make_memory_set_used(&graph->memory, graph_used);
+    }
+    else
+    {
+        __c_make_graph_reset(graph);
+    }
+
+    return result;
+}
+
+// Adds a test that is run by c_make_test_run() or after the test target. The test passes if
+// 'command' exits with 0 within 'timeout' seconds. With a timeout of 0 the 'test_timeout'
+// config value is used, which defaults to 300 seconds.
+C_MAKE_DEF void
+c_make_test_add(const char *name, CMakeCommand command, uint32_t timeout)
+{
+    CMakeTestList *tests = &_c_make_context.tests;
+
+    if (tests->count == tests->allocated)
+    {
+        size_t old_count = tests->allocated;
+        tests->allocated += 64;
+        tests->items = (CMakeTest *) c_make_memory_reallocate(&_c_make_context.permanent_memory, tests->items,
+                                                              old_count * sizeof(*tests->items),
+                                                              tests->allocated * sizeof(*tests->items));
+    }
+
+    CMakeTest *test = tests->items + tests->count;
+    tests->count += 1;
+
+    test->name = c_make_copy_string(&tests->memory, CMakeCString(name)).data;
+    test->command.count = command.count;
+    test->command.allocated = command.count + 1;
+    test->command.items = __c_make_copy_c_string_array(&tests->memory, command.count, command.items);
+    test->timeout = timeout;
+    test->result = CMakeTestResultNotRun;
+    test->process_id = CMakeInvalidProcessId;
+    test->wall_time = 0;
+    test->max_resident_size = 0;
+}
+
+typedef struct CMakeTestOrder
+{
+    // Wall time of the test in earlier runs, 0 if unknown.
+    uint64_t wall_time;
+    size_t index;
+} CMakeTestOrder;
+
+static int
+__c_make_compare_tests(const void *a, const void *b)
+{
+    const CMakeTestOrder *test_a = (const CMakeTestOrder *) a;
+    const CMakeTestOrder *test_b = (const CMakeTestOrder *) b;
+
+    if (test_a->wall_time != test_b->wall_time)
+    {
+        return (test_a->wall_time > test_b->wall_time) ? -1 : 1;
+    }
+
+    return (test_a->index < test_b->index) ? -1 : ((test_a->index > test_b->index) ? 1 : 0);
+}
+
+// Takes the results of all running tests whose process has exited. Returns the number
+// of tests that are still running.
+static size_t
+__c_make_test_collect(CMakeTestList *tests)
+{
+    size_t running_count = 0;
+
+    for (size_t i = tests->run_count; i < tests->count; i += 1)
+    {
+        CMakeTest *test = tests->items + i;
+
+        if (test->result != CMakeTestResultRunning)
+        {
+            continue;
+        }
+
+        size_t index = _c_make_context.process_group.count;
+
+        for (size_t j = 0; j < _c_make_context.process_group.count; j += 1)
+        {
+            if (_c_make_context.process_group.items[j].id == test->process_id)
+            {
+                index = j;
+                break;
+            }
+        }
+
+        if (index == _c_make_context.process_group.count)
+        {
+            test->result = CMakeTestResultFailed;
+            continue;
+        }
+
+        CMakeProcess *process = _c_make_context.process_group.items + index;
+
+        if (!process->exited)
+        {
+            running_count += 1;
+            continue;
+        }
+
+        if (process->succeeded)
+        {
+            test->result = CMakeTestResultPassed;
+        }
+        else if (process->timed_out)
+        {
+            test->result = CMakeTestResultTimedOut;
+        }
+        else if (process->cancelled)
+        {
+            test->result = CMakeTestResultCancelled;
+        }
+        else
+        {
+            test->result = CMakeTestResultFailed;
+        }
+
+        test->wall_time = process->wall_time;
+        test->max_resident_size = process->max_resident_size;
+
+        __c_make_process_remove(index);
+    }
+
+    return running_count;
 }
 
+// Runs all tests that were added since the last call in parallel, with the same job limits
+// as all other commands. Tests that took the longest in earlier runs are started first.
+// With '--shard <i>/<n>' only every n-th test starting with the i-th is run, so that the
+// tests can be split across machines. Returns true if all tests that were run passed.
 C_MAKE_DEF bool
-c_make_file_exists(const char *file_name)
+c_make_test_run(void)
 {
-#if C_MAKE_PLATFORM_WINDOWS
-    CMakeTemporaryMemory temp_memory = c_make_begin_temporary_memory(0, 0);
+    CMakeTestList *tests = &_c_make_context.tests;
 
-    LPWSTR utf16_file_name = c_make_c_string_utf8_to_utf16(temp_memory.memory, file_name);
-    DWORD file_attributes = GetFileAttributes(utf16_file_name);
-
-    c_make_end_temporary_memory(temp_memory);
+    if (tests->run_count == tests->count)
+    {
+        return true;
+    }
 
-    return ((file_attributes != INVALID_FILE_ATTRIBUTES) && !(file_attributes & FILE_ATTRIBUTE_DIRECTORY)) ? true : false;
-#elif C_MAKE_PLATFORM_ANDROID || C_MAKE_PLATFORM_FREEBSD || C_MAKE_PLATFORM_LINUX || C_MAKE_PLATFORM_MACOS
-    bool result = false;
-    struct stat stats;
+    uint64_t default_timeout = 300;
+    CMakeConfigValue test_timeout = c_make_config_get("test_timeout");
 
-    if (!stat(file_name, &stats))
+    if (test_timeout.is_valid)
     {
-        result = S_ISREG(stats.st_mode) ? true : false;
-    }
+        CMakeString value = c_make_string_trim(CMakeCString(test_timeout.val));
+        uint64_t seconds;
 
-    return result;
-#endif
-}
+        if (__c_make_parse_u64(&value, 10, &seconds) && !value.count && seconds)
+        {
+            default_timeout = seconds;
+        }
+        else
+        {
+            c_make_log(CMakeLogLevelWarning, "invalid test_timeout '%s', expected a time in seconds\n", test_timeout.val);
+        }
+    }
 
-C_MAKE_DEF bool
-c_make_directory_exists(const char *directory_name)
-{
-#if C_MAKE_PLATFORM_WINDOWS
     CMakeTemporaryMemory temp_memory = c_make_begin_temporary_memory(0, 0);
 
-    LPWSTR utf16_directory_name = c_make_c_string_utf8_to_utf16(temp_memory.memory, directory_name);
-    DWORD file_attributes = GetFileAttributes(utf16_directory_name);
+    CMakeTestOrder *order = (CMakeTestOrder *) c_make_memory_allocate(temp_memory.memory, (tests->count - tests->run_count) * sizeof(*order));
+    size_t order_count = 0;
 
-    c_make_end_temporary_memory(temp_memory);
+    for (size_t i = tests->run_count; i < tests->count; i += 1)
+    {
+        if (_c_make_context.test_shard_count &&
+            ((i % _c_make_context.test_shard_count) != (_c_make_context.test_shard_index - 1)))
+        {
+            continue;
+        }
 
-    return ((file_attributes != INVALID_FILE_ATTRIBUTES) && (file_attributes & FILE_ATTRIBUTE_DIRECTORY)) ? true : false;
-#elif C_MAKE_PLATFORM_ANDROID || C_MAKE_PLATFORM_FREEBSD || C_MAKE_PLATFORM_LINUX || C_MAKE_PLATFORM_MACOS
-    bool result = false;
-    struct stat stats;
+        CMakeCommandHistory *command_history = __c_make_get_command_history(__c_make_hash_command(tests->items[i].command), false);
 
-    if (!stat(directory_name, &stats))
-    {
-        result = S_ISDIR(stats.st_mode) ? true : false;
+        order[order_count].wall_time = command_history ? command_history->wall_time : 0;
+        order[order_count].index = i;
+        order_count += 1;
     }
 
-    return result;
-#endif
-}
+    qsort(order, order_count, sizeof(*order), __c_make_compare_tests);
 
-C_MAKE_DEF bool
-c_make_create_directory(const char *directory_name)
-{
-#if C_MAKE_PLATFORM_WINDOWS
-    CMakeTemporaryMemory temp_memory = c_make_begin_temporary_memory(0, 0);
+    for (size_t i = 0; i < order_count; i += 1)
+    {
+        CMakeTest *test = tests->items + order[i].index;
+        uint64_t timeout = test->timeout ? test->timeout : default_timeout;
 
-    LPWSTR utf16_directory_name = c_make_c_string_utf8_to_utf16(temp_memory.memory, directory_name);
+        test->process_id = CMakeInvalidProcessId;
 
-    if (!CreateDirectory(utf16_directory_name, 0))
-    {
-        c_make_end_temporary_memory(temp_memory);
+        if (!_c_make_context.cancelled)
+        {
+            test->process_id = __c_make_command_run(test->command, 0, 0, 0, 1000000 * timeout);
+        }
 
-        if (GetLastError() == ERROR_ALREADY_EXISTS)
+        if (test->process_id != CMakeInvalidProcessId)
         {
-            return true;
+            test->result = CMakeTestResultRunning;
+        }
+        else if (_c_make_context.cancelled)
+        {
+            test->result = CMakeTestResultCancelled;
+        }
+        else
+        {
+            c_make_log(CMakeLogLevelError, "could not run test '%s'\n", test->name);
+            test->result = CMakeTestResultFailed;
+            _c_make_context.did_fail = true;
         }
 
-        return false;
+        __c_make_test_collect(tests);
     }
 
-    c_make_end_temporary_memory(temp_memory);
-
-    return true;
-#elif C_MAKE_PLATFORM_ANDROID || C_MAKE_PLATFORM_FREEBSD || C_MAKE_PLATFORM_LINUX || C_MAKE_PLATFORM_MACOS
-    if (!mkdir(directory_name, 0775))
+    while (__c_make_test_collect(tests))
     {
-        return true;
+        __c_make_process_wait_any();
     }
 
-    if (errno == EEXIST)
+    size_t passed_count = 0;
+
+    for (size_t i = 0; i < order_count; i += 1)
     {
-        return true;
+        CMakeTest *test = tests->items + order[i].index;
+
+        if (test->result == CMakeTestResultPassed)
+        {
+            passed_count += 1;
+        }
+        else if (test->result == CMakeTestResultTimedOut)
+        {
+            c_make_log(CMakeLogLevelError, "test '%s' timed out after %.2fs\n", test->name, (double) test->wall_time / 1000000.0);
+        }
+        else if (test->result == CMakeTestResultFailed)
+        {
+            c_make_log(CMakeLogLevelError, "test '%s' failed\n", test->name);
+        }
     }
 
-    return false;
-#endif
+    c_make_log((passed_count == order_count) ? CMakeLogLevelInfo : CMakeLogLevelError, "%llu of %llu tests passed\n",
+               (unsigned long long) passed_count, (unsigned long long) order_count);
+
+    tests->run_count = tests->count;
+
+    c_make_end_temporary_memory(temp_memory);
+
+    return passed_count == order_count;
 }
 
-C_MAKE_DEF bool
-c_make_create_directory_recursively(const char *directory_name)
+#if !defined(C_MAKE_NO_ENTRY_POINT)
+
+static bool
+__c_make_store_history(void)
 {
-#if C_MAKE_PLATFORM_WINDOWS
+    CMakeHistory *history = &_c_make_context.history;
+
+    if (!history->is_dirty || !_c_make_context.build_path)
+    {
+        return true;
+    }
+
     CMakeTemporaryMemory temp_memory = c_make_begin_temporary_memory(0, 0);
 
-    LPWSTR utf16_directory_name = c_make_c_string_utf8_to_utf16(temp_memory.memory, directory_name);
-    DWORD file_attributes = GetFileAttributes(utf16_directory_name);
+    CMakeString content;
+    content.count = 0;
+    content.data = (char *) c_make_memory_allocate(temp_memory.memory, (history->count * 96) + 1);
 
-    if ((file_attributes == INVALID_FILE_ATTRIBUTES) || !(file_attributes & FILE_ATTRIBUTE_DIRECTORY))
+    for (size_t i = 0; i < history->count; i += 1)
     {
-        CMakeString parent_string = CMakeCString(directory_name);
-        c_make_string_split_right_path_separator(&parent_string);
+        CMakeCommandHistory *command = history->items + i;
 
-        if (parent_string.count > 0)
+        if (command->max_resident_size)
         {
-            const char *parent_directory = c_make_string_to_c_string_with_memory(temp_memory.memory, parent_string);
-
-            if (!c_make_create_directory_recursively(parent_directory))
-            {
-                c_make_end_temporary_memory(temp_memory);
-                return false;
-            }
+            content.count += sprintf(content.data + content.count, "m %" CMakeStringFmt " %llu\n",
+                                     CMakeStringArg(command->command_hash), (unsigned long long) command->max_resident_size);
         }
 
-        if (!CreateDirectory(utf16_directory_name, 0) && (GetLastError() != ERROR_ALREADY_EXISTS))
+        if (command->wall_time)
         {
-            c_make_end_temporary_memory(temp_memory);
-            return false;
+            content.count += sprintf(content.data + content.count, "t %" CMakeStringFmt " %llu\n",
+                                     CMakeStringArg(command->command_hash), (unsigned long long) command->wall_time);
         }
     }
 
-    c_make_end_temporary_memory(temp_memory);
-#elif C_MAKE_PLATFORM_ANDROID || C_MAKE_PLATFORM_FREEBSD || C_MAKE_PLATFORM_LINUX || C_MAKE_PLATFORM_MACOS
-    struct stat stats;
+    bool result = c_make_write_entire_file(__c_make_get_history_file_name(temp_memory.memory), content);
 
-    if (stat(directory_name, &stats) || S_ISDIR(stats.st_mode))
+    if (!result)
     {
-        CMakeString parent_string = CMakeCString(directory_name);
-        c_make_string_split_right_path_separator(&parent_string);
+        c_make_log(CMakeLogLevelError, "could not write history\n");
+    }
 
-        if (parent_string.count > 0)
-        {
-            CMakeTemporaryMemory temp_memory = c_make_begin_temporary_memory(0, 0);
+    c_make_end_temporary_memory(temp_memory);
 
-            const char *parent_directory = c_make_string_to_c_string_with_memory(temp_memory.memory, parent_string);
-            bool result = c_make_create_directory_recursively(parent_directory);
+    history->is_dirty = false;
 
-            c_make_end_temporary_memory(temp_memory);
+    return result;
+}
 
-            if (!result)
+#define __C_MAKE_BUILD_LOG_MAGIC 0x4c424d43 // 'CMBL'
+#define __C_MAKE_BUILD_LOG_VERSION 1
+
+static const char *
+__c_make_get_build_log_file_name(CMakeMemory *memory)
+{
+    return c_make_c_string_path_concat_with_memory(memory, _c_make_context.build_path, "c_make_build_log.bin");
+}
+
+// The key of a build log covers everything that can change the build graph without changing
+// one of its files: the config and the build script. It is 0 if one of them can't be read.
+static uint64_t
+__c_make_get_build_log_key(const char *config_file_name, size_t file_count, const char **files)
+{
+    uint64_t result = 0;
+    size_t public_used = c_make_memory_get_used(&_c_make_context.public_memory);
+
+    CMakeString content;
+
+    if (c_make_read_entire_file(config_file_name, &content))
+    {
+        uint32_t version = __C_MAKE_BUILD_LOG_VERSION;
+
+        result = c_make_hash_data(0, &version, sizeof(version));
+        result = c_make_hash_data(result, content.data, content.count);
+
+        for (size_t i = 0; i < file_count; i += 1)
+        {
+            CMakeFileStatus status;
+            __c_make_stat_file(&status, files[i]);
+
+            if (status.error)
             {
-                return false;
+                c_make_memory_set_used(&_c_make_context.public_memory, public_used);
+                return 0;
             }
+
+            result = c_make_hash_data(result, files[i], c_make_get_c_string_length(files[i]) + 1);
+            result = c_make_hash_data(result, &status.size, sizeof(status.size));
+            result = c_make_hash_data(result, &status.modification_time, sizeof(status.modification_time));
         }
 
-        if (mkdir(directory_name, 0775) && (errno != EEXIST))
+        if (!result)
         {
-            return false;
+            result = 1;
         }
     }
-#endif
 
-    return true;
+    c_make_memory_set_used(&_c_make_context.public_memory, public_used);
+
+    return result;
 }
 
-C_MAKE_DEF bool
-c_make_read_entire_file(const char *file_name, CMakeString *content)
+static void
+__c_make_build_log_write(CMakeString *content, const void *data, size_t size)
 {
-#if C_MAKE_PLATFORM_WINDOWS
-    CMakeTemporaryMemory temp_memory = c_make_begin_temporary_memory(0, 0);
-
-    LPWSTR utf16_file_name = c_make_c_string_utf8_to_utf16(temp_memory.memory, file_name);
-    HANDLE file = CreateFile(utf16_file_name, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, 0, 0);
-
-    c_make_end_temporary_memory(temp_memory);
+    memcpy(content->data + content->count, data, size);
+    content->count += size;
+}
 
-    if (file == INVALID_HANDLE_VALUE)
+static bool
+__c_make_build_log_read(CMakeString *content, void *data, size_t size)
+{
+    if (content->count < size)
     {
         return false;
     }
 
-    LARGE_INTEGER file_size;
+    memcpy(data, content->data, size);
+    content->count -= size;
+    content->data += size;
 
-    if (!GetFileSizeEx(file, &file_size))
+    return true;
+}
+
+// The build log is a binary file in native byte order:
+//
+//   u32 magic, u32 version, u64 key
+//   u64 file count, per file: u64 size, u64 modification time, u32 path length, path, 0
+//   u64 action count, per action: u64 command hash, u32 input count, u32 output count,
+//                                 u32 file index of every input and output
+//
+// The build is up to date if the key matches and all files still have the recorded size
+// and modification time. The files are checked in one pass over the file table, without
+// running the build script or looking at a single action. The key covers the build script
+// and the config, so the commands can't have changed either. A key of 0 never matches,
+// such a log only keeps the command hashes of the outputs for the next build.
+static bool
+__c_make_build_log_is_up_to_date(uint64_t key)
+{
+    if (!key)
     {
-        CloseHandle(file);
         return false;
     }
 
+    bool result = false;
     size_t public_used = c_make_memory_get_used(&_c_make_context.public_memory);
 
-    content->count = file_size.QuadPart;
-    content->data = (char *) c_make_memory_allocate(&_c_make_context.public_memory, content->count + 1);
+    CMakeString content;
 
-    size_t index = 0;
+    if (c_make_read_entire_file(__c_make_get_build_log_file_name(&_c_make_context.public_memory), &content))
+    {
+        uint32_t magic = 0, version = 0;
+        uint64_t log_key = 0, file_count = 0;
 
-    while (index < content->count)
+        if (__c_make_build_log_read(&content, &magic, sizeof(magic)) && (magic == __C_MAKE_BUILD_LOG_MAGIC) &&
+            __c_make_build_log_read(&content, &version, sizeof(version)) && (version == __C_MAKE_BUILD_LOG_VERSION) &&
+            __c_make_build_log_read(&content, &log_key, sizeof(log_key)) && (log_key == key) &&
+            __c_make_build_log_read(&content, &file_count, sizeof(file_count)))
+        {
+            result = true;
+
+            for (uint64_t i = 0; result && (i < file_count); i += 1)
+            {
+                uint64_t size, modification_time;
+                uint32_t path_length;
+
+                if (!__c_make_build_log_read(&content, &size, sizeof(size)) ||
+                    !__c_make_build_log_read(&content, &modification_time, sizeof(modification_time)) ||
+                    !__c_make_build_log_read(&content, &path_length, sizeof(path_length)) ||
+                    (content.count <= path_length) || content.data[path_length])
+                {
+                    result = false;
+                    break;
+                }
+
+                CMakeFileStatus status;
+                __c_make_stat_file(&status, content.data);
+
+                result = !status.error && (status.size == size) && (status.modification_time == modification_time);
+
+                content.count -= path_length + 1;
+                content.data += path_length + 1;
+            }
+        }
+    }
+
+    c_make_memory_set_used(&_c_make_context.public_memory, public_used);
+
+    return result;
+}
+
+// Loads the command hash of every output from the log of the previous build.
+static bool
+__c_make_build_log_load_previous(CMakeBuildLog *build_log, CMakeString content)
+{
+    uint32_t magic = 0, version = 0;
+    uint64_t key = 0, file_count = 0, action_count = 0;
+
+    if (!__c_make_build_log_read(&content, &magic, sizeof(magic)) || (magic != __C_MAKE_BUILD_LOG_MAGIC) ||
+        !__c_make_build_log_read(&content, &version, sizeof(version)) || (version != __C_MAKE_BUILD_LOG_VERSION) ||
+        !__c_make_build_log_read(&content, &key, sizeof(key)) ||
+        !__c_make_build_log_read(&content, &file_count, sizeof(file_count)) ||
+        (file_count > (content.count / 21)))
     {
-        DWORD bytes_read = 0;
-        if (!ReadFile(file, content->data + index, content->count - index, &bytes_read, 0))
+        return false;
+    }
+
+    CMakeString *paths = (CMakeString *) c_make_memory_allocate(&_c_make_context.public_memory, file_count * sizeof(*paths));
+
+    for (uint64_t i = 0; i < file_count; i += 1)
+    {
+        uint64_t size, modification_time;
+        uint32_t path_length;
+
+        if (!__c_make_build_log_read(&content, &size, sizeof(size)) ||
+            !__c_make_build_log_read(&content, &modification_time, sizeof(modification_time)) ||
+            !__c_make_build_log_read(&content, &path_length, sizeof(path_length)) ||
+            (content.count <= path_length) || content.data[path_length])
         {
-            c_make_memory_set_used(&_c_make_context.public_memory, public_used);
-            CloseHandle(file);
             return false;
         }
 
-        index += bytes_read;
+        paths[i] = c_make_make_string(content.data, path_length);
+
+        content.count -= path_length + 1;
+        content.data += path_length + 1;
     }
 
-    content->data[content->count] = 0;
+    if (!__c_make_build_log_read(&content, &action_count, sizeof(action_count)))
+    {
+        return false;
+    }
 
-    CloseHandle(file);
-    return true;
-#elif C_MAKE_PLATFORM_ANDROID || C_MAKE_PLATFORM_FREEBSD || C_MAKE_PLATFORM_LINUX || C_MAKE_PLATFORM_MACOS
-    int fd = open(file_name, O_RDONLY);
+    build_log->previous_outputs = (const char **) c_make_memory_allocate(&build_log->memory, file_count * sizeof(*build_log->previous_outputs));
+    build_log->previous_command_hashes = (uint64_t *) c_make_memory_allocate(&build_log->memory, file_count * sizeof(*build_log->previous_command_hashes));
 
-    if (fd >= 0)
+    for (uint64_t i = 0; i < action_count; i += 1)
     {
-        struct stat stats;
+        uint64_t command_hash;
+        uint32_t input_count, output_count;
 
-        if (fstat(fd, &stats) < 0)
+        if (!__c_make_build_log_read(&content, &command_hash, sizeof(command_hash)) ||
+            !__c_make_build_log_read(&content, &input_count, sizeof(input_count)) ||
+            !__c_make_build_log_read(&content, &output_count, sizeof(output_count)) ||
+            ((content.count / sizeof(uint32_t)) < ((uint64_t) input_count + output_count)))
         {
-            close(fd);
             return false;
         }
 
-        size_t public_used = c_make_memory_get_used(&_c_make_context.public_memory);
-
-        content->count = stats.st_size;
-        content->data = (char *) c_make_memory_allocate(&_c_make_context.public_memory, content->count + 1);
-
-        size_t index = 0;
+        content.count -= input_count * sizeof(uint32_t);
+        content.data += input_count * sizeof(uint32_t);
 
-        while (index < content->count)
+        for (uint32_t j = 0; j < output_count; j += 1)
         {
-            ssize_t read_bytes = read(fd, content->data + index, content->count - index);
+            uint32_t file_index;
+            __c_make_build_log_read(&content, &file_index, sizeof(file_index));
 
-            if (read_bytes < 0)
+            if (file_index >= file_count)
             {
-                c_make_memory_set_used(&_c_make_context.public_memory, public_used);
-                close(fd);
                 return false;
             }
 
-            index += read_bytes;
+            if (__c_make_map_find(&build_log->previous_output_map, paths[file_index]) >= build_log->previous_output_count)
+            {
+                CMakeString path = c_make_copy_string(&build_log->memory, paths[file_index]);
+
+                build_log->previous_outputs[build_log->previous_output_count] = path.data;
+                build_log->previous_command_hashes[build_log->previous_output_count] = command_hash;
+                __c_make_map_insert(&build_log->memory, &build_log->previous_output_map, path, build_log->previous_output_count);
+                build_log->previous_output_count += 1;
+            }
         }
+    }
 
-        content->data[content->count] = 0;
+    return true;
+}
 
-        close(fd);
-        return true;
+// Starts recording the build log. The old log is written back with a key of 0 first, so that
+// a failed or interrupted build never leaves a log behind that claims to be up to date, but
+// the next build still knows the commands of all outputs.
+static void
+__c_make_begin_build_log(uint64_t key)
+{
+    CMakeBuildLog *build_log = &_c_make_context.build_log;
+
+    size_t public_used = c_make_memory_get_used(&_c_make_context.public_memory);
+
+    const char *build_log_file_name = __c_make_get_build_log_file_name(&_c_make_context.public_memory);
+
+    CMakeString content;
+
+    if (c_make_read_entire_file(build_log_file_name, &content) && __c_make_build_log_load_previous(build_log, content))
+    {
+        uint64_t no_key = 0;
+        memcpy(content.data + (2 * sizeof(uint32_t)), &no_key, sizeof(no_key));
     }
     else
     {
-        return false;
+        build_log->previous_output_count = 0;
+        content = CMakeStringLiteral("");
     }
-#endif
+
+    if (c_make_write_entire_file(build_log_file_name, content))
+    {
+        CMakeFileStatus status;
+        __c_make_stat_file(&status, build_log_file_name);
+
+        if (!status.error)
+        {
+            build_log->is_recording = true;
+            build_log->is_valid = (key != 0);
+            build_log->key = key;
+            build_log->start_time = status.modification_time;
+        }
+    }
+
+    c_make_memory_set_used(&_c_make_context.public_memory, public_used);
 }
 
-C_MAKE_DEF bool
-c_make_write_entire_file(const char *file_name, CMakeString content)
+static bool
+__c_make_store_build_log(void)
 {
-#if C_MAKE_PLATFORM_WINDOWS
-    CMakeTemporaryMemory temp_memory = c_make_begin_temporary_memory(0, 0);
+    CMakeBuildLog *build_log = &_c_make_context.build_log;
 
-    LPWSTR utf16_file_name = c_make_c_string_utf8_to_utf16(temp_memory.memory, file_name);
-    HANDLE file = CreateFile(utf16_file_name, GENERIC_WRITE, 0, 0,
-                             CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0);
+    if (!build_log->is_recording)
+    {
+        return true;
+    }
 
-    c_make_end_temporary_memory(temp_memory);
+    build_log->is_recording = false;
 
-    if (file == INVALID_HANDLE_VALUE)
+    // The log of a build that failed or did something the log can't check gets a key of 0.
+    // It is still written, because it has the command hashes for the next build.
+    uint64_t key = (build_log->is_valid && !_c_make_context.did_fail) ? build_log->key : 0;
+
+    CMakeTemporaryMemory temp_memory = c_make_begin_temporary_memory(0, 0);
+
+    bool *is_output = (bool *) c_make_memory_allocate(temp_memory.memory, (build_log->file_count + build_log->previous_output_count) * sizeof(bool));
+
+    for (size_t i = 0; i < (build_log->file_count + build_log->previous_output_count); i += 1)
     {
-        return false;
+        is_output[i] = false;
     }
 
-    while (content.count)
+    for (size_t i = 0; i < build_log->action_count; i += 1)
     {
-        DWORD bytes_written = 0;
-        if (!WriteFile(file, content.data, content.count, &bytes_written, 0))
+        CMakeBuildLogAction *action = build_log->actions + i;
+
+        for (size_t j = 0; j < action->output_count; j += 1)
         {
-            CloseHandle(file);
-            return false;
+            is_output[action->files[action->input_count + j]] = true;
         }
-
-        content.data += bytes_written;
-        content.count -= bytes_written;
     }
 
-    CloseHandle(file);
-    return true;
-#elif C_MAKE_PLATFORM_ANDROID || C_MAKE_PLATFORM_FREEBSD || C_MAKE_PLATFORM_LINUX || C_MAKE_PLATFORM_MACOS
-    int fd = open(file_name, O_WRONLY | O_TRUNC | O_CREAT, 0664);
-
-    if (fd >= 0)
+    // Only a complete build decides which outputs still exist. Otherwise the outputs of
+    // actions that never got into a graph keep their command hashes.
+    if (!key)
     {
-        while (content.count)
+        for (size_t i = 0; i < build_log->previous_output_count; i += 1)
         {
-            ssize_t written_bytes = write(fd, content.data, content.count);
+            uint32_t file_index = __c_make_build_log_add_file(build_log, build_log->previous_outputs[i]);
 
-            if (written_bytes < 0)
+            if (!is_output[file_index])
             {
-                close(fd);
-                return false;
+                CMakeBuildLogAction *action = __c_make_build_log_add_action(build_log, build_log->previous_command_hashes[i], 0, 1);
+                action->files[0] = file_index;
+                is_output[file_index] = true;
             }
-
-            content.data += written_bytes;
-            content.count -= written_bytes;
         }
-
-        close(fd);
-        return true;
     }
-    else
+
+    size_t content_size = 24 + 8;
+
+    for (size_t i = 0; i < build_log->action_count; i += 1)
     {
-        return false;
+        CMakeBuildLogAction *action = build_log->actions + i;
+        content_size += 16 + (4 * (action->input_count + action->output_count));
     }
-#endif
-}
-
-C_MAKE_DEF bool
-c_make_copy_file(const char *src_file_name, const char *dst_file_name)
-{
-#if C_MAKE_PLATFORM_WINDOWS
-    CMakeTemporaryMemory temp_memory = c_make_begin_temporary_memory(0, 0);
 
-    LPWSTR utf16_src_file_name = c_make_c_string_utf8_to_utf16(temp_memory.memory, src_file_name);
-    LPWSTR utf16_dst_file_name = c_make_c_string_utf8_to_utf16(temp_memory.memory, dst_file_name);
+    CMakeFileStatus *statuses = (CMakeFileStatus *) c_make_memory_allocate(temp_memory.memory, build_log->file_count * sizeof(CMakeFileStatus));
 
-    if (!CopyFile(utf16_src_file_name, utf16_dst_file_name, FALSE))
+    for (size_t i = 0; i < build_log->file_count; i += 1)
     {
-        c_make_end_temporary_memory(temp_memory);
-        return false;
+        CMakeFileStatus *status = statuses + i;
+        __c_make_stat_file(status, build_log->files[i]);
+
+        // A missing file or an input that changed while the build was running can't be
+        // compared against the next build.
+        if (status->error || (!is_output[i] && (status->modification_time >= build_log->start_time)))
+        {
+            key = 0;
+        }
+
+        content_size += 21 + c_make_get_c_string_length(build_log->files[i]);
     }
 
-    c_make_end_temporary_memory(temp_memory);
+    CMakeString content;
+    content.count = 0;
+    content.data = (char *) c_make_memory_allocate(temp_memory.memory, content_size);
 
-    return true;
-#elif C_MAKE_PLATFORM_ANDROID || C_MAKE_PLATFORM_FREEBSD || C_MAKE_PLATFORM_LINUX || C_MAKE_PLATFORM_MACOS
-    int src_fd = open(src_file_name, O_RDONLY);
+    uint32_t magic = __C_MAKE_BUILD_LOG_MAGIC;
+    uint32_t version = __C_MAKE_BUILD_LOG_VERSION;
+    uint64_t file_count = build_log->file_count;
+    uint64_t action_count = build_log->action_count;
 
-    if (src_fd < 0)
+    __c_make_build_log_write(&content, &magic, sizeof(magic));
+    __c_make_build_log_write(&content, &version, sizeof(version));
+    __c_make_build_log_write(&content, &key, sizeof(key));
+    __c_make_build_log_write(&content, &file_count, sizeof(file_count));
+
+    for (size_t i = 0; i < build_log->file_count; i += 1)
     {
-        c_make_log(CMakeLogLevelError, "could not open file '%s': %s\n", src_file_name, strerror(errno));
-        return false;
+        uint32_t path_length = (uint32_t) c_make_get_c_string_length(build_log->files[i]);
+
+        __c_make_build_log_write(&content, &statuses[i].size, sizeof(statuses[i].size));
+        __c_make_build_log_write(&content, &statuses[i].modification_time, sizeof(statuses[i].modification_time));
+        __c_make_build_log_write(&content, &path_length, sizeof(path_length));
+        __c_make_build_log_write(&content, build_log->files[i], path_length + 1);
     }
 
-    struct stat stats;
+    __c_make_build_log_write(&content, &action_count, sizeof(action_count));
 
-    if (fstat(src_fd, &stats) < 0)
+    for (size_t i = 0; i < build_log->action_count; i += 1)
     {
-        c_make_log(CMakeLogLevelError, "could not get file stats on '%s': %s\n", src_file_name, strerror(errno));
-        close(src_fd);
-        return false;
-    }
+        CMakeBuildLogAction *action = build_log->actions + i;
+        uint32_t input_count = (uint32_t) action->input_count;
+        uint32_t output_count = (uint32_t) action->output_count;
 
-    size_t src_file_size = stats.st_size;
+        __c_make_build_log_write(&content, &action->command_hash, sizeof(action->command_hash));
+        __c_make_build_log_write(&content, &input_count, sizeof(input_count));
+        __c_make_build_log_write(&content, &output_count, sizeof(output_count));
+        __c_make_build_log_write(&content, action->files, (input_count + output_count) * sizeof(uint32_t));
+    }
 
-    int dst_fd = open(dst_file_name, O_WRONLY | O_TRUNC | O_CREAT, stats.st_mode);
+    bool result = c_make_write_entire_file(__c_make_get_build_log_file_name(temp_memory.memory), content);
 
-    if (dst_fd < 0)
+    if (!result)
     {
-        c_make_log(CMakeLogLevelError, "could not create file '%s': %s\n", dst_file_name, strerror(errno));
-        close(src_fd);
-        return false;
+        c_make_log(CMakeLogLevelError, "could not write build log\n");
     }
 
-    CMakeTemporaryMemory temp_memory = c_make_begin_temporary_memory(0, 0);
+    c_make_end_temporary_memory(temp_memory);
 
-    void *copy_buffer = c_make_memory_allocate(temp_memory.memory, 4096);
+    return result;
+}
 
-    size_t index = 0;
+static size_t
+__c_make_json_escape(char *dst, const char *str)
+{
+    size_t count = 0;
 
-    while (index < src_file_size)
+    for (; *str; str += 1)
     {
-        size_t remaining_size = src_file_size - index;
-        size_t size_to_read = 4096;
+        unsigned char c = (unsigned char) *str;
 
-        if (remaining_size < size_to_read)
+        if ((c == '"') || (c == '\\'))
         {
-            size_to_read = remaining_size;
+            dst[count++] = '\\';
+            dst[count++] = c;
         }
-
-        ssize_t read_bytes = read(src_fd, copy_buffer, size_to_read);
-
-        if ((read_bytes < 0) || ((size_t) read_bytes != size_to_read))
+        else if (c < 0x20)
         {
-            c_make_end_temporary_memory(temp_memory);
-            close(src_fd);
-            close(dst_fd);
-            return false;
+            count += sprintf(dst + count, "\\u%04x", c);
         }
-
-        ssize_t written_bytes = write(dst_fd, copy_buffer, size_to_read);
-
-        if ((written_bytes < 0) || ((size_t) written_bytes != size_to_read))
+        else
         {
-            c_make_end_temporary_memory(temp_memory);
-            close(src_fd);
-            close(dst_fd);
-            return false;
+            dst[count++] = c;
         }
-
-        index += size_to_read;
     }
 
-    c_make_end_temporary_memory(temp_memory);
-
-    close(dst_fd);
-    close(src_fd);
-    return true;
-#endif
+    return count;
 }
 
-C_MAKE_DEF bool
-c_make_rename_file(const char *old_file_name, const char *new_file_name)
+// Writes all finished commands as a trace that can be opened with chrome://tracing or
+// https://ui.perfetto.dev. Commands that ran at the same time are put on separate rows.
+static bool
+__c_make_store_trace(void)
 {
-#if C_MAKE_PLATFORM_WINDOWS
-    CMakeTemporaryMemory temp_memory = c_make_begin_temporary_memory(0, 0);
+    CMakeTrace *trace = &_c_make_context.trace;
 
-    LPWSTR utf16_old_file_name = c_make_c_string_utf8_to_utf16(temp_memory.memory, old_file_name);
-    LPWSTR utf16_new_file_name = c_make_c_string_utf8_to_utf16(temp_memory.memory, new_file_name);
+    if (!_c_make_context.trace_enabled || !_c_make_context.build_path)
+    {
+        return true;
+    }
 
-    bool result =
-        MoveFileEx(utf16_old_file_name, utf16_new_file_name, MOVEFILE_REPLACE_EXISTING) ? true : false;
+    CMakeTemporaryMemory temp_memory = c_make_begin_temporary_memory(0, 0);
 
-    c_make_end_temporary_memory(temp_memory);
+    size_t content_size = 64;
 
-    return result;
-#elif C_MAKE_PLATFORM_ANDROID || C_MAKE_PLATFORM_FREEBSD || C_MAKE_PLATFORM_LINUX || C_MAKE_PLATFORM_MACOS
-    if (rename(old_file_name, new_file_name))
+    for (size_t i = 0; i < trace->count; i += 1)
     {
-        return false;
+        content_size += 6 * (c_make_get_c_string_length(trace->items[i].name) +
+                             c_make_get_c_string_length(trace->items[i].command)) + 384;
     }
 
-    return true;
-#endif
-}
+    CMakeString content;
+    content.count = 0;
+    content.data = (char *) c_make_memory_allocate(temp_memory.memory, content_size + 1);
 
-C_MAKE_DEF bool
-c_make_delete_file(const char *file_name)
-{
-#if C_MAKE_PLATFORM_WINDOWS
-    CMakeTemporaryMemory temp_memory = c_make_begin_temporary_memory(0, 0);
+    content.count += sprintf(content.data + content.count, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
 
-    LPWSTR utf16_file_name = c_make_c_string_utf8_to_utf16(temp_memory.memory, file_name);
+    for (size_t i = 0; i < trace->count; i += 1)
+    {
+        CMakeTraceEvent *event = trace->items + i;
 
-    bool result = DeleteFile(utf16_file_name) ? true : false;
+        content.count += sprintf(content.data + content.count, "{\"name\":\"");
+        content.count += __c_make_json_escape(content.data + content.count, event->name);
+        content.count += sprintf(content.data + content.count,
+                                 "\",\"cat\":\"command\",\"ph\":\"X\",\"pid\":1,\"tid\":%llu,\"ts\":%llu,\"dur\":%llu,"
+                                 "\"args\":{\"status\":\"%s %d\",\"user_time_ms\":%.3f,\"system_time_ms\":%.3f,"
+                                 "\"max_rss_kb\":%llu,\"command\":\"",
+                                 (unsigned long long) event->slot, (unsigned long long) event->start_time,
+                                 (unsigned long long) (event->end_time - event->start_time), event->status, event->code,
+                                 (double) event->user_time / 1000.0, (double) event->system_time / 1000.0,
+                                 (unsigned long long) event->max_resident_size);
+        content.count += __c_make_json_escape(content.data + content.count, event->command);
+        content.count += sprintf(content.data + content.count, "\"}}%s\n", ((i + 1) < trace->count) ? "," : "");
+    }
 
-    if (!result && (GetLastError() == ERROR_FILE_NOT_FOUND))
+    content.count += sprintf(content.data + content.count, "]}\n");
+
+    const char *trace_file_name = c_make_c_string_path_concat_with_memory(temp_memory.memory, _c_make_context.build_path, "c_make_trace.json");
+    bool result = c_make_write_entire_file(trace_file_name, content);
+
+    if (result)
     {
-        result = true;
+        c_make_log(CMakeLogLevelInfo, "trace written to '%s'\n", trace_file_name);
+    }
+    else
+    {
+        c_make_log(CMakeLogLevelError, "could not write trace '%s'\n", trace_file_name);
     }
 
     c_make_end_temporary_memory(temp_memory);
 
     return result;
-#elif C_MAKE_PLATFORM_ANDROID || C_MAKE_PLATFORM_FREEBSD || C_MAKE_PLATFORM_LINUX || C_MAKE_PLATFORM_MACOS
-    if (unlink(file_name))
-    {
-        if (errno == ENOENT)
-        {
-            return true;
-        }
+}
 
-        return false;
+static const char *
+__c_make_get_test_result_name(CMakeTestResult result)
+{
+    switch (result)
+    {
+        case CMakeTestResultNotRun:    return "not run";
+        case CMakeTestResultRunning:   return "running";
+        case CMakeTestResultPassed:    return "passed";
+        case CMakeTestResultFailed:    return "failed";
+        case CMakeTestResultTimedOut:  return "timed out";
+        case CMakeTestResultCancelled: return "cancelled";
     }
 
-    return true;
-#endif
+    return "";
 }
 
-C_MAKE_DEF bool
-c_make_has_slash_or_backslash(const char *path)
+// Writes the results of all tests that were run to 'c_make_test_report.json' in the build
+// directory, so that a CI can collect the reports of all shards.
+static bool
+__c_make_store_test_report(void)
 {
-    if (path)
+    CMakeTestList *tests = &_c_make_context.tests;
+
+    if (!tests->count || !_c_make_context.build_path)
     {
-        while (*path)
-        {
-            if ((*path == '/') || (*path == '\\'))
-            {
-                return true;
-            }
+        return true;
+    }
 
-            path += 1;
-        }
+    CMakeTemporaryMemory temp_memory = c_make_begin_temporary_memory(0, 0);
 
-        return false;
-    }
-    else
+    size_t content_size = 128;
+
+    for (size_t i = 0; i < tests->count; i += 1)
     {
-        return false;
+        CMakeTest *test = tests->items + i;
+
+        content_size += 6 * c_make_get_c_string_length(test->name) + 256;
+
+        for (size_t j = 0; j < test->command.count; j += 1)
+        {
+            content_size += 6 * c_make_get_c_string_length(test->command.items[j]) + 1;
+        }
     }
-}
 
-C_MAKE_DEF CMakeString
-c_make_get_environment_variable(CMakeMemory *memory, const char *variable_name)
-{
-    CMakeString result = { 0, 0 };
+    CMakeString content;
+    content.count = 0;
+    content.data = (char *) c_make_memory_allocate(temp_memory.memory, content_size + 1);
 
-#if C_MAKE_PLATFORM_WINDOWS
-    CMakeTemporaryMemory temp_memory = c_make_begin_temporary_memory(1, &memory);
+    content.count += sprintf(content.data + content.count, "{\"shard\":\"%llu/%llu\",\"tests\":[\n",
+                             (unsigned long long) (_c_make_context.test_shard_count ? _c_make_context.test_shard_index : 1),
+                             (unsigned long long) (_c_make_context.test_shard_count ? _c_make_context.test_shard_count : 1));
 
-    wchar_t *utf16_variable_name = c_make_c_string_utf8_to_utf16(temp_memory.memory, variable_name);
-    DWORD variable_size = GetEnvironmentVariable(utf16_variable_name, 0, 0);
+    bool is_first = true;
 
-    if (variable_size > 0)
+    for (size_t i = 0; i < tests->count; i += 1)
     {
-        wchar_t *variable = (wchar_t *) c_make_memory_allocate(temp_memory.memory, sizeof(wchar_t) * variable_size);
-        DWORD ret = GetEnvironmentVariable(utf16_variable_name, variable, variable_size);
+        CMakeTest *test = tests->items + i;
 
-        if ((ret > 0) && (ret < variable_size))
+        if (test->result == CMakeTestResultNotRun)
         {
-            result = c_make_string_utf16_to_utf8(memory, variable, ret);
+            continue;
         }
+
+        CMakeString command = c_make_command_to_string(temp_memory.memory, test->command);
+
+        content.count += sprintf(content.data + content.count, "%s{\"name\":\"", is_first ? "" : ",\n");
+        content.count += __c_make_json_escape(content.data + content.count, test->name);
+        content.count += sprintf(content.data + content.count, "\",\"result\":\"%s\",\"wall_time_ms\":%.3f,\"max_rss_kb\":%llu,\"command\":\"",
+                                 __c_make_get_test_result_name(test->result), (double) test->wall_time / 1000.0,
+                                 (unsigned long long) test->max_resident_size);
+        content.count += __c_make_json_escape(content.data + content.count, command.count ? command.data : "");
+        content.count += sprintf(content.data + content.count, "\"}");
+
+        is_first = false;
     }
 
-    c_make_end_temporary_memory(temp_memory);
-#elif C_MAKE_PLATFORM_ANDROID || C_MAKE_PLATFORM_FREEBSD || C_MAKE_PLATFORM_LINUX || C_MAKE_PLATFORM_MACOS
-    (void) memory;
+    content.count += sprintf(content.data + content.count, "\n]}\n");
 
-    char *variable = getenv(variable_name);
+    const char *report_file_name = c_make_c_string_path_concat_with_memory(temp_memory.memory, _c_make_context.build_path, "c_make_test_report.json");
+    bool result = c_make_write_entire_file(report_file_name, content);
 
-    if (variable)
+    if (result)
     {
-        result = CMakeCString(variable);
+        c_make_log(CMakeLogLevelInfo, "test report written to '%s'\n", report_file_name);
     }
-#endif
+    else
+    {
+        c_make_log(CMakeLogLevelError, "could not write test report '%s'\n", report_file_name);
+    }
+
+    c_make_end_temporary_memory(temp_memory);
 
     return result;
 }
 
-C_MAKE_DEF const char *
-c_make_find_program(const char *program_name)
-{
-    CMakeTemporaryMemory temp_memory = c_make_begin_temporary_memory(0, 0);
-    CMakeString paths = c_make_get_environment_variable(temp_memory.memory, "PATH");
+#if !defined(C_MAKE_STATIC)
 
-    size_t public_used = c_make_memory_get_used(&_c_make_context.public_memory);
-    size_t memory_used = c_make_memory_get_used(temp_memory.memory);
+// The implementation of c_make.h is compiled once into an object file next to the
+// c_make executable. The name of the object contains a hash of the header, the
+// compiler and its flags, so that an outdated object is never linked. Objects of
+// older headers are deleted. Returns 0 if the object could not be compiled.
+static const char *
+__c_make_get_implementation_object(CMakeCommand *command, const char *header_file)
+{
+    uint64_t header_hash;
 
-    while (paths.count)
+    if (!c_make_hash_file(header_file, &header_hash))
     {
-#if C_MAKE_PLATFORM_WINDOWS
-        char *path = c_make_string_to_c_string_with_memory(temp_memory.memory, c_make_string_split_left(&paths, ';'));
-#elif C_MAKE_PLATFORM_ANDROID || C_MAKE_PLATFORM_FREEBSD || C_MAKE_PLATFORM_LINUX || C_MAKE_PLATFORM_MACOS
-        char *path = c_make_string_to_c_string_with_memory(temp_memory.memory, c_make_string_split_left(&paths, ':'));
-#endif
-
-        char *full_path = c_make_c_string_path_concat(path, program_name);
+        return 0;
+    }
 
-        c_make_memory_set_used(temp_memory.memory, memory_used);
+    size_t base_count = command->count;
+    bool is_msvc = c_make_compiler_is_msvc(command->items[0]);
 
-        // TODO: is executable?
-        if (c_make_file_exists(full_path))
-        {
-            c_make_end_temporary_memory(temp_memory);
-            return full_path;
-        }
+    uint64_t hash = c_make_hash_data(0, &header_hash, sizeof(header_hash));
 
-        c_make_memory_set_used(&_c_make_context.public_memory, public_used);
+    for (size_t i = 0; i < base_count; i += 1)
+    {
+        hash = c_make_hash_data(hash, command->items[i], c_make_get_c_string_length(command->items[i]) + 1);
     }
 
-    c_make_end_temporary_memory(temp_memory);
+#ifdef __cplusplus
+    hash = c_make_hash_data(hash, "c++", 3);
+#endif
 
-    return 0;
-}
+    char object_name[32];
+    snprintf(object_name, sizeof(object_name), "c_make_%016llx%s", (unsigned long long) hash, is_msvc ? ".obj" : ".o");
 
-C_MAKE_DEF const char *
-c_make_get_executable(const char *config_name, const char *fallback_executable)
-{
-    CMakeConfigValue value = c_make_config_get(config_name);
-    const char *result = 0;
+    const char *object_file = c_make_c_string_path_concat(_c_make_context.source_path, object_name);
 
-    if (value.is_valid)
+    if (c_make_file_exists(object_file))
     {
-        result = value.val;
+        return object_file;
+    }
 
-        if (!c_make_has_slash_or_backslash(result))
-        {
-            result = c_make_find_program(result);
-        }
+    c_make_command_append(command, "-DC_MAKE_IMPLEMENTATION", "-DC_MAKE_IMPLEMENTATION_OBJECT", "-c");
+
+    if (is_msvc)
+    {
+#ifdef __cplusplus
+        c_make_command_append(command, c_make_c_string_concat("-Tp", header_file));
+#else
+        c_make_command_append(command, c_make_c_string_concat("-Tc", header_file));
+#endif
+        c_make_command_append(command, c_make_c_string_concat("-Fo", object_file));
     }
     else
     {
-        result = c_make_find_program(fallback_executable);
+#ifdef __cplusplus
+        c_make_command_append(command, "-x", "c++", header_file, "-x", "none");
+#else
+        c_make_command_append(command, "-x", "c", header_file, "-x", "none");
+#endif
+        c_make_command_append(command, "-o", object_file);
     }
 
-    return result;
-}
+    c_make_log(CMakeLogLevelInfo, "compile c_make implementation\n");
 
-C_MAKE_DEF CMakeString
-c_make_string_concat_va(CMakeMemory *memory, size_t count, ...)
-{
-    CMakeString result = { 0, 0 };
+    bool succeeded = c_make_command_run_and_wait(*command);
 
-    va_list args;
-    va_start(args, count);
+    command->count = base_count;
 
-    for (size_t i = 0; i < count; i += 1)
+    if (!succeeded)
     {
-        CMakeString str = va_arg(args, CMakeString);
-        result.count += str.count;
+        // The fallback is a build of the whole header, so this is not a failure.
+        _c_make_context.did_fail = false;
+        return 0;
     }
 
-    va_end(args);
-
-    result.data = (char *) c_make_memory_allocate(memory, result.count + 1);
-    char *dst = result.data;
-
-    va_start(args, count);
+    CMakeTemporaryMemory temp_memory = c_make_begin_temporary_memory(0, 0);
+    CMakeDirectory *directory = c_make_directory_open(temp_memory.memory, _c_make_context.source_path);
 
-    for (size_t i = 0; i < count; i += 1)
+    if (directory)
     {
-        CMakeString str = va_arg(args, CMakeString);
+        CMakeDirectoryEntry *entry;
 
-        for (size_t j = 0; j < str.count; j += 1)
+        while ((entry = c_make_directory_get_next_entry(temp_memory.memory, directory)))
         {
-            *dst++ = str.data[j];
+            CMakeString name = entry->name;
+            CMakeString extension = c_make_string_split_right(&name, '.');
+
+            if ((name.count == 23) && c_make_string_starts_with(name, CMakeStringLiteral("c_make_")) &&
+                (c_make_strings_are_equal(extension, CMakeStringLiteral("o")) ||
+                 c_make_strings_are_equal(extension, CMakeStringLiteral("obj"))) &&
+                c_make_strcmp(entry->name.data, object_name))
+            {
+                c_make_delete_file(c_make_c_string_path_concat_with_memory(temp_memory.memory, _c_make_context.source_path, entry->name.data));
+            }
         }
-    }
 
-    va_end(args);
+        c_make_directory_close(directory);
+    }
 
-    result.data[result.count] = 0;
+    c_make_end_temporary_memory(temp_memory);
 
-    return result;
+    return object_file;
 }
 
-C_MAKE_DEF CMakeString
-c_make_string_path_concat_va(CMakeMemory *memory, size_t count, ...)
+#endif
+
+#if C_MAKE_PLATFORM_ANDROID || C_MAKE_PLATFORM_LINUX
+
+#define __C_MAKE_WATCH_FILE_INPUT 0
+#define __C_MAKE_WATCH_FILE_RESTART 1
+#define __C_MAKE_WATCH_FILE_OUTPUT 2
+
+static void
+__c_make_watch_directory(CMakeWatcher *watcher, CMakeString directory, bool is_listed)
 {
-    CMakeTemporaryMemory temp_memory = c_make_begin_temporary_memory(1, &memory);
+    size_t index = __c_make_map_find(&watcher->directory_map, directory);
 
-    CMakeString *strings = (CMakeString *) c_make_memory_allocate(temp_memory.memory, count * sizeof(*strings));
+    if (index != (size_t) -1)
+    {
+        if (is_listed)
+        {
+            watcher->directories[index].is_listed = true;
+        }
 
-    va_list args;
-    va_start(args, count);
+        return;
+    }
 
-    for (size_t i = 0; i < count; i += 1)
+    const char *path = c_make_string_to_c_string_with_memory(&watcher->memory, directory);
+    int watch_descriptor = inotify_add_watch(watcher->fd, directory.count ? path : ".",
+                                             IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR);
+
+    if (watch_descriptor < 0)
     {
-        strings[i] = va_arg(args, CMakeString);
+        c_make_log(CMakeLogLevelWarning, "could not watch directory '%s' (errno = %d: %s)\n", path, errno, strerror(errno));
+        return;
     }
 
-    va_end(args);
+    if (watcher->directory_count == watcher->directory_allocated)
+    {
+        size_t old_count = watcher->directory_allocated;
+        watcher->directory_allocated = watcher->directory_allocated ? (2 * watcher->directory_allocated) : 64;
+        watcher->directories = (CMakeWatchedDirectory *) c_make_memory_reallocate(&watcher->memory, watcher->directories,
+                                                                                 old_count * sizeof(*watcher->directories),
+                                                                                 watcher->directory_allocated * sizeof(*watcher->directories));
+    }
 
-    CMakeString result = c_make_path_concat(memory, count, strings);
+    CMakeWatchedDirectory *watched_directory = watcher->directories + watcher->directory_count;
 
-    c_make_end_temporary_memory(temp_memory);
+    watched_directory->watch_descriptor = watch_descriptor;
+    watched_directory->path = path;
+    watched_directory->is_listed = is_listed;
 
-    return result;
+    __c_make_map_insert(&watcher->memory, &watcher->directory_map, CMakeCString(path), watcher->directory_count);
+    watcher->directory_count += 1;
 }
 
-C_MAKE_DEF char *
-c_make_c_string_concat_va(CMakeMemory *memory, size_t count, ...)
+static void
+__c_make_watch_file(CMakeWatcher *watcher, const char *file_name, size_t kind)
 {
-    size_t length = 1;
-
-    va_list args;
-    va_start(args, count);
+    CMakeString path = c_make_copy_string(&watcher->file_memory, CMakeCString(file_name));
 
-    for (size_t i = 0; i < count; i += 1)
+    if (__c_make_map_find(&watcher->file_map, path) != (size_t) -1)
     {
-        const char *str = va_arg(args, const char *);
-        length += c_make_get_c_string_length(str);
+        return;
     }
 
-    va_end(args);
-
-    char *result = (char *) c_make_memory_allocate(memory, length);
-    char *dst = result;
+    __c_make_map_insert(&watcher->file_memory, &watcher->file_map, path, kind);
 
-    va_start(args, count);
+    // Watching the directory instead of the file also catches editors that
+    // replace a file by renaming a new one over it.
+    CMakeString directory = path;
+    c_make_string_split_right_path_separator(&directory);
 
-    for (size_t i = 0; i < count; i += 1)
+    if (!directory.count && (path.data[0] == '/'))
     {
-        const char *str = va_arg(args, const char *);
-        while (*str) *dst++ = *str++;
+        directory = CMakeStringLiteral("/");
     }
 
-    va_end(args);
-
-    *dst = 0;
-
-    return result;
+    __c_make_watch_directory(watcher, directory, false);
 }
 
-C_MAKE_DEF char *
-c_make_c_string_path_concat_va(CMakeMemory *memory, size_t count, ...)
+// Registers watches on all inputs of the build graph, the dependencies that were
+// recorded for its outputs and all directories that were listed by the build script.
+// The outputs are remembered, because the build itself writes them while the watches
+// are active. An output that is also an input, like an object file, is never watched.
+static void
+__c_make_watch_build(CMakeWatcher *watcher, size_t restart_file_count, const char **restart_files)
 {
-    CMakeTemporaryMemory temp_memory = c_make_begin_temporary_memory(1, &memory);
+    CMakeGraph *graph = &_c_make_context.graph;
 
-    CMakeString *strings = (CMakeString *) c_make_memory_allocate(temp_memory.memory, count * sizeof(*strings));
+    c_make_memory_set_used(&watcher->file_memory, 0);
+    watcher->file_map.count = 0;
+    watcher->file_map.allocated = 0;
+    watcher->file_map.slots = 0;
 
-    va_list args;
-    va_start(args, count);
+    for (size_t i = 0; i < restart_file_count; i += 1)
+    {
+        __c_make_watch_file(watcher, restart_files[i], __C_MAKE_WATCH_FILE_RESTART);
+    }
 
-    for (size_t i = 0; i < count; i += 1)
+    for (size_t i = 0; i < watcher->listed_count; i += 1)
     {
-        const char *str = va_arg(args, const char *);
-        strings[i] = CMakeCString(str);
+        __c_make_watch_directory(watcher, CMakeCString(watcher->listed[i]), true);
     }
 
-    va_end(args);
+    for (size_t i = 0; i < graph->count; i += 1)
+    {
+        CMakeAction *action = graph->items + i;
 
-    CMakeString result = c_make_path_concat(memory, count, strings);
+        for (size_t j = 0; j < action->output_count; j += 1)
+        {
+            CMakeString path = c_make_copy_string(&watcher->file_memory, CMakeCString(action->outputs[j]));
 
-    c_make_end_temporary_memory(temp_memory);
+            if (__c_make_map_find(&watcher->file_map, path) == (size_t) -1)
+            {
+                __c_make_map_insert(&watcher->file_memory, &watcher->file_map, path, __C_MAKE_WATCH_FILE_OUTPUT);
+            }
+        }
+    }
 
-    return result.data;
+    for (size_t i = 0; i < graph->count; i += 1)
+    {
+        CMakeAction *action = graph->items + i;
+
+        for (size_t j = 0; j < action->input_count; j += 1)
+        {
+            __c_make_watch_file(watcher, action->inputs[j], __C_MAKE_WATCH_FILE_INPUT);
+        }
+
+        for (size_t j = 0; j < action->output_count; j += 1)
+        {
+            CMakeDependencies *dependencies = __c_make_get_dependencies(action->outputs[j]);
+
+            if (dependencies)
+            {
+                for (size_t k = 0; k < dependencies->count; k += 1)
+                {
+                    __c_make_watch_file(watcher, dependencies->items[k].data, __C_MAKE_WATCH_FILE_INPUT);
+                }
+            }
+        }
+    }
 }
 
-static size_t
-__c_make_process_wait(CMakeProcessId process_id)
+static bool
+__c_make_watch_file_changed(CMakeMap *changed_files, const char *file_name)
 {
-    if (process_id == CMakeInvalidProcessId)
+    return __c_make_map_find(changed_files, CMakeCString(file_name)) != (size_t) -1;
+}
+
+// Waits for changes and marks the affected actions of the graph. Bursts of events
+// are collected until there was no event for 'debounce_time' milliseconds.
+static void
+__c_make_watch_wait(CMakeWatcher *watcher, int debounce_time, bool *full_build, bool *restart)
+{
+    CMakeGraph *graph = &_c_make_context.graph;
+    CMakeTemporaryMemory temp_memory = c_make_begin_temporary_memory(0, 0);
+    CMakeMap changed_files = { 0, 0, 0 };
+
+    union
     {
-        _c_make_context.did_fail = true;
-        return -1;
-    }
+        struct inotify_event event;
+        char data[4096];
+    } buffer;
 
-    size_t index = _c_make_context.process_group.count;
+    bool changed = false;
 
-    for (size_t i = 0; i < _c_make_context.process_group.count; i += 1)
+    for (;;)
     {
-        if (_c_make_context.process_group.items[i].id == process_id)
+        struct pollfd poll_fd;
+        poll_fd.fd = watcher->fd;
+        poll_fd.events = POLLIN;
+        poll_fd.revents = 0;
+
+        int ret = poll(&poll_fd, 1, changed ? debounce_time : -1);
+
+        if (ret < 0)
         {
-            index = i;
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            c_make_log(CMakeLogLevelError, "could not wait for file changes (errno = %d: %s)\n", errno, strerror(errno));
+            *full_build = true;
             break;
         }
-    }
 
-    if (index < _c_make_context.process_group.count)
-    {
-        CMakeProcess *process = _c_make_context.process_group.items + index;
+        if (ret == 0)
+        {
+            break;
+        }
 
-        if (!process->exited)
+        ssize_t size = read(watcher->fd, buffer.data, sizeof(buffer.data));
+
+        if (size <= 0)
         {
-            process->exited = true;
+            continue;
+        }
 
-#if C_MAKE_PLATFORM_WINDOWS
-            DWORD wait_result = WaitForSingleObject(process_id, INFINITE);
+        for (char *at = buffer.data; at < (buffer.data + size);)
+        {
+            struct inotify_event *event = (struct inotify_event *) at;
+            at += sizeof(struct inotify_event) + event->len;
 
-            if (wait_result == WAIT_FAILED)
+            if (event->mask & IN_Q_OVERFLOW)
             {
-                _c_make_context.did_fail = true;
-                process->succeeded = false;
-                // TODO: log error
+                *full_build = true;
+                changed = true;
+                continue;
             }
-            else
+
+            if (!event->len)
+            {
+                continue;
+            }
+
+            // The same directory can be watched under different paths.
+            for (size_t i = 0; i < watcher->directory_count; i += 1)
             {
-                DWORD exit_code = 0;
+                CMakeWatchedDirectory *directory = watcher->directories + i;
 
-                if (!GetExitCodeProcess(process_id, &exit_code))
+                if (directory->watch_descriptor != event->wd)
                 {
-                    _c_make_context.did_fail = true;
-                    process->succeeded = false;
-                    // TODO: log error
+                    continue;
                 }
 
-                if (exit_code != 0)
+                CMakeString path;
+
+                if (!directory->path[0])
                 {
-                    _c_make_context.did_fail = true;
-                    process->succeeded = false;
-                    // TODO: log that the process has exited with an error code
-                    // TODO: What to return here? false or true?
+                    path = c_make_copy_string(temp_memory.memory, CMakeCString(event->name));
+                }
+                else if (directory->path[c_make_get_c_string_length(directory->path) - 1] == '/')
+                {
+                    path = CMakeCString(c_make_c_string_concat_with_memory(temp_memory.memory, directory->path, event->name));
+                }
+                else
+                {
+                    path = CMakeCString(c_make_c_string_path_concat_with_memory(temp_memory.memory, directory->path, event->name));
                 }
 
-                CloseHandle(process_id);
-            }
-#else
-            for (;;)
-            {
-                int status;
+                size_t kind = __c_make_map_find(&watcher->file_map, path);
 
-                if (waitpid(process_id, &status, 0) < 0)
+                // Writes of the build to its own outputs don't start another run.
+                if (kind == __C_MAKE_WATCH_FILE_OUTPUT)
                 {
-                    _c_make_context.did_fail = true;
-                    process->succeeded = false;
-                    // TODO: log error
-                    break;
+                    continue;
                 }
 
-                if (WIFEXITED(status))
+                if (directory->is_listed && (event->mask & (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO)))
                 {
-                    int exit_code = WEXITSTATUS(status);
+                    *full_build = true;
+                    changed = true;
+                }
 
-                    if (exit_code != 0)
+                if (kind == __C_MAKE_WATCH_FILE_RESTART)
+                {
+                    *restart = true;
+                    changed = true;
+                }
+                else if (kind == __C_MAKE_WATCH_FILE_INPUT)
+                {
+                    if (__c_make_map_find(&changed_files, path) == (size_t) -1)
                     {
-                        _c_make_context.did_fail = true;
-                        process->succeeded = false;
-                        // TODO: log that the process has exited with an error code
-                        // TODO: What to return here? false or true?
+                        __c_make_map_insert(temp_memory.memory, &changed_files, path, 0);
                     }
 
-                    break;
+                    changed = true;
                 }
+            }
+        }
+    }
+
+    if (!*full_build && !*restart)
+    {
+        for (size_t i = 0; i < graph->count; i += 1)
+        {
+            CMakeAction *action = graph->items + i;
+
+            for (size_t j = 0; !action->input_changed && (j < action->input_count); j += 1)
+            {
+                action->input_changed = __c_make_watch_file_changed(&changed_files, action->inputs[j]);
+            }
+
+            for (size_t j = 0; !action->input_changed && (j < action->output_count); j += 1)
+            {
+                CMakeDependencies *dependencies = __c_make_get_dependencies(action->outputs[j]);
 
-                if (WIFSIGNALED(status))
+                for (size_t k = 0; dependencies && !action->input_changed && (k < dependencies->count); k += 1)
                 {
-                    _c_make_context.did_fail = true;
-                    process->succeeded = false;
-                    // TODO: log the signal that terminated the child
-                    break;
+                    action->input_changed = __c_make_watch_file_changed(&changed_files, dependencies->items[k].data);
                 }
             }
-#endif
         }
     }
 
-    return index;
+    c_make_end_temporary_memory(temp_memory);
 }
 
-C_MAKE_DEF CMakeProcessId
-c_make_command_run(CMakeCommand command)
+// Runs the build target and then keeps running until it is interrupted. Every
+// change to an input of the build graph reruns the actions that depend on it.
+// The config and the resolved tools stay in memory between runs. A change to
+// a directory listed by the build script reruns the whole build target, and a
+// change to the build script or the config restarts c_make.
+static int
+__c_make_watch(char **arguments, size_t restart_file_count, const char **restart_files)
 {
-    if (command.count == 0)
+    CMakeWatcher *watcher = &_c_make_context.watcher;
+    CMakeGraph *graph = &_c_make_context.graph;
+
+    int debounce_time = 100;
+    CMakeConfigValue watch_debounce_time = c_make_config_get("watch_debounce_time");
+
+    if (watch_debounce_time.is_valid)
     {
-        return CMakeInvalidProcessId;
+        uint64_t value = 0;
+        CMakeString str = CMakeCString(watch_debounce_time.val);
+
+        if (__c_make_parse_u64(&str, 10, &value) && !str.count && (value <= 60000))
+        {
+            debounce_time = (int) value;
+        }
+        else
+        {
+            c_make_log(CMakeLogLevelWarning, "invalid watch_debounce_time '%s'\n", watch_debounce_time.val);
+        }
     }
 
-    if (_c_make_context.verbose)
+    watcher->fd = -1;
+
+    bool full_build = true;
+
+    for (;;)
     {
-        CMakeTemporaryMemory temp_memory = c_make_begin_temporary_memory(0, 0);
+        bool restart = false;
+
+        _c_make_context.did_fail = false;
+        _c_make_context.cancelled = false;
+        __c_make_invalidate_file_status_cache();
+
+        if (full_build)
+        {
+            if (watcher->fd >= 0)
+            {
+                close(watcher->fd);
+            }
+
+            watcher->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+            if (watcher->fd < 0)
+            {
+                c_make_log(CMakeLogLevelError, "could not initialize inotify (errno = %d: %s)\n", errno, strerror(errno));
+                return 2;
+            }
+
+            c_make_memory_set_used(&watcher->memory, 0);
+            watcher->is_active = true;
+            watcher->directory_map.count = 0;
+            watcher->directory_map.allocated = 0;
+            watcher->directory_map.slots = 0;
+            watcher->directory_count = 0;
+            watcher->directory_allocated = 0;
+            watcher->directories = 0;
+            watcher->listed_count = 0;
+            watcher->listed_allocated = 0;
+            watcher->listed = 0;
+
+            __c_make_graph_reset(graph);
+            graph->keep_actions = true;
+            graph->only_changed_inputs = false;
+
+            _c_make_entry_(CMakeTargetBuild);
+        }
+        else
+        {
+            graph->only_changed_inputs = true;
+        }
+
+        c_make_graph_run();
+        c_make_process_wait_for_all();
+
+        __c_make_store_hash_database();
+        __c_make_store_dependency_database();
+        __c_make_store_history();
+
+        if (_c_make_context.did_fail)
+        {
+            c_make_log(CMakeLogLevelError, "build failed, waiting for changes\n");
+        }
+        else
+        {
+            c_make_log(CMakeLogLevelInfo, "build finished, waiting for changes\n");
+        }
 
-        CMakeString command_string = c_make_command_to_string(temp_memory.memory, command);
-        c_make_log(CMakeLogLevelRaw, "%" CMakeStringFmt "\n", CMakeStringArg(command_string));
+        __c_make_watch_build(watcher, restart_file_count, restart_files);
 
-        c_make_end_temporary_memory(temp_memory);
-    }
+        full_build = false;
+        __c_make_watch_wait(watcher, debounce_time, &full_build, &restart);
 
-    for (size_t i = 0; i < command.count; i += 1)
-    {
-        if (!command.items[i])
+        if (restart)
         {
-            return CMakeInvalidProcessId;
+            c_make_log(CMakeLogLevelInfo, "restart c_make\n");
+
+            close(watcher->fd);
+            __c_make_jobserver_remove_fifo();
+            execv(arguments[0], arguments);
+
+            c_make_log(CMakeLogLevelError, "could not restart c_make (errno = %d: %s)\n", errno, strerror(errno));
+            return 2;
         }
     }
+}
 
-    CMakeProcessId process_id;
+#endif
 
-#if C_MAKE_PLATFORM_WINDOWS
-    STARTUPINFO start_info = { 0 };
-    start_info.cb = sizeof(start_info);
-    start_info.hStdError  = GetStdHandle(STD_ERROR_HANDLE);
-    start_info.hStdOutput = GetStdHandle(STD_OUTPUT_HANDLE);
-    start_info.hStdInput  = GetStdHandle(STD_INPUT_HANDLE);
-    start_info.dwFlags    = STARTF_USESTDHANDLES;
+// Merges the raw profiles that clang writes during training runs into 'default.profdata',
+// if one of them is newer. gcc reads its .gcda files directly.
+static void
+__c_make_merge_profile_data(const char *profile_path)
+{
+    size_t public_used = c_make_memory_get_used(&_c_make_context.public_memory);
 
-    PROCESS_INFORMATION process_info = { 0 };
+    const char *profile_data_file = c_make_c_string_path_concat(profile_path, "default.profdata");
 
-    CMakeTemporaryMemory temp_memory = c_make_begin_temporary_memory(0, 0);
+    uint64_t profile_data_size = 0;
+    uint64_t profile_data_time = 0;
+    __c_make_get_file_info(profile_data_file, &profile_data_size, &profile_data_time);
 
-    CMakeString command_line = c_make_command_to_string(temp_memory.memory, command);
+    CMakeCommand command = { 0, 0, 0 };
+    c_make_command_append(&command, "llvm-profdata", "merge", c_make_c_string_concat("-output=", profile_data_file));
 
-    int wide_command_line_size = 2 * command_line.count;
-    LPWSTR wide_command_line = (LPWSTR) c_make_memory_allocate(temp_memory.memory, wide_command_line_size);
+    size_t base_count = command.count;
+    bool needs_merge = false;
 
-    int wide_count = MultiByteToWideChar(CP_UTF8, 0, command_line.data, command_line.count, wide_command_line, wide_command_line_size);
-    wide_command_line[wide_count] = 0;
+    CMakeDirectory *directory = c_make_directory_open(&_c_make_context.public_memory, profile_path);
 
-    BOOL result = CreateProcess(0, wide_command_line, 0, 0, TRUE, 0, 0, 0, &start_info, &process_info);
+    if (directory)
+    {
+        CMakeDirectoryEntry *entry;
 
-    c_make_end_temporary_memory(temp_memory);
+        while ((entry = c_make_directory_get_next_entry(&_c_make_context.public_memory, directory)))
+        {
+            CMakeString name = entry->name;
+            CMakeString extension = c_make_string_split_right(&name, '.');
 
-    if (!result)
-    {
-        CMakeTemporaryMemory temp_memory = c_make_begin_temporary_memory(0, 0);
+            if (name.count && c_make_strings_are_equal(extension, CMakeStringLiteral("profraw")))
+            {
+                const char *raw_profile_file = c_make_c_string_path_concat(profile_path, entry->name.data);
 
-        CMakeString command_string = c_make_command_to_string(temp_memory.memory, command);
-        c_make_log(CMakeLogLevelError, "could not run command (GetLastError = %lu): %" CMakeStringFmt "\n", GetLastError(), CMakeStringArg(command_string));
+                uint64_t size, modification_time;
 
-        c_make_end_temporary_memory(temp_memory);
-        return CMakeInvalidProcessId;
-    }
+                if (__c_make_get_file_info(raw_profile_file, &size, &modification_time) &&
+                    (modification_time > profile_data_time))
+                {
+                    needs_merge = true;
+                }
 
-    CloseHandle(process_info.hThread);
+                c_make_command_append(&command, raw_profile_file);
+            }
+        }
 
-    process_id = process_info.hProcess;
-#else
-    CMakeTemporaryMemory temp_memory = c_make_begin_temporary_memory(0, 0);
-    char **command_line = (char **) c_make_memory_allocate(temp_memory.memory, (command.count + 1) * sizeof(char *));
+        c_make_directory_close(directory);
+    }
 
-    for (size_t i = 0; i < command.count; i += 1)
+    if (needs_merge && (command.count > base_count))
     {
-        command_line[i] = (char *) command.items[i];
+        const char *llvm_profdata = c_make_get_llvm_profdata();
+
+        if (llvm_profdata)
+        {
+            command.items[0] = llvm_profdata;
+
+            c_make_log(CMakeLogLevelInfo, "merge profile data\n");
+            c_make_command_run_and_wait(command);
+        }
+        else
+        {
+            c_make_log(CMakeLogLevelError, "could not find llvm-profdata to merge the profile data in '%s'\n", profile_path);
+            _c_make_context.did_fail = true;
+        }
     }
 
-    command_line[command.count] = 0;
+    c_make_memory_set_used(&_c_make_context.public_memory, public_used);
+}
 
-    pid_t pid = fork();
+// Writes the build type, the target cpu and clones, and for 'pgo_use' the time of the newest
+// profile data, to 'c_make_build_settings.txt'. The file is only rewritten if one of them
+// changed, and c_make_needs_rebuild treats it as an input of every output.
+static void
+__c_make_update_build_settings(void)
+{
+    size_t public_used = c_make_memory_get_used(&_c_make_context.public_memory);
 
-    if (pid < 0)
-    {
-        c_make_end_temporary_memory(temp_memory);
-        // TODO: log error
-        fprintf(stderr, "Could not fork\n");
-        return CMakeInvalidProcessId;
-    }
+    CMakeBuildType build_type = c_make_get_build_type();
+    uint64_t profile_time = 0;
 
-    if (pid == 0)
+    if ((build_type == CMakeBuildTypePgoGenerate) || (build_type == CMakeBuildTypePgoUse))
     {
-        int ret = execvp(command_line[0], command_line);
+        const char *profile_path = c_make_get_profile_path();
 
-        if (ret < 0)
+        if (!c_make_directory_exists(profile_path))
         {
-            // TODO: log error
-            fprintf(stderr, "Could not execvp: %s\n", strerror(errno));
-            exit(1);
+            c_make_create_directory_recursively(profile_path);
         }
 
-        /* unreachable */
-        return CMakeInvalidProcessId;
-    }
+        if (build_type == CMakeBuildTypePgoUse)
+        {
+            __c_make_merge_profile_data(profile_path);
 
-    c_make_end_temporary_memory(temp_memory);
+            CMakeDirectory *directory = c_make_directory_open(&_c_make_context.public_memory, profile_path);
 
-    process_id = pid;
-#endif
+            if (directory)
+            {
+                CMakeDirectoryEntry *entry;
 
-    if (_c_make_context.process_group.count == _c_make_context.process_group.allocated)
-    {
-        size_t old_count = _c_make_context.process_group.allocated;
-        _c_make_context.process_group.allocated += 16;
-        _c_make_context.process_group.items =
-            (CMakeProcess *) c_make_memory_reallocate(&_c_make_context.permanent_memory,
-                                                      _c_make_context.process_group.items,
-                                                      old_count * sizeof(*_c_make_context.process_group.items),
-                                                      _c_make_context.process_group.allocated * sizeof(*_c_make_context.process_group.items));
-    }
+                while ((entry = c_make_directory_get_next_entry(&_c_make_context.public_memory, directory)))
+                {
+                    uint64_t size, modification_time;
 
-    CMakeProcess *process = _c_make_context.process_group.items + _c_make_context.process_group.count;
-    _c_make_context.process_group.count += 1;
+                    if (c_make_strings_are_equal(entry->name, CMakeStringLiteral(".")) ||
+                        c_make_strings_are_equal(entry->name, CMakeStringLiteral("..")))
+                    {
+                        continue;
+                    }
 
-    process->id = process_id;
-    process->exited = false;
-    process->succeeded = true;
+                    if (__c_make_get_file_info(c_make_c_string_path_concat(profile_path, entry->name.data), &size, &modification_time) &&
+                        (modification_time > profile_time))
+                    {
+                        profile_time = modification_time;
+                    }
+                }
 
-    if (_c_make_context.sequential)
-    {
-        __c_make_process_wait(process_id);
+                c_make_directory_close(directory);
+            }
+        }
     }
 
-    return process_id;
-}
-
-C_MAKE_DEF CMakeProcessId
-c_make_command_run_and_reset(CMakeCommand *command)
-{
-    CMakeProcessId process_id = c_make_command_run(*command);
-    command->count = 0;
-    return process_id;
-}
+    CMakeConfigValue build_type_value = c_make_config_get("build_type");
+    CMakeConfigValue target_cpu_value = c_make_config_get("target_cpu");
 
-C_MAKE_DEF bool
-c_make_process_wait(CMakeProcessId process_id)
-{
-    size_t index = __c_make_process_wait(process_id);
+    char profile_time_string[32];
+    snprintf(profile_time_string, sizeof(profile_time_string), "%llu", (unsigned long long) profile_time);
 
-    if (index < _c_make_context.process_group.count)
-    {
-        CMakeProcess *process = _c_make_context.process_group.items + index;
+    CMakeString content = CMakeCString(c_make_c_string_concat("build_type = \"", build_type_value.is_valid ? build_type_value.val : "debug", "\"\n",
+                                                              "target_cpu = \"", target_cpu_value.is_valid ? target_cpu_value.val : "", "\"\n",
+                                                              "target_clones = \"", __c_make_get_target_clones(c_make_get_target_architecture()), "\"\n",
+                                                              "profile_time = \"", profile_time_string, "\"\n"));
 
-        assert(process->exited);
-        bool succeeded = process->succeeded;
+    const char *build_settings_file = c_make_c_string_path_concat_with_memory(&_c_make_context.permanent_memory,
+                                                                              _c_make_context.build_path, "c_make_build_settings.txt");
 
-        _c_make_context.process_group.count -= 1;
-        _c_make_context.process_group.items[index] = _c_make_context.process_group.items[_c_make_context.process_group.count];
+    CMakeString old_content;
 
-        return succeeded;
+    if (!c_make_read_entire_file(build_settings_file, &old_content) || !c_make_strings_are_equal(old_content, content))
+    {
+        c_make_write_entire_file(build_settings_file, content);
     }
 
-    return false;
-}
+    _c_make_context.build_settings_file = build_settings_file;
 
-C_MAKE_DEF bool
-c_make_command_run_and_reset_and_wait(CMakeCommand *command)
-{
-    CMakeProcessId process_id = c_make_command_run(*command);
-    command->count = 0;
-    return c_make_process_wait(process_id);
+    c_make_memory_set_used(&_c_make_context.public_memory, public_used);
 }
 
-C_MAKE_DEF bool
-c_make_command_run_and_wait(CMakeCommand command)
+// Builds several build directories at the same time. Every directory is built by its own
+// c_make process with its own config. They all share the jobserver of this process, so that
+// their commands are interleaved under one 'max_jobs' budget.
+static int
+__c_make_build_directories(const char *c_make_executable_file, size_t directory_count, char **directories,
+                           size_t option_count, char **options)
 {
-    CMakeProcessId process_id = c_make_command_run(command);
-    return c_make_process_wait(process_id);
-}
+    // The nested builds collect the output of their commands, their own output is passed through.
+    c_make_config_set("capture_output", "off");
 
-C_MAKE_DEF bool
-c_make_process_wait_for_all(void)
-{
-    bool result = true;
+    // Without a build directory there is no history, which would only measure the nested builds.
+    _c_make_context.build_path = 0;
 
-    while (_c_make_context.process_group.count)
+    CMakeCommand command = { 0, 0, 0 };
+
+    for (size_t i = 0; i < directory_count; i += 1)
     {
-        result = result & c_make_process_wait(_c_make_context.process_group.items[0].id);
+        if (!c_make_file_exists(c_make_c_string_path_concat(directories[i], "c_make.txt")))
+        {
+            c_make_log(CMakeLogLevelError, "the build directory '%s' was never setup\n", directories[i]);
+            return 2;
+        }
     }
 
-    return result;
-}
+    for (size_t i = 0; i < directory_count; i += 1)
+    {
+        command.count = 0;
 
-#if !defined(C_MAKE_NO_ENTRY_POINT)
+        c_make_command_append(&command, c_make_executable_file, "build", directories[i]);
+        c_make_command_append_slice(&command, option_count, (const char **) options);
+
+        c_make_command_run(command);
+    }
+
+    c_make_process_wait_for_all();
+
+    return _c_make_context.did_fail ? 1 : 0;
+}
 
 static void
 print_help(const char *program_name)
 {
-    fprintf(stderr, "usage: %s <command> <build-directory> [--verbose] [--sequential] [<key>=\"<value>\" ...]\n", program_name);
+    fprintf(stderr, "usage: %s <command> <build-directory>... [--verbose] [--sequential] [--fail-fast] [--trace] [--report] [--jobs <n>] [--shard <i>/<n>] [<key>=\"<value>\" ...]\n", program_name);
     fprintf(stderr, "\n");
     fprintf(stderr, "commands:\n");
     fprintf(stderr, "    setup                Create and configure a new build directory.\n");
     fprintf(stderr, "    build                Run the build target on the given build directory.\n");
+    fprintf(stderr, "                         If none of the files of the last successful build\n");
+    fprintf(stderr, "                         changed, it returns without running the build script.\n");
+    fprintf(stderr, "                         With more than one build directory, all of them are\n");
+    fprintf(stderr, "                         built at the same time and share '--jobs'.\n");
     fprintf(stderr, "    install              Run the install target on the given build directory.\n");
+    fprintf(stderr, "    test                 Run the test target on the given build directory and then\n");
+    fprintf(stderr, "                         all tests it added in parallel. The results are written\n");
+    fprintf(stderr, "                         to 'c_make_test_report.json' in the build directory.\n");
+    fprintf(stderr, "    watch                Run the build target on the given build directory and\n");
+    fprintf(stderr, "                         keep watching its inputs. A change reruns only the\n");
+    fprintf(stderr, "                         affected commands. This is only supported on linux.\n");
     fprintf(stderr, "\n");
     fprintf(stderr, "options:\n");
     fprintf(stderr, "    --verbose            This will print out the configuration and all the\n");
@@ -4252,6 +12388,19 @@ print_help(const char *program_name)
     fprintf(stderr, "    --sequential         This will make c_make_command_run wait for the command\n");
     fprintf(stderr, "                         to terminate. This effectively sequentializes the\n");
     fprintf(stderr, "                         build process.\n");
+    fprintf(stderr, "    --fail-fast          Terminate all running commands as soon as one command\n");
+    fprintf(stderr, "                         fails and don't start any new ones. This is the same\n");
+    fprintf(stderr, "                         as setting the option 'fail_fast' to 'on'.\n");
+    fprintf(stderr, "    --trace              Record the start and end time, exit status and resource\n");
+    fprintf(stderr, "                         usage of every command and write them to the trace file\n");
+    fprintf(stderr, "                         'c_make_trace.json' in the build directory. The file can\n");
+    fprintf(stderr, "                         be opened with chrome://tracing or ui.perfetto.dev.\n");
+    fprintf(stderr, "    --report             Print the critical path of every build graph after it\n");
+    fprintf(stderr, "                         ran and how much faster more cores could make it.\n");
+    fprintf(stderr, "    --jobs <n>, -j <n>   Run at most <n> commands at the same time. This\n");
+    fprintf(stderr, "                         overrides the 'max_jobs' option.\n");
+    fprintf(stderr, "    --shard <i>/<n>      Only run every <n>th test starting with the <i>th, to\n");
+    fprintf(stderr, "                         split the tests across <n> machines.\n");
     fprintf(stderr, "\n");
     fprintf(stderr, "Every build directory has a configuration which is stored in 'c_make.txt'.\n");
     fprintf(stderr, "It consists of all the options that define a build. All options can be set\n");
@@ -4263,8 +12412,27 @@ print_help(const char *program_name)
     fprintf(stderr, "    android_aapt_executable      Path to the android aapt executable.\n");
     fprintf(stderr, "    android_platform_jar         Path to the android platforms 'android.jar'.\n");
     fprintf(stderr, "    android_zipalign_executable  Path to the android zipalign executable.\n");
-    fprintf(stderr, "    build_type                   Build type. Either 'debug', 'reldebug' or 'release'.\n");
-    fprintf(stderr, "                                 Default: 'debug'\n");
+    fprintf(stderr, "    build_type                   Build type. Either 'debug', 'reldebug', 'release', 'release_lto',\n");
+    fprintf(stderr, "                                 'pgo_generate' or 'pgo_use'. 'release_lto' enables link time\n");
+    fprintf(stderr, "                                 optimization. Programs built with 'pgo_generate' record profile\n");
+    fprintf(stderr, "                                 data in '<build-directory>/pgo' when they run, which a\n");
+    fprintf(stderr, "                                 following 'pgo_use' build optimizes for. Changing the build\n");
+    fprintf(stderr, "                                 type rebuilds all outputs. Default: 'debug'\n");
+    fprintf(stderr, "    cache_directory              Directory of the compile cache. If set, gcc and clang compiles\n");
+    fprintf(stderr, "                                 are looked up in the cache by the compiler, the command line\n");
+    fprintf(stderr, "                                 and the preprocessed sources before the compiler runs.\n");
+    fprintf(stderr, "    cache_hard_link              Either 'on' or 'off'. Hard link cached outputs instead of\n");
+    fprintf(stderr, "                                 copying them. Default: 'off'\n");
+    fprintf(stderr, "    cache_max_size               Maximum size of the compile cache in MiB. The least recently\n");
+    fprintf(stderr, "                                 used files are deleted when it grows larger. Default: '5120'\n");
+    fprintf(stderr, "    capture_output               Either 'on' or 'off'. If enabled, the output of every command\n");
+    fprintf(stderr, "                                 is collected and printed in one piece when the command\n");
+    fprintf(stderr, "                                 exits. Default: 'on'\n");
+    fprintf(stderr, "    content_hash                 Either 'on' or 'off'. If enabled, an input of c_make_needs_rebuild\n");
+    fprintf(stderr, "                                 only counts as changed if its content hash differs from the\n");
+    fprintf(stderr, "                                 last build. The hashes are stored in 'c_make_hashes.txt'.\n");
+    fprintf(stderr, "                                 Default: 'off'\n");
+    fprintf(stderr, "    fail_fast                    Either 'on' or 'off'. See '--fail-fast'. Default: 'off'\n");
     fprintf(stderr, "    host_ar                      Path to or name of the host archive/library program.\n");
     fprintf(stderr, "    host_c_compiler              Path to or name of the host c compiler.\n");
     fprintf(stderr, "    host_cpp_compiler            Path to or name of the host c++ compiler.\n");
@@ -4273,20 +12441,45 @@ print_help(const char *program_name)
     fprintf(stderr, "    java_jarsigner_executable    Path to the java jarsigner executable.\n");
     fprintf(stderr, "    java_javac_executable        Path to the java compiler (javac).\n");
     fprintf(stderr, "    java_keytool_executable      Path to the java keytool executable.\n");
+    fprintf(stderr, "    jobserver                    Either 'fifo', 'pipe' or 'off'. Kind of the make jobserver that\n");
+    fprintf(stderr, "                                 c_make creates for its commands, so that nested builds share\n");
+    fprintf(stderr, "                                 'max_jobs'. A jobserver in MAKEFLAGS is always used instead.\n");
+    fprintf(stderr, "                                 Default: 'fifo'\n");
+    fprintf(stderr, "    llvm_profdata_executable     Path to the llvm-profdata executable. It merges the profile data\n");
+    fprintf(stderr, "                                 of clang for 'pgo_use'.\n");
+    fprintf(stderr, "    max_jobs                     Maximum number of commands that run at the same time.\n");
+    fprintf(stderr, "                                 Defaults to the number of online processors.\n");
+    fprintf(stderr, "    memory_budget                Memory in MiB that running commands may use together. Commands\n");
+    fprintf(stderr, "                                 are weighted by the peak memory measured in earlier builds,\n");
+    fprintf(stderr, "                                 which is stored in 'c_make_history.txt'. Defaults to the\n");
+    fprintf(stderr, "                                 available memory on linux and windows.\n");
+    fprintf(stderr, "    program.<name>               Path of the program <name> as found in PATH by\n");
+    fprintf(stderr, "                                 c_make_find_program. Remove it to search again.\n");
     fprintf(stderr, "    target_architecture          Architecture of the target. Either 'amd64', 'aarch64',\n");
     fprintf(stderr, "                                 'riscv64', 'wasm32' or 'wasm64'. The default is the\n");
     fprintf(stderr, "                                 host architecture.\n");
     fprintf(stderr, "    target_ar                    Path to or name of the target archive/library program.\n");
     fprintf(stderr, "    target_c_compiler            Path to or name of the target c compiler.\n");
     fprintf(stderr, "    target_c_flags               Flags for the target c build.\n");
+    fprintf(stderr, "    target_clones                Comma separated list of the target_clones that functions marked\n");
+    fprintf(stderr, "                                 with C_MAKE_TARGET_CLONES are compiled for. See\n");
+    fprintf(stderr, "                                 c_make_command_append_target_clones.\n");
     fprintf(stderr, "    target_cpp_compiler          Path to or name of the target c++ compiler.\n");
     fprintf(stderr, "    target_cpp_flags             Flags for the target c++ build.\n");
+    fprintf(stderr, "    target_cpu                   CPU to optimize for, e.g. 'native', 'x86-64-v3' or 'neoverse-v1'.\n");
+    fprintf(stderr, "                                 Passed as '-march' (amd64) or '-mcpu' (other architectures) to\n");
+    fprintf(stderr, "                                 gcc and clang and as '-arch' to msvc. Default: unset\n");
     fprintf(stderr, "    target_platform              Platform of the target. Either 'android', 'freebsd',\n");
     fprintf(stderr, "                                 'windows', 'linux', 'macos' or 'web'. The default is\n");
     fprintf(stderr, "                                 the host platform.\n");
+    fprintf(stderr, "    test_timeout                 Seconds after which a test that doesn't set its own timeout is\n");
+    fprintf(stderr, "                                 killed, on posix together with its child processes.\n");
+    fprintf(stderr, "                                 Default: '300'\n");
     fprintf(stderr, "    visual_studio_root_path      Path to the visual studio install. This should be the directory\n");
     fprintf(stderr, "                                 in which you find 'VC\\Tools\\MSVC\\<version>'.\n");
     fprintf(stderr, "    visual_studio_version        The version of the visual studio install.\n");
+    fprintf(stderr, "    watch_debounce_time          Milliseconds without file changes before 'watch' starts a\n");
+    fprintf(stderr, "                                 new build. Default: '100'\n");
     fprintf(stderr, "    windows_rc_executable        Path to the windows resource compiler executable.\n");
     fprintf(stderr, "    windows_sdk_root_path        Path to the windows sdk. This should be the directory\n");
     fprintf(stderr, "                                 in which you find 'bin', 'Include' and 'Lib'.\n");
@@ -4378,7 +12571,27 @@ int main(int argument_count, char **arguments)
     _c_make_context.build_path = build_directory;
     _c_make_context.source_path = source_directory;
 
-    for (int i = 3; i < argument_count; i += 1)
+    // 'build' takes more than one build directory. Options always start with a '-' and
+    // config values contain a '='.
+    int first_option = 3;
+
+    if (c_make_strings_are_equal(command, CMakeStringLiteral("build")))
+    {
+        while (first_option < argument_count)
+        {
+            CMakeString argument = CMakeCString(arguments[first_option]);
+
+            if (!argument.count || (argument.data[0] == '-') ||
+                (c_make_string_find(argument, CMakeStringLiteral("=")) < argument.count))
+            {
+                break;
+            }
+
+            first_option += 1;
+        }
+    }
+
+    for (int i = first_option; i < argument_count; i += 1)
     {
         CMakeString argument = CMakeCString(arguments[i]);
 
@@ -4390,6 +12603,63 @@ int main(int argument_count, char **arguments)
         {
             _c_make_context.sequential = true;
         }
+        else if (c_make_strings_are_equal(argument, CMakeStringLiteral("--fail-fast")))
+        {
+            _c_make_context.fail_fast = true;
+        }
+        else if (c_make_strings_are_equal(argument, CMakeStringLiteral("--report")))
+        {
+            _c_make_context.report_enabled = true;
+        }
+        else if (c_make_strings_are_equal(argument, CMakeStringLiteral("--trace")))
+        {
+            _c_make_context.trace_enabled = true;
+            _c_make_context.trace.start_time = __c_make_get_time_in_microseconds();
+        }
+        else if ((c_make_strings_are_equal(argument, CMakeStringLiteral("--jobs")) ||
+                  c_make_strings_are_equal(argument, CMakeStringLiteral("-j"))) && ((i + 1) < argument_count))
+        {
+            int max_jobs = 0;
+            CMakeString value = CMakeCString(arguments[i + 1]);
+
+            if (c_make_parse_integer(&value, &max_jobs) && !value.count && (max_jobs > 0))
+            {
+                _c_make_context.max_jobs = max_jobs;
+            }
+            else
+            {
+                c_make_log(CMakeLogLevelWarning, "invalid number of jobs '%s'\n", arguments[i + 1]);
+            }
+
+            i += 1;
+        }
+        else if (c_make_strings_are_equal(argument, CMakeStringLiteral("--shard")))
+        {
+            uint64_t shard_index = 0, shard_count = 0;
+            CMakeString value = CMakeCString(((i + 1) < argument_count) ? arguments[i + 1] : "");
+
+            if (__c_make_parse_u64(&value, 10, &shard_index) && (c_make_string_split_left(&value, '/').count == 0) &&
+                __c_make_parse_u64(&value, 10, &shard_count) && !value.count &&
+                (shard_index >= 1) && (shard_index <= shard_count))
+            {
+                _c_make_context.test_shard_index = (size_t) shard_index;
+                _c_make_context.test_shard_count = (size_t) shard_count;
+            }
+            else
+            {
+                // Running all tests instead would make every shard of a CI run the whole suite.
+                c_make_log(CMakeLogLevelError, "invalid shard '%s', expected <i>/<n> with 1 <= i <= n\n",
+                           ((i + 1) < argument_count) ? arguments[i + 1] : "");
+                _c_make_context.did_fail = true;
+            }
+
+            i += 1;
+        }
+    }
+
+    if (_c_make_context.did_fail)
+    {
+        return 1;
     }
 
 #if C_MAKE_PLATFORM_WINDOWS
@@ -4408,6 +12678,25 @@ int main(int argument_count, char **arguments)
 
     const char *c_make_source_files[] = { c_make_source_file, __FILE__ };
 
+    uint64_t build_log_key = 0;
+
+    if (c_make_strings_are_equal(command, CMakeStringLiteral("build")) && (first_option == 3))
+    {
+        const char *build_log_files[] = { c_make_executable_file, c_make_source_file, __FILE__ };
+
+        build_log_key = __c_make_get_build_log_key(config_file_name, CMakeArrayCount(build_log_files), build_log_files);
+
+        if (__c_make_build_log_is_up_to_date(build_log_key))
+        {
+            if (_c_make_context.verbose)
+            {
+                c_make_log(CMakeLogLevelInfo, "nothing changed since the last build\n");
+            }
+
+            return 0;
+        }
+    }
+
     if (c_make_needs_rebuild(c_make_executable_file, CMakeArrayCount(c_make_source_files), c_make_source_files))
     {
         size_t public_used = c_make_memory_get_used(&_c_make_context.public_memory);
@@ -4441,13 +12730,47 @@ int main(int argument_count, char **arguments)
         c_make_command_append_command_line(&command, CMakeStr(C_MAKE_COMPILER_FLAGS));
         c_make_command_append(&command, "-DC_MAKE_COMPILER_FLAGS=" CMakeStr(C_MAKE_COMPILER_FLAGS));
 #endif
-        c_make_command_append_output_executable(&command, "c_make", c_make_get_host_platform());
-        c_make_command_append(&command, c_make_source_file);
-        c_make_command_append_default_linker_flags(&command, c_make_get_host_architecture());
 
-        c_make_log(CMakeLogLevelInfo, "rebuild c_make\n");
+        bool rebuilt = false;
+
+#if !defined(C_MAKE_STATIC)
+        // Only the build script gets compiled, the implementation is linked from a cached object.
+        size_t base_count = command.count;
+        const char *implementation_object = __c_make_get_implementation_object(&command, __FILE__);
+
+        if (implementation_object)
+        {
+            c_make_command_append(&command, "-DC_MAKE_SEPARATE_IMPLEMENTATION");
+            c_make_command_append_output_executable(&command, "c_make", c_make_get_host_platform());
+            c_make_command_append(&command, c_make_source_file, implementation_object);
+            c_make_command_append_default_linker_flags(&command, c_make_get_host_architecture());
+
+            c_make_log(CMakeLogLevelInfo, "rebuild c_make\n");
+
+            rebuilt = c_make_command_run_and_wait(command);
+
+            if (!rebuilt)
+            {
+                _c_make_context.did_fail = false;
+                c_make_log(CMakeLogLevelWarning, "could not link against the implementation object, compile the whole header\n");
+            }
+
+            command.count = base_count;
+        }
+#endif
+
+        if (!rebuilt)
+        {
+            c_make_command_append_output_executable(&command, "c_make", c_make_get_host_platform());
+            c_make_command_append(&command, c_make_source_file);
+            c_make_command_append_default_linker_flags(&command, c_make_get_host_architecture());
+
+            c_make_log(CMakeLogLevelInfo, "rebuild c_make\n");
 
-        if (!c_make_command_run_and_wait(command))
+            rebuilt = c_make_command_run_and_wait(command);
+        }
+
+        if (!rebuilt)
         {
             c_make_rename_file(c_make_temp_file, c_make_executable_file);
         }
@@ -4472,6 +12795,12 @@ int main(int argument_count, char **arguments)
         c_make_memory_set_used(&_c_make_context.public_memory, public_used);
     }
 
+    if (first_option > 3)
+    {
+        return __c_make_build_directories(c_make_executable_file, (size_t) (first_option - 2), arguments + 2,
+                                          (size_t) (argument_count - first_option), arguments + first_option);
+    }
+
     _c_make_context.target_platform = c_make_get_host_platform();
     _c_make_context.target_architecture = c_make_get_host_architecture();
     _c_make_context.build_type = CMakeBuildTypeDebug;
@@ -4784,8 +13113,18 @@ int main(int argument_count, char **arguments)
 
         _c_make_entry_(CMakeTargetSetup);
 
+        c_make_graph_run();
         c_make_process_wait_for_all();
 
+        // Look up the default tools once, so that their paths are stored with the config.
+        public_used = c_make_memory_get_used(&_c_make_context.public_memory);
+
+        c_make_get_target_ar();
+        c_make_get_target_c_compiler();
+        c_make_get_target_cpp_compiler();
+
+        c_make_memory_set_used(&_c_make_context.public_memory, public_used);
+
         c_make_log(CMakeLogLevelInfo, "store config:\n");
         c_make_print_config();
 
@@ -4802,7 +13141,9 @@ int main(int argument_count, char **arguments)
         c_make_memory_set_used(&_c_make_context.public_memory, public_used);
     }
     else if (c_make_strings_are_equal(command, CMakeStringLiteral("build")) ||
-             c_make_strings_are_equal(command, CMakeStringLiteral("install")))
+             c_make_strings_are_equal(command, CMakeStringLiteral("install")) ||
+             c_make_strings_are_equal(command, CMakeStringLiteral("test")) ||
+             c_make_strings_are_equal(command, CMakeStringLiteral("watch")))
     {
         if (!c_make_directory_exists(build_directory))
         {
@@ -4827,16 +13168,49 @@ int main(int argument_count, char **arguments)
             c_make_print_config();
         }
 
+        __c_make_update_build_settings();
+
+        if (c_make_strings_are_equal(command, CMakeStringLiteral("watch")))
+        {
+#if C_MAKE_PLATFORM_ANDROID || C_MAKE_PLATFORM_LINUX
+            const char *restart_files[] = { config_file_name, c_make_source_file, __FILE__ };
+
+            return __c_make_watch(arguments, CMakeArrayCount(restart_files), restart_files);
+#else
+            c_make_log(CMakeLogLevelError, "watch mode is only supported on linux\n");
+            return 2;
+#endif
+        }
+
         if (c_make_strings_are_equal(command, CMakeStringLiteral("build")))
         {
+            // 'pgo_use' merges new profile data on every build, which the build log can't check.
+            __c_make_begin_build_log((c_make_get_build_type() != CMakeBuildTypePgoUse) ? build_log_key : 0);
+
             _c_make_entry_(CMakeTargetBuild);
         }
+        else if (c_make_strings_are_equal(command, CMakeStringLiteral("test")))
+        {
+            _c_make_entry_(CMakeTargetTest);
+        }
         else
         {
             _c_make_entry_(CMakeTargetInstall);
         }
 
+        c_make_graph_run();
         c_make_process_wait_for_all();
+
+        // Tests run after the graph, so they can use everything the test target builds.
+        c_make_test_run();
+
+        __c_make_store_build_log();
+        __c_make_store_hash_database();
+        __c_make_store_dependency_database();
+        __c_make_store_history();
+        __c_make_evict_cache();
+        __c_make_store_trace();
+        __c_make_store_test_report();
     }
 
     return _c_make_context.did_fail ? 1 : 0;
@@ -4844,7 +13218,7 @@ int main(int argument_count, char **arguments)
 
 #endif // !defined(C_MAKE_NO_ENTRY_POINT)
 
-#endif // defined(C_MAKE_IMPLEMENTATION)
+#endif // defined(C_MAKE_IMPLEMENTATION) && !defined(C_MAKE_SEPARATE_IMPLEMENTATION)
 
 #ifndef __C_MAKE_STRIP_PREFIX__
 #define __C_MAKE_STRIP_PREFIX__
@@ -4871,6 +13245,11 @@ int main(int argument_count, char **arguments)
 #    define ConfigValue CMakeConfigValue
 #    define SoftwarePackage CMakeSoftwarePackage
 #    define AndroidSdk CMakeAndroidSdk
+#    define Action CMakeAction
+#    define Graph CMakeGraph
+#    define FileList CMakeFileList
+#    define InstallFile CMakeInstallFile
+#    define InstallManifest CMakeInstallManifest
 #    define StringLiteral CMakeStringLiteral
 #    define CString CMakeCString
 #    define string_replace_all c_make_string_replace_all
@@ -4890,6 +13269,7 @@ int main(int argument_count, char **arguments)
 #    define TargetSetup CMakeTargetSetup
 #    define TargetBuild CMakeTargetBuild
 #    define TargetInstall CMakeTargetInstall
+#    define TargetTest CMakeTargetTest
 #    define LogLevel CMakeLogLevel
 #    define LogLevelRaw CMakeLogLevelRaw
 #    define LogLevelInfo CMakeLogLevelInfo
@@ -4913,6 +13293,9 @@ int main(int argument_count, char **arguments)
 #    define BuildTypeDebug CMakeBuildTypeDebug
 #    define BuildTypeRelDebug CMakeBuildTypeRelDebug
 #    define BuildTypeRelease CMakeBuildTypeRelease
+#    define BuildTypeReleaseLto CMakeBuildTypeReleaseLto
+#    define BuildTypePgoGenerate CMakeBuildTypePgoGenerate
+#    define BuildTypePgoUse CMakeBuildTypePgoUse
 #    define set_failed c_make_set_failed
 #    define get_failed c_make_get_failed
 #    define memory_allocate c_make_memory_allocate
@@ -4932,6 +13315,8 @@ int main(int argument_count, char **arguments)
 #    define command_append_input_static_library c_make_command_append_input_static_library
 #    define command_append_default_compiler_flags c_make_command_append_default_compiler_flags
 #    define command_append_default_linker_flags c_make_command_append_default_linker_flags
+#    define command_append_target_clones c_make_command_append_target_clones
+#    define command_append_dependency_file c_make_command_append_dependency_file
 #    define command_to_string c_make_command_to_string
 #    define strings_are_equal c_make_strings_are_equal
 #    define string_starts_with c_make_string_starts_with
@@ -4953,8 +13338,11 @@ int main(int argument_count, char **arguments)
 #    define get_target_architecture c_make_get_target_architecture
 #    define get_build_type c_make_get_build_type
 #    define get_build_path c_make_get_build_path
+#    define get_profile_path c_make_get_profile_path
 #    define get_source_path c_make_get_source_path
 #    define get_install_prefix c_make_get_install_prefix
+#    define get_processor_count c_make_get_processor_count
+#    define get_max_jobs c_make_get_max_jobs
 #    define get_host_ar c_make_get_host_ar
 #    define get_target_ar c_make_get_target_ar
 #    define get_host_c_compiler c_make_get_host_c_compiler
@@ -4982,16 +13370,21 @@ int main(int argument_count, char **arguments)
 #    define get_java_jarsigner c_make_get_java_jarsigner
 #    define get_java_javac c_make_get_java_javac
 #    define get_java_keytool c_make_get_java_keytool
+#    define get_llvm_profdata c_make_get_llvm_profdata
 #    define setup_java c_make_setup_java
 #    define config_set c_make_config_set
 #    define config_get c_make_config_get
 #    define store_config c_make_store_config
 #    define load_config c_make_load_config
+#    define hash_data c_make_hash_data
+#    define hash_file c_make_hash_file
 #    define needs_rebuild c_make_needs_rebuild
+#    define needs_rebuild_ignore_dependencies c_make_needs_rebuild_ignore_dependencies
 #    define needs_rebuild_single_source c_make_needs_rebuild_single_source
 #    define directory_open c_make_directory_open
 #    define directory_get_next_entry c_make_directory_get_next_entry
 #    define directory_close c_make_directory_close
+#    define glob_files c_make_glob_files
 #    define file_exists c_make_file_exists
 #    define directory_exists c_make_directory_exists
 #    define create_directory c_make_create_directory
@@ -5001,16 +13394,25 @@ int main(int argument_count, char **arguments)
 #    define copy_file c_make_copy_file
 #    define rename_file c_make_rename_file
 #    define delete_file c_make_delete_file
+#    define install_manifest_add c_make_install_manifest_add
+#    define install c_make_install
 #    define has_slash_or_backslash c_make_has_slash_or_backslash
 #    define get_environment_variable c_make_get_environment_variable
 #    define find_program c_make_find_program
 #    define get_executable c_make_get_executable
 #    define command_run c_make_command_run
+#    define command_run_with_redirect c_make_command_run_with_redirect
 #    define command_run_and_reset c_make_command_run_and_reset
 #    define process_wait c_make_process_wait
 #    define command_run_and_reset_and_wait c_make_command_run_and_reset_and_wait
 #    define command_run_and_wait c_make_command_run_and_wait
 #    define process_wait_for_all c_make_process_wait_for_all
+#    define graph_add_action c_make_graph_add_action
+#    define graph_set_memory_estimate c_make_graph_set_memory_estimate
+#    define graph_add_executable c_make_graph_add_executable
+#    define graph_run c_make_graph_run
+#    define test_add c_make_test_add
+#    define test_run c_make_test_run
 #    define is_msvc_library_manager c_make_is_msvc_library_manager
 #    define compiler_is_msvc c_make_compiler_is_msvc
 #    define config_set_if_not_exists c_make_config_set_if_not_exists